@@ -0,0 +1,228 @@
+/*
+ * File       : bench.c
+ * Description: Benchmark of the searches of libkmul over fixed suites of
+ *              multipliers, reporting the rate of constants, the latency per
+ *              constant and the memory of the search state per algorithm.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+/* A benchmark workload: a fixed sequence of multipliers searched with a
+ * single context, as in a -range run. The exhaustive search, which runs
+ * without a time budget, only takes the first "optimal_count" of them.
+ */
+typedef struct
+{
+  const char *name;
+  int64_t (*multiplier)(int64_t i);
+  int64_t count;
+  int64_t optimal_count;
+} BenchSuite;
+
+/* An algorithm under benchmark, named after its option. */
+typedef struct
+{
+  const char *name;
+  ConstMulAlg alg;
+} BenchAlg;
+
+/* Consecutive multipliers 0, 1, 2, ..., as in the ranges of 8-, 16- and
+ * 20-bit multipliers.
+ */
+static int64_t consecutive(int64_t i)
+{
+  return i;
+}
+
+/* The SplitMix64 mixer, used as a pseudo-random sequence of the index. */
+static uint64_t splitmix64(uint64_t x)
+{
+  x += UINT64_C(0x9E3779B97F4A7C15);
+  x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return x ^ (x >> 31);
+}
+
+/* Pseudo-random 32-bit multipliers. */
+static int64_t random32(int64_t i)
+{
+  return (int64_t)(splitmix64((uint64_t)i) >> 32);
+}
+
+/* Pseudo-random 64-bit multipliers, of either sign. */
+static int64_t random64(int64_t i)
+{
+  return (int64_t)splitmix64((uint64_t)i);
+}
+
+/* Pseudo-random 32-bit multipliers with three quarters of their bits set on
+ * average, whose long runs of ones and isolated zeros are the hard cases of
+ * the decompositions.
+ */
+static int64_t dense32(int64_t i)
+{
+  uint64_t r = splitmix64((uint64_t)i);
+
+  return (int64_t)((r | (r >> 32)) & UINT64_C(0xFFFFFFFF));
+}
+
+/* Pseudo-random dense 64-bit multipliers, as dense32() over 64 bits. */
+static int64_t dense64(int64_t i)
+{
+  return (int64_t)(splitmix64((uint64_t)i) | splitmix64((uint64_t)i ^ UINT64_C(0x5555555555555555)));
+}
+
+static int compare_times(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Search the multipliers of "suite" with algorithm "alg" and a fresh
+ * context, timing each one. The lookups, nodes and total cost of the
+ * sequences do not depend on the host, and track changes of the search
+ * along with its speed; the rate of lookups tracks the speed of the memo
+ * table.
+ */
+static void run_suite(const BenchSuite *suite, const BenchAlg *alg)
+{
+  KmulContext ctx;
+  int64_t count = (alg->alg == OPTIMAL) ? suite->optimal_count : suite->count;
+  double *times = malloc(count * sizeof(double));
+  double elapsed = 0.0;
+  uint64_t cost = 0;
+  int64_t i;
+
+  if (times == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %" PRId64 " constants.\n", count);
+    exit(EXIT_FAILURE);
+  }
+  kmul_init_context(&ctx, NULL, NAC);
+  // The exhaustive search runs to completion, so that it always finds the
+  // same graphs.
+  ctx.timeout_ms = 0;
+  for (i = 0; i < count; i++)
+  {
+    int64_t m = suite->multiplier(i);
+    double start = kmul_stats_clock();
+    const KmulSequence *seq = kmul_sequence(&ctx, alg->alg, m);
+
+    times[i] = kmul_stats_clock() - start;
+    elapsed += times[i];
+    cost += seq->cost;
+  }
+  qsort(times, count, sizeof(double), compare_times);
+  printf("%-9s %-9s %8" PRId64 " %12.0f %12.0f %9.2f %9.2f %9.1f %12" PRIu64 " %10" PRIu64 " %8.3f\n",
+    suite->name, alg->name, count, count / elapsed, ctx.counters.lookups / elapsed,
+    times[(count - 1) / 2] * 1e6, times[(count * 99 - 1) / 100] * 1e6, kmul_context_memory(&ctx) / 1024.0,
+    ctx.counters.lookups, ctx.counters.nodes, (double)cost / count);
+  fflush(stdout);
+  kmul_free_context(&ctx);
+  free(times);
+}
+
+/* Whether "name" is one of the arguments. */
+static int selected(const char *name, int argc, char *argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(name, argv[i]) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  static const BenchSuite suites[] =
+  {
+    {"range8",   consecutive,     256,  256},
+    {"range16",  consecutive,   65536, 4096},
+    {"range20",  consecutive, 1048576,    0},
+    {"random32", random32,      20000,    0},
+    {"random64", random64,       1000,    0},
+    {"dense32",  dense32,       20000,    0},
+    {"dense64",  dense64,        1000,    0}
+  };
+  static const BenchAlg algs[] =
+  {
+    {"bindecomp", BINARY_DECOMPOSITION},
+    {"csd",       CSD_DECOMPOSITION},
+    {"bernstein", BERNSTEIN_BRIGGS},
+    {"optimal",   OPTIMAL}
+  };
+  int num_suites = sizeof(suites) / sizeof(suites[0]), num_algs = sizeof(algs) / sizeof(algs[0]);
+  int any_suite = 0, any_alg = 0;
+  int i, j;
+
+  // Suites and algorithms can be selected by name, e.g. "range16 csd".
+  for (i = 1; i < argc; i++)
+  {
+    int known = 0;
+
+    for (j = 0; j < num_suites; j++)
+    {
+      known |= (strcmp(argv[i], suites[j].name) == 0);
+    }
+    any_suite |= known;
+    for (j = 0; j < num_algs; j++)
+    {
+      if (strcmp(argv[i], algs[j].name) == 0)
+      {
+        known = any_alg = 1;
+      }
+    }
+    if (!known)
+    {
+      fprintf(stderr, "Error: Unknown suite or algorithm %s.\n", argv[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  printf("%-9s %-9s %8s %12s %12s %9s %9s %9s %12s %10s %8s\n", "suite", "algorithm", "count",
+    "constants/s", "lookups/s", "p50 us", "p99 us", "mem KiB", "lookups", "nodes", "cost");
+  for (i = 0; i < num_suites; i++)
+  {
+    if (any_suite && !selected(suites[i].name, argc, argv))
+    {
+      continue;
+    }
+    for (j = 0; j < num_algs; j++)
+    {
+      if ((any_alg && !selected(algs[j].name, argc, argv)) ||
+          (algs[j].alg == OPTIMAL && suites[i].optimal_count == 0))
+      {
+        continue;
+      }
+      run_suite(&suites[i], &algs[j]);
+    }
+  }
+
+  return 0;
+}
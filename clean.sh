@@ -3,7 +3,7 @@
 # Clean the produced files from testing unsigned and signed multiplications
 for mulu in "0" "1" "2" "3" "4" "5" "6" "7" "8" "9" "10" "11" "23" "37" "43" "111" "255"
 do
-  for alg in "b" "o"; do
+  for alg in "b" "c" "o" "x"; do
     rm -rf kmul_${alg}_u32_p_${mulu}.nac 
     rm -rf kmul_${alg}_u32_p_${mulu}.c
   done
@@ -11,10 +11,56 @@ done
 
 for muls in "1" "2" "3" "4" "5" "6" "7" "8" "9" "10" "11" "23" "37" "43" "111" "255"
 do
-  for alg in "b" "o"; do
+  for alg in "b" "c" "o" "x"; do
     rm -rf kmul_${alg}_s32_m_${muls}.nac
     rm -rf kmul_${alg}_s32_m_${muls}.c
     rm -rf kmul_${alg}_s32_p_${muls}.nac
     rm -rf kmul_${alg}_s32_p_${muls}.c
   done
 done
+
+# Clean the produced files from testing 64-bit multiplications
+rm -rf kmul_o_u64_p_*.c kmul_o_s64_m_*.c
+
+# Clean the produced files from testing multipliers needing all bits of the
+# data width
+rm -rf kmul_o_u32_p_4294967295.c kmul_o_u32_p_4294967295_bench.*
+
+# Clean the produced files from testing depth-minimizing sequences
+for alg in "b" "c" "o"; do
+  rm -rf kmul_${alg}_u32_p_1000001.c
+  rm -rf kmul_${alg}_s32_m_21845.nac
+done
+
+# Clean the produced files from testing target profiles
+rm -rf kmul_o_u32_p_45.c kmul_o_s32_m_1000001.nac
+
+# Clean the produced files from testing the search statistics
+rm -rf kmul_stats.jsonl kmul_stats.csv
+
+# Clean the produced files from testing the quality report
+rm -rf kmul_report_*.csv
+
+# Clean the produced files from testing multiple constant multiplications
+rm -rf kmul_mcm_*.nac kmul_mcm_*.c
+
+# Clean the produced files from testing array kernels
+rm -rf kmul_o_s*_p_181.c kmul_o_u*_p_1000.c
+
+# Clean the produced files from testing LLVM IR emission
+rm -rf kmul_o_s*_p_100.ll kmul_c_u*_p_27.ll
+
+# Clean the produced files from testing assembly backends
+rm -rf kmul_o_u32_p_45.s kmul_o_s64_m_1000001.s
+
+# Clean the produced files from testing Verilog/VHDL emission
+rm -rf kmul_o_s12_p_181*.v kmul_o_s12_p_181*.vhd kmul_c_u32_p_2654435769*.v kmul_c_u32_p_2654435769*.vhd
+
+# Clean the produced files from testing the benchmark harness
+rm -rf kmul_o_s16_p_77.c kmul_o_s16_p_77_bench.* kmul_o_u64_p_1000001.c kmul_o_u64_p_1000001_bench.*
+
+# Clean the produced files from testing division and remainder by constants
+rm -rf kdiv_*.c kdiv_*.nac kdiv_*_bench.* kmod_*.c kmod_*.nac kmod_*_bench.*
+
+# Clean the produced files from testing the C++ header backend
+rm -rf kmul.hpp
@@ -1,12 +1,7 @@
 /*
  * File       : kmul.c                                                          
- * Description: Generator and calculator for multiplication by integer constant 
- *              routines. Based on the implementation of Bernstein's algorithm
- *              in the technical report (Multiplication by Integer Constants) 
- *              by:
- *              Preston Briggs <preston@cs.rice.edu>
- *              Tim Harvey     <harv@cs.rice.edu>
- *              July 13, 1994
+ * Description: Command-line front-end of the kmul generator of multiplication
+ *              by integer constant routines (see libkmul.c).
  * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>                
  * Copyright  : (C) Nikolaos Kavvadias 2006-2021
  * Website    : http://www.nkavvadias.com                            
@@ -30,714 +25,485 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
-#include <assert.h>
-
-/* dprintf: debugging printf enable by "enable" flag. */
-#define dprintf(enable, debug_f, ...) \
-if (enable==1) fprintf(debug_f, __VA_ARGS__);
-#define _d_(arg) arg
-
-// Function definitions <3c>, ...
-// Function definitions <3c>
-#define IS_ODD(c)         ((c) & 1)
-#define IS_EVEN(c)        (!IS_ODD(c))
-/* Absolute value of an integer. */
-#define ABS(x)            ((x) >  0 ? (x) : (-x))
-
-// Constant definitions <10b>
-#define HASH_SIZE 2047
-// Maximum constant multiplication steps
-#define MAX_STEPS   16
-
-// Code generation mode
-typedef enum
-{
-  NAC,
-  ANSIC,
-  C99
-} CodegenMode;
+#include <inttypes.h>
+#include <pthread.h>
+#include "kmul.h"
 
-// Constant multiplication algorithm to use
-typedef enum
-{
-  BINARY_DECOMPOSITION, /* just use binary decomposition */
-  BERNSTEIN_BRIGGS      /* the Bernstein-Briggs dynamic programming algorithm */
-} ConstMulAlg;
-
-// ------------------------------ cut ----------------------------------
-// Type definitions <7a>, ...
-// Type definitions <7a>
-typedef enum
-{
-  IDENTITY,   /* used for n = 1 */
-  NEGATE,     /* used for n = 1 */
-  SHIFT_ADD,  /* used for makeOdd(n  1) */
-  SHIFT_SUB,  /* used for makeOdd(n + 1) */
-  SHIFT_REV,  /* used for makeOdd(1  n) */
-  FACTOR_ADD, /* used for n/(2i  1) */
-  FACTOR_SUB, /* used for n/(2i + 1) */
-  FACTOR_REV  /* used for n/(1  2i) */
-} MulOp;
-
-// Type definitions <7c>
-typedef struct node
-{
-  struct node *parent;
-  int value;
-  double cost;
-  MulOp opcode;
-  // Other fields in Node <10a>
-  struct node *next;
-} Node;
-
-// Function definitions <15b>
-// The final version of try <12b>
-static void do_try(int factor, Node *node, MulOp opcode);
-// The final version of find_sequence <12a>
-static Node *find_sequence(int c, double limit);
-// ---------------------------- end cut --------------------------------
-
-int multiplier_val=1, width_val=32, lo_val=0, hi_val=65535;
+/* Magnitude of a 64-bit integer, safe for INT64_MIN. */
+#define UABS(x)           ((x) >= 0 ? (uint64_t)(x) : (uint64_t)0 - (uint64_t)(x))
+
+int64_t multiplier_val=1, lo_val=0, hi_val=65535;
+int width_val=32;
+int timeout_val=1000;
+KmulObjective objective_val=MINIMIZE_ADDERS;
+int is_negative=0;
 int enable_debug=0;
+int enable_range=0;
+int num_threads=1;
+int pipeline_val=0;
+int enable_bench=0;
+int enable_jit=0;
+int enable_modular=0;
+int enable_report=0;
+uint64_t modular_count=0, modular_gains=0, modular_savings=0;
+KmulRoutineOp routine_op=KMUL_ROUTINE_MUL;
 int is_signed=0;
 CodegenMode cgen=NAC;
+KmulVecIsa vec_isa=VEC_NONE;
 int enable_cany=0;
-FILE *fout;
-
-// Variable definitions <7b>, ...
-// Variable definitions <7b>
-double ADD_COST = 1.0, SUB_COST = 1.0, NEG_COST = 1.0, SHIFT_COST = 0.0, MULT_COST = 8.0;
-//static unsigned int costs[] =
-static double costs[8];
-// Variable definitions <10c>
-static Node *hash_table[HASH_SIZE];
-// Delay cost of the single-constant multiplier (SCM)
-double const_mul_cost = 0.0;
-// Counter enumerating the number of operations for a const. mult.
-int count = 0, kmul_steps = 0;
-
-
-/* Print a configurable number of space characters to an output file (specified
- * by the given filename; the file is assumed already opened).
- */
-void print_spaces(FILE *f, int nspaces)
-{
-  int i;  
-  for (i = 0; i < nspaces; i++)
-  {
-    fprintf(f, " ");
-  }
-}
+char *mktable_name=NULL, *table_name=NULL;
+char *cxx_name=NULL;
+char *stats_name=NULL;
+KmulStats stats;
+char *target_name=NULL, *profile_name=NULL;
+KmulCostModel cost_model;
+int64_t *mcm_vals=NULL;
+int mcm_count=0;
+KmulTable *table=NULL;
 
-/* fprintf prefixed by a number of space characters.
- */
-void pfprintf(FILE *f, int nspaces, char *fmt, ...)
-{
-  va_list args;
-  print_spaces(f, nspaces);
-  va_start(args, fmt);
-  vfprintf(f, fmt, args);
-  va_end(args);
-}
 
-/* Initialize costs for the Bernstein-Briggs algorithm
+/* Initialize a context emitting to "f" according to the program options.
  */
-void init_costs_for_mult_const_optimization()
-{
-//  int i;
-  costs[0] = 0.0;                      /* for IDENTITY  */
-  costs[1] = NEG_COST;                 /* for NEGATE    */
-  costs[2] = SHIFT_COST + ADD_COST;    /* for SHIFTADD  */
-  costs[3] = SHIFT_COST + SUB_COST;    /* for SHIFTSUB  */
-  costs[4] = SHIFT_COST + SUB_COST;    /* for SHIFTREV  */
-  costs[5] = SHIFT_COST + ADD_COST;    /* for FACTORADD */
-  costs[6] = SHIFT_COST + SUB_COST;    /* for FACTORSUB */
-  costs[7] = SHIFT_COST + SUB_COST;    /* for FACTORREV */
-}
-
-// Function definitions <3d>
-static int makeOdd(int c)
+static void setup_context(KmulContext *ctx, FILE *f)
 {
-  do
+  kmul_init_context(ctx, f, cgen);
+  kmul_set_cost_model(ctx, &cost_model);
+  ctx->debug = enable_debug;
+  ctx->timeout_ms = timeout_val;
+  ctx->objective = objective_val;
+  ctx->finfo = stdout;
+  ctx->vec = vec_isa;
+  ctx->pipeline = pipeline_val;
+  ctx->modular = enable_modular;
+  ctx->stats = (stats_name != NULL) ? &stats : NULL;
+  if (table != NULL && !kmul_use_table(ctx, table))
   {
-    c = c / 2;
-  } while (IS_EVEN(c));
-
-  return c;
+    fprintf(stderr, "Error: The table %s was built with other costs than those of the routines.\n", table_name);
+    exit(EXIT_FAILURE);
+  }
 }
 
-// Function definitions <10d>
-static Node *lookup(int c)
+/* Return the name of the output file "fout_name" (with extension "suffix")
+ * followed by "tag", with extension "ext" unless NULL.
+ */
+static char *companion_name(const char *fout_name, const char *suffix, const char *tag, const char *ext)
 {
-  int hash = ABS(c) % HASH_SIZE;
-  Node *node = hash_table[hash];
+  size_t len = strlen(fout_name) - strlen(suffix) - 1;
+  char *name = malloc(len + strlen(tag) + (ext != NULL ? strlen(ext) + 1 : 0) + 1);
 
-  while (node && node->value != c)
+  if (name == NULL)
   {
-    node = node->next;
+    fprintf(stderr, "Error: Out of memory for the name of a file.\n");
+    exit(EXIT_FAILURE);
   }
-
-  // Create a new Node and add it to hash_table[hash] <10e>
-  if (!node)
+  memcpy(name, fout_name, len);
+  strcpy(name + len, tag);
+  if (ext != NULL)
   {
-    // Create and initialize node <8b>
-    node = (Node *) malloc(sizeof(Node));
-    node->value = c;
-    node->parent = NULL;
-
-    node->next = hash_table[hash];
-    hash_table[hash] = node;
-    // Create and initialize node <12c>
-    //node->cost = SHIFT_COST + 1;
-    node->cost = SHIFT_COST;
+    strcat(name, ".");
+    strcat(name, ext);
   }
-
-  return node;
+  return name;
 }
 
-// The final version of find_sequence <12a>
-static Node *find_sequence(int c, double limit)
+/* Write the testbench of the Verilog or VHDL routines of [lo_val, hi_val] in
+ * "fout_name" into "<name>_tb.<suffix>", named after the file.
+ */
+static void emit_testbench_file(const char *fout_name, const char *suffix, ConstMulAlg alg)
 {
-  Node *node = lookup(c);
+  char *tb_name = companion_name(fout_name, suffix, "_tb", suffix);
+  char *module_name = companion_name(fout_name, suffix, "_tb", NULL);
+  FILE *f = fopen(tb_name, "w");
 
-  if (!node->parent && node->cost < limit)
+  if (f == NULL)
   {
-    node->cost = limit;
-
-    // Handle the positive case <9a>
-    if (c > 0)
-    {
-      int power = 4;
-      int edge = c >> 1;
-
-      while (power < edge)
-      {
-      	if (c % (power - 1) == 0)
-        {
-          do_try(c / (power - 1), node, FACTOR_SUB);
-        }
-        if (c % (power + 1) == 0)
-        {
-          do_try(c / (power + 1), node, FACTOR_ADD);
-        }
-        power = power << 1;
-      }
-      do_try(makeOdd(c - 1), node, SHIFT_ADD);
-      do_try(makeOdd(c + 1), node, SHIFT_SUB);
-    }
-    // Handle the negative case <9b>
-    else
-    {
-      int power = 4;
-      int edge = (-c) >> 1;
-
-      while (power < edge)
-      {
-      	if (c % (1 - power) == 0)
-        {
-          do_try(c / (1 - power), node, FACTOR_REV);
-        }
-        if (c % (power + 1) == 0)
-        {
-          do_try(c / (power + 1), node, FACTOR_ADD);
-        }
-        power = power << 1;
-      }
-      do_try(makeOdd(1 - c), node, SHIFT_REV);
-      do_try(makeOdd(c + 1), node, SHIFT_SUB);
-    }
+    fprintf(stderr, "Error: Cannot open %s for writing.\n", tb_name);
+    exit(EXIT_FAILURE);
   }
-
-  return node;
+  emit_rtl_testbench(f, cgen, module_name, alg, lo_val, hi_val, is_signed, width_val, pipeline_val);
+  fclose(f);
+  free(tb_name);
+  free(module_name);
 }
 
-// The final version of try <12b>
-static void do_try(int factor, Node *node, MulOp opcode)
+/* Write the harness of the C routines of [lo_val, hi_val] in "fout_name"
+ * into "<name>_bench.c", compile it with the C compiler of $CC (or "cc") and
+ * run it. Exit with an error if it cannot be built or a routine fails its
+ * verification.
+ */
+static void run_bench(const char *fout_name, const char *suffix, ConstMulAlg alg)
 {
-  double cost = costs[opcode];
-  double limit = node->cost - cost;
-  Node *factor_node = find_sequence(factor, limit);
+  char *src_name = companion_name(fout_name, suffix, "_bench", "c");
+  char *exe_name = companion_name(fout_name, suffix, "_bench", "exe");
+  const char *cc = getenv("CC");
+  char *command;
+  FILE *f = fopen(src_name, "w");
 
-  if (factor_node->parent && factor_node->cost < limit)
+  if (f == NULL)
   {
-    node->parent = factor_node;
-    node->opcode = opcode;
-    node->cost = factor_node->cost + cost;
+    fprintf(stderr, "Error: Cannot open %s for writing.\n", src_name);
+    exit(EXIT_FAILURE);
   }
-}
-
-// Function definitions <13a>
-static void emit_shift(FILE *f, int target, int source)
-{
-  int temp = source;
-  unsigned int i = 0;
+  emit_bench_harness(f, fout_name, cgen, routine_op, alg, lo_val, hi_val, is_signed, width_val);
+  fclose(f);
 
-  do
+  if (cc == NULL || cc[0] == '\0')
   {
-    temp <<= 1;
-    i++;
-  } while (target != temp);
-
-  dprintf(enable_debug, stdout, "Info: %d = %d << %u\n", target, source, i);
-  if (cgen == NAC)
+    cc = "cc";
+  }
+  command = malloc(strlen(cc) + strlen(src_name) + 2 * strlen(exe_name) + 32);
+  if (command == NULL)
   {
-    pfprintf(f, 2, "t%d <= shl t%d, %d;\n", count+1, count, i);   
+    fprintf(stderr, "Error: Out of memory for the benchmark command.\n");
+    exit(EXIT_FAILURE);
   }
-  else if (enable_cany)
+  sprintf(command, "%s -O2 -std=c99 -Wall -Werror -o %s %s", cc, exe_name, src_name);
+  printf("%s\n", command);
+  fflush(stdout);
+  if (system(command) != 0)
   {
-    pfprintf(f, 2, "t%d = t%d << %d;\n", count+1, count, i);   
-  }      
-  count++;
-}
-
-// Function definitions <13b>
-static int emit_code(FILE *f, Node *node)
-{
-  int source;
-  int target = node->value;
-  switch (node->opcode)
+    fprintf(stderr, "Error: Cannot compile the benchmark harness %s.\n", src_name);
+    exit(EXIT_FAILURE);
+  }
+  sprintf(command, "./%s", exe_name);
+  if (system(command) != 0)
   {
-    // Opcode cases <13c>
-    case IDENTITY:
-      break;
-    // Opcode cases <13d>
-    case NEGATE:
-      source = emit_code(f, node->parent);
-      dprintf(enable_debug, stdout, "Info: %d = 0 - %d\n", target, source);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= neg t%d;\n", count+1, count);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d = -t%d;\n", count+1, count);   
-      }
-      count++;
-      break;
-    // Opcode cases <14a>
-    case SHIFT_ADD:
-      source = emit_code(f, node->parent);
-      emit_shift(f, target-1, source);
-      dprintf(enable_debug, stdout, "Info: %d = %d + 1\n", target, target-1);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= add t%d, x;\n", count+1, count);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d = t%d + x;\n", count+1, count);   
-      }      
-      count++;
-      break;
-    // Opcode cases <14b>
-    case SHIFT_SUB:
-      source = emit_code(f, node->parent);
-      emit_shift(f, target+1, source);
-      dprintf(enable_debug, stdout, "Info: %d = %d - 1\n", target, target+1);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= sub t%d, x;\n", count+1, count);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d = t%d - x;\n", count+1, count);   
-      }      
-      count++;
-      break;
-    // Opcode cases <14c>
-    case SHIFT_REV:
-      source = emit_code(f, node->parent);
-      emit_shift(f, 1-target, source);
-      dprintf(enable_debug, stdout, "Info: %d = 1 - %d\n", target, 1-target);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= sub x, t%d;\n", count+1, count);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d = x - t%d;\n", count+1, count);   
-      }      
-      count++;
-      break;
-    // Opcode cases <14d>
-    case FACTOR_ADD:
-      source = emit_code(f, node->parent);
-      emit_shift(f, target-source, source);
-      dprintf(enable_debug, stdout, "Info: %d = %d + %d\n", target, target-source, source);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= add t%d, t%d;\n", count+1, count, count-1);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d <= t%d + t%d;\n", count+1, count, count-1);   
-      }      
-      count++;      
-      break;
-    // Opcode cases <14e>
-    case FACTOR_SUB:
-      source = emit_code(f, node->parent);
-      emit_shift(f, target+source, source);
-      dprintf(enable_debug, stdout, "Info: %d = %d - %d\n", target, target+source, source);
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= sub t%d, t%d;\n", count+1, count, count-1);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d <= t%d - t%d;\n", count+1, count, count-1);   
-      }      
-      count++;      
-      break;
-    // Opcode cases <15a>
-    case FACTOR_REV:
-      source = emit_code(f, node->parent);
-      emit_shift(f, source-target, source);
-      dprintf(enable_debug, stdout, "Info: %d = %d - %d\n", target, source, source-target);
-      // FIXME: ??? Needs testing.
-      if (cgen == NAC)
-      {
-        pfprintf(f, 2, "t%d <= sub t%d, t%d;\n", count+1, count-1, count);   
-      }
-      else if (enable_cany)
-      {
-        pfprintf(f, 2, "t%d <= t%d - t%d;\n", count+1, count-1, count);   
-      }      
-      count++;            
-      break;
+    fprintf(stderr, "Error: The routines of %s failed their verification.\n", fout_name);
+    exit(EXIT_FAILURE);
   }
-  return target;
+  free(command);
+  free(src_name);
+  free(exe_name);
 }
 
-// Function definitions <15c>
-static double estimate_cost(/*int c*/)
+/* Compile the multipliers of [lo_val, hi_val] to x86-64 machine code in
+ * memory and compare each function with the native multiplication for edge
+ * values and pseudo-random inputs. Exit with an error if the code cannot be
+ * mapped or a function fails.
+ */
+static void run_jit(ConstMulAlg alg)
 {
-  // Multiplication cost for the multiplier unit
-  return (MULT_COST);
-}
+  static const uint64_t edges[] = {
+    0, 1, 2, 3, UINT64_C(0x7FFFFFFF), UINT64_C(0x80000000), UINT64_C(0xFFFFFFFF),
+    UINT64_C(0x7FFFFFFFFFFFFFFF), UINT64_C(0x8000000000000000), UINT64_C(0xFFFFFFFFFFFFFFFF)
+  };
+  uint64_t seed = UINT64_C(0x9E3779B97F4A7C15), u, x, y, count = 0;
+  unsigned long failures = 0;
+  KmulContext ctx;
+  KmulJit jit;
+  KmulJitFn fn;
+  int i;
 
-/* The simplest possible algorithm using binary decomposition
- */
-void binary_decomposition(FILE *f, int target) {
-  int x = target;
-  int mul = 0;
-  int x_abs = ABS(x);
-
-  while (x_abs > 0) {
-    unsigned bit = x_abs & 1;
-    if (bit) {
-      if (cgen == NAC)
-      {
-        if (mul == 0) {
-          pfprintf(f, 2, "t%d <= mov x;\n", count);
-        } else {
-          pfprintf(f, 2, "t%d <= shl x, %d;\n", count, mul);
-        }
-        if (count > 0) {
-          pfprintf(f, 2, "t%d <= add t%d, t%d;\n", count, count, count-1);
-        }
-      }
-      else if (enable_cany)
-      {
-        if (mul == 0) {
-          pfprintf(f, 2, "t%d = x;\n", count);
-        } else {
-          pfprintf(f, 2, "t%d = x << %d;\n", count, mul);
-        }
-        if (count > 0) {
-          pfprintf(f, 2, "t%d = t%d + t%d;\n", count, count, count-1);
-        }
-      }
-      count++;
-    }
-    x_abs >>= 1;
-    mul++;
+  setup_context(&ctx, NULL);
+  ctx.finfo = NULL;
+  if (kmul_jit_init(&jit, &ctx, alg) != 0)
+  {
+    fprintf(stderr, "Error: Out of memory for the JIT cache.\n");
+    exit(EXIT_FAILURE);
   }
-  if (x < 0)
+  for (u = (uint64_t)lo_val; ; u++)
   {
-    if (cgen == NAC)
+    fn = kmul_jit(&jit, (int64_t)u);
+    if (fn == NULL)
     {
-      pfprintf(f, 2, "t%d <= neg t%d;\n", count, count-1);
+      fprintf(stderr, "Error: Cannot compile the multiplication by %" PRId64 " (-jit needs an x86-64 host).\n",
+        (int64_t)u);
+      exit(EXIT_FAILURE);
     }
-    else if (enable_cany)
+    // A second request must be served by the cache.
+    if (kmul_jit(&jit, (int64_t)u) != fn)
     {
-      pfprintf(f, 2, "t%d = -t%d;\n", count, count-1);
+      fprintf(stderr, "Error: The JIT cache missed the multiplication by %" PRId64 ".\n", (int64_t)u);
+      exit(EXIT_FAILURE);
     }
-  }
-}
-
-// Function definitions <15d>
-void multiply(int target)
-{
-  double multiply_cost = estimate_cost(/*target*/);
-
-  // Handle the (straightforward) odd case <16a>
-  if (IS_ODD(target))
-  {
-    Node *result = find_sequence(target, multiply_cost);
-
-    if (result->parent && result->cost < multiply_cost)
+    for (i = 0; i < 1024; i++)
     {
-      emit_code(fout, result);
-      const_mul_cost = result->cost;
+      if (i < (int)(sizeof(edges) / sizeof(edges[0])))
+      {
+        x = edges[i];
+      }
+      else
+      {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        x = seed;
+      }
+      y = fn(x);
+      if (y != x * u && failures++ < 10)
+      {
+        printf("FAIL: %" PRId64 " * %" PRId64 " = %" PRId64 ", expected %" PRId64 "\n",
+          (int64_t)x, (int64_t)u, (int64_t)y, (int64_t)(x * u));
+      }
     }
-    else
+    count++;
+    if (u == (uint64_t)hi_val)
     {
-      const_mul_cost = multiply_cost;
+      break;
     }
   }
-  // Handle the (relatively complex) even case <16b>
-  else
+  printf("JIT: %" PRIu64 " multipliers, %lu bytes of x86-64 code in %u chunks, %lu failures.\n", count,
+    (unsigned long)jit.code_bytes, jit.num_chunks, failures);
+  kmul_jit_free(&jit);
+  kmul_free_context(&ctx);
+  if (failures != 0)
   {
-    Node *result = find_sequence(makeOdd(target), multiply_cost - SHIFT_COST);
-
-    if (result->parent && result->cost + SHIFT_COST < multiply_cost)
-    {
-      int source = emit_code(fout, result);
-      emit_shift(fout, target, source);
-      const_mul_cost = result->cost;
-    }
-    else
-    {
-      const_mul_cost = multiply_cost;
-    }
+    fprintf(stderr, "Error: The JIT-compiled multiplications failed their verification.\n");
+    exit(EXIT_FAILURE);
   }
 }
 
-// Function definitions <16c>
-void init_multiply(void)
+/* Compare all algorithms on the multipliers of [lo_val, hi_val], writing a
+ * row per multiplier to a CSV file named after the range and the summary to
+ * the standard output.
+ */
+static void run_report(void)
 {
-  Node *node, *node1;
-  unsigned int i;
-  
-  for (i = 0; i < HASH_SIZE; i++)
-  {
-    hash_table[i] = NULL;
-  }
-  init_costs_for_mult_const_optimization();
-  node1 = lookup(1);
-  node1->parent = node1;    // must not be NULL
-  node1->opcode = IDENTITY;
-  node1->cost = 0;
-  node = lookup(-1);
-  node->parent = node1;
-  node->opcode = NEGATE;
-  node->cost = NEG_COST;
-}
+  char report_name[96];
+  KmulContext ctx;
+  FILE *f;
 
-/* Emit the NAC (generic assembly language) implementation of unsigned/signed
- * multiplication by constant. Calls "multiply" which in turn recursively calls
- * "emit_code".
- */
-void emit_kmul_nac(FILE *f, ConstMulAlg alg, int m, int s, unsigned int W)
-{ 
-  char c = ((s) ? 's' : 'u');
-  int steps = (alg == BINARY_DECOMPOSITION) ? width_val : MAX_STEPS;
-  char a = (alg == BINARY_DECOMPOSITION) ? 'b' : 'o';
-   
-  pfprintf(f, 0, "procedure kmul_%c_%c%d_%c_%d (in %c%d x, out %c%d y)\n",
-      a, c, W, ((m > 0) ? 'p' : 'm'), ABS(m), c, W, c, W);
-  pfprintf(f, 0, "{\n");   
-  if (m == 0)
-  {
-    pfprintf(f, 2, "localvar %c%d t;\n", c, W);   
-  }
-  else
+  sprintf(report_name, "kmul_report_%c%d_%c%" PRIu64 "_%c%" PRIu64 ".csv", is_signed ? 's' : 'u', width_val,
+    ((!is_signed || lo_val >= 0) ? 'p' : 'm'), (is_signed ? UABS(lo_val) : (uint64_t)lo_val),
+    ((!is_signed || hi_val >= 0) ? 'p' : 'm'), (is_signed ? UABS(hi_val) : (uint64_t)hi_val));
+  f = fopen(report_name, "w");
+  if (f == NULL)
   {
-    for (int i = 0; i < steps; i++)
-    {
-      pfprintf(f, 2, "localvar %c%d t%d;\n", c, W, i);   
-    }
+    fprintf(stderr, "Error: Cannot open %s for writing.\n", report_name);
+    exit(EXIT_FAILURE);
   }
-  pfprintf(f, 0, "S_1:\n");
-  
-  count = 0;
-  // Apply constant multiplication optimization.
-  if (m == 0)
+  setup_context(&ctx, NULL);
+  ctx.finfo = NULL;
+  kmul_report(&ctx, f, stdout, lo_val, hi_val, is_signed, width_val);
+  kmul_free_context(&ctx);
+  fclose(f);
+}
+
+/* Parse a multiplier given in decimal, octal or hexadecimal notation. Values
+ * beyond INT64_MAX are accepted for unsigned multiplication and wrap around
+ * to their 64-bit two's complement representation. A leading minus sign is
+ * recorded in "is_negative".
+ */
+static int64_t parse_multiplier(const char *str)
+{
+  char *end;
+  int64_t value;
+
+  if (str[0] == '-')
   {
-    pfprintf(f, 2, "t <= ldc 0;\n");
+    is_negative = 1;
+    value = (int64_t)strtoll(str, &end, 0);
   }
   else
   {
-    if (alg == BERNSTEIN_BRIGGS)
-    {
-      pfprintf(f, 2, "t%d <= mov x;\n", count);
-    }
-    if (m != 0)
-    {
-      if (alg == BINARY_DECOMPOSITION) {
-        binary_decomposition(f, (int)m);
-      } else {
-        assert(alg == BERNSTEIN_BRIGGS);
-        init_multiply();
-        multiply((int)m);
-      }
-    }
-  }
-  if (m == 0)
-  {
-    pfprintf(f, 2, "y <= mov t;\n");   
+    value = (int64_t)strtoull(str, &end, 0);
   }
-  else
+  if (end == str || *end != '\0')
   {
-    int last = (alg == BINARY_DECOMPOSITION && m > 0) ? count-1 : count;
-    pfprintf(f, 2, "y <= mov t%d;\n", last);
+    fprintf(stderr, "Error: Invalid multiplier %s.\n", str);
+    exit(EXIT_FAILURE);
   }
-  pfprintf(f, 0, "}\n");   
+  return value;
 }
 
-/* For a given data width, set the effective data width for the corresponding integer
- * C data type.
+/* Parse the comma-separated list of multipliers of "-mcm" into mcm_vals.
  */
-unsigned int set_data_width(unsigned int W)
+static void parse_mcm_list(const char *list)
 {
-  unsigned int effective_width = 0;
+  char *copy = malloc(strlen(list) + 1);
+  char *token;
 
-  if (W > 0 && W <= 8)
+  if (copy == NULL)
   {
-    effective_width = 8;
+    fprintf(stderr, "Error: Out of memory for the multipliers of -mcm.\n");
+    exit(EXIT_FAILURE);
   }
-  else if (W > 8 && W <= 16)
+  strcpy(copy, list);
+  mcm_vals = realloc(mcm_vals, (strlen(list) / 2 + 1) * sizeof(int64_t));
+  if (mcm_vals == NULL)
   {
-    effective_width = 16;
+    fprintf(stderr, "Error: Out of memory for the multipliers of -mcm.\n");
+    exit(EXIT_FAILURE);
   }
-  else if (W > 16 && W <= 32)
+  mcm_count = 0;
+  for (token = strtok(copy, ","); token != NULL; token = strtok(NULL, ","))
   {
-    effective_width = 32;
+    mcm_vals[mcm_count++] = parse_multiplier(token);
   }
-  else if ((W > 32 && W <= 64) && cgen != ANSIC)
+  free(copy);
+}
+
+/* Emit the single routine computing all the products of the multipliers of
+ * "-mcm", and report its cost against the total cost of separate routines.
+ */
+static void emit_kmul_mcm_list(FILE *f, ConstMulAlg alg)
+{
+  KmulContext ctx;
+  KmulMcm mcm;
+  int separate_cost = 0;
+  int depth;
+  int i;
+
+  setup_context(&ctx, f);
+  if (mcm_graph(&ctx, mcm_vals, mcm_count, &mcm) != 0)
   {
-    effective_width = 64;
+    fprintf(stderr, "Error: The odd parts of the multipliers of -mcm must fit in %d bits.\n", KMUL_MCM_MAX_BITS);
+    exit(EXIT_FAILURE);
   }
-  if ((W > 32 && cgen == ANSIC) || (W > 64))
+  emit_kmul_mcm(&ctx, &mcm, is_signed, width_val);
+  depth = ctx.seq.depth;
+  for (i = 0; i < mcm_count; i++)
   {
-    fprintf(stderr, "Error: Data widths higher than %d bits are not supported.\n", (cgen == ANSIC ? 32 : 64));
-    exit(EXIT_FAILURE);
+    separate_cost += kmul_sequence(&ctx, alg, mcm_vals[i])->cost;
   }
-
-  return (effective_width);
+  printf("Info: %d multipliers: %d additions/subtractions, adder depth %d, cost %d (separate routines: cost %d).\n",
+    mcm_count, mcm.num_ops, depth, mcm.cost, separate_cost);
+  kmul_mcm_free(&mcm);
+  kmul_free_context(&ctx);
 }
 
-/* For the given signedness (s) and data width (W) return the corresponding 
- * C data type for either ANSI C or C99.
- */                       
-char *get_c_type(int s, unsigned int W)
+/* Emit the routines for all multipliers in [lo, hi] to the output stream of
+ * the context. Routines are separated by an empty line, except for the first
+ * routine of the whole range (lo_val).
+ */
+void emit_kmul_range(KmulContext *ctx, ConstMulAlg alg, int64_t lo, int64_t hi)
 {
-  char *c_type_str = malloc((strlen("unsigned long long int")+1) * sizeof(char));
+  // Count in unsigned arithmetic, which wraps around instead of overflowing
+  // (unsigned ranges may cross 2^63).
+  uint64_t u;
 
-  if (cgen == C99)
-  {
-    int offset = 0;
-    if (s == 0)
-    {
-      strcpy(c_type_str, "u");
-      offset = 1;
-    }
-    sprintf(c_type_str+offset, "int%u_t", set_data_width(W));
-  }
-  else if (cgen == ANSIC)
+  for (u = (uint64_t)lo; ; u++)
   {
-    if (s == 0)
-    {
-      strcpy(c_type_str, "unsigned ");
-    }
-    if (set_data_width(W) == 8)
+    if (u != (uint64_t)lo_val)
     {
-      strcpy(c_type_str, "char");
-    } 
-    else if (set_data_width(W) == 16)
-    { 
-      strcpy(c_type_str, "short");
+      fprintf(ctx->fout, "\n");
     }
-    else if (set_data_width(W) == 32)
+    emit_kmul(ctx, alg, (int64_t)u, is_signed, width_val);
+    // Stop before wrapping around when the range ends at the largest value.
+    if (u == (uint64_t)hi)
     {
-      strcpy(c_type_str, "long");
+      break;
     }
   }
-  else
-  {
-    strncpy(c_type_str, "UNSUPPORTED", sizeof("UNSUPPORTED")+1);
-    fprintf(stderr, "Error: Unsupported C data type in get_c_type(). Exiting...\n");
-    exit(EXIT_FAILURE);
-  }
-  if ((W > 32 && cgen == ANSIC) || (W > 64))
+}
+
+/* Add the modular search statistics of a context to the totals. */
+static void add_modular_stats(const KmulContext *ctx)
+{
+  modular_count += ctx->modular_count;
+  modular_gains += ctx->modular_gains;
+  modular_savings += ctx->modular_savings;
+}
+
+/* A worker thread generating a contiguous part of the multiplier range with
+ * its own context; its output is buffered in a temporary file.
+ */
+typedef struct
+{
+  KmulContext ctx;
+  ConstMulAlg alg;
+  int64_t lo, hi;
+  KmulStats stats;
+} KmulWorker;
+
+static void *kmul_worker(void *arg)
+{
+  KmulWorker *w = (KmulWorker *)arg;
+
+  emit_kmul_range(&w->ctx, w->alg, w->lo, w->hi);
+  kmul_free_context(&w->ctx);
+  return NULL;
+}
+
+/* Append the contents of the temporary file "buffer" to "f" and close it. */
+static void append_buffer(FILE *f, FILE *buffer)
+{
+  char buf[BUFSIZ];
+  size_t len;
+
+  rewind(buffer);
+  while ((len = fread(buf, 1, sizeof(buf), buffer)) > 0)
   {
-    fprintf(stderr, "Error: Data widths higher than %d bits are not supported.\n", (cgen == ANSIC ? 32 : 64));
-    exit(EXIT_FAILURE);
+    fwrite(buf, 1, len, f);
   }
+  fclose(buffer);
+}
+
+/* Return the offset of part "i" of "n" in a range of "span" multipliers,
+ * i.e. floor(span * i / n) without overflowing 64 bits.
+ */
+static uint64_t range_part(uint64_t span, int i, int n)
+{
+  uint64_t q = (span - 1) / n, r = (span - 1) % n + 1;
 
-  return (c_type_str);
+  // span == q * n + r, with 1 <= r <= n so that span == 0 (2^64) works too.
+  return q * i + (r * i) / n;
 }
 
-/* Emit the ANSI C or C99 implementation of unsigned/signed multiplication by
- * constant.
- */                       
-void emit_kmul_cany(FILE *f, ConstMulAlg alg, int m, int s, unsigned int W)
+/* Split [lo_val, hi_val] among "n" worker threads and append their outputs to
+ * "f" in the order of the range, so that the result does not depend on the
+ * number of threads.
+ */
+void emit_kmul_range_threaded(FILE *f, ConstMulAlg alg, int n)
 {
-  char c = ((s) ? 's' : 'u');
-  char *dt = NULL;
-  int steps = (alg == BINARY_DECOMPOSITION) ? width_val : MAX_STEPS;
-  char a = (alg == BINARY_DECOMPOSITION) ? 'b' : 'o';
+  // Unsigned, since the range may span more than INT64_MAX multipliers; a
+  // span of zero stands for the full 2^64 range.
+  uint64_t span = (uint64_t)hi_val - (uint64_t)lo_val + 1;
+  KmulWorker *workers;
+  pthread_t *threads;
+  int i;
 
-  if (cgen == C99)
+  if (span != 0 && span < (uint64_t)n)
   {
-    pfprintf(f, 0, "#include <stdint.h>\n");
+    n = (int)span;
   }
-  
-  dt = get_c_type(s, W);  
- 
-  pfprintf(f, 0, "%s kmul_%c_%c%d_%c_%d (%s x)\n", dt, a, c, W, ((m > 0) ? 'p' : 'm'), ABS(m), dt);
-  pfprintf(f, 0, "{\n");   
-  if (m == 0)
+  workers = calloc(n, sizeof(KmulWorker));
+  threads = malloc(n * sizeof(pthread_t));
+  if (workers == NULL || threads == NULL)
   {
-    pfprintf(f, 2, "%s t;\n", dt);   
+    fprintf(stderr, "Error: Out of memory for %d worker threads.\n", n);
+    exit(EXIT_FAILURE);
   }
-  else
+  for (i = 0; i < n; i++)
   {
-    for (int i = 0; i < steps; i++)
+    workers[i].alg = alg;
+    workers[i].lo = (int64_t)((uint64_t)lo_val + range_part(span, i, n));
+    workers[i].hi = (int64_t)((uint64_t)lo_val + range_part(span, i+1, n) - 1);
+    setup_context(&workers[i].ctx, tmpfile());
+    // The reports and statistics of the routines are buffered as well, to
+    // keep their order.
+    workers[i].ctx.finfo = tmpfile();
+    if (stats_name != NULL)
     {
-      pfprintf(f, 2, "%s t%d;\n", dt, i);   
+      kmul_stats_init(&workers[i].stats, tmpfile(), stats.csv);
+      workers[i].ctx.stats = &workers[i].stats;
     }
-  }
-  pfprintf(f, 2, "%s y;\n", dt);   
- 
-  count = 0;
-  // Apply constant multiplication optimization.
-  if (m == 0)
-  {
-    pfprintf(f, 2, "t = 0;\n");
-  }
-  else
-  {
-    if (alg == BERNSTEIN_BRIGGS)
+    if (workers[i].ctx.fout == NULL || workers[i].ctx.finfo == NULL ||
+        (stats_name != NULL && workers[i].stats.f == NULL))
     {
-      pfprintf(f, 2, "t%d = x;\n", count);
+      fprintf(stderr, "Error: Cannot create the output buffer of worker %d.\n", i);
+      exit(EXIT_FAILURE);
     }
-    if (m != 0)
+    if (pthread_create(&threads[i], NULL, kmul_worker, &workers[i]) != 0)
     {
-      if (alg == BINARY_DECOMPOSITION) {
-        binary_decomposition(f, (int)m);
-      } else {
-        assert(alg == BERNSTEIN_BRIGGS);
-        init_multiply();
-        multiply((int)m);
-      }
+      fprintf(stderr, "Error: Cannot create worker thread %d.\n", i);
+      exit(EXIT_FAILURE);
     }
   }
-  if (m == 0)
-  {
-    pfprintf(f, 2, "y = t;\n");   
-  }
-  else
+  for (i = 0; i < n; i++)
   {
-    int last = (alg == BINARY_DECOMPOSITION && m > 0) ? count-1 : count;
-    pfprintf(f, 2, "y = t%d;\n", last);
+    pthread_join(threads[i], NULL);
+    append_buffer(f, workers[i].ctx.fout);
+    append_buffer(stdout, workers[i].ctx.finfo);
+    add_modular_stats(&workers[i].ctx);
+    if (stats_name != NULL)
+    {
+      append_buffer(stats.f, workers[i].stats.f);
+      kmul_stats_merge(&stats, &workers[i].stats);
+    }
   }
-  pfprintf(f, 2, "return (y);\n");
-  pfprintf(f, 0, "}\n");   
-
-  free(dt);
+  free(threads);
+  free(workers);
 }
 
 /* Print usage instructions for the "kmul" program.
@@ -756,8 +522,63 @@ static void print_usage()
   printf("*         Enable debug/diagnostic output.\n");
   printf("*   -bindecomp:\n");
   printf("*         Use binary decomposition instead of the Bernstein-Briggs algorithm.\n");
+  printf("*   -csd:\n");
+  printf("*         Use the canonical signed digit (non-adjacent form) recoding of\n");
+  printf("*         the multiplier instead of the Bernstein-Briggs algorithm.\n");
+  printf("*   -optimal:\n");
+  printf("*         Search for the adder graph with the fewest additions/subtractions,\n");
+  printf("*         falling back to the Bernstein-Briggs sequence when it runs out of\n");
+  printf("*         time.\n");
+  printf("*   -timeout <ms>:\n");
+  printf("*         Time budget of \"-optimal\" per multiplier in milliseconds; 0 for\n");
+  printf("*         no limit. Default: 1000.\n");
+  printf("*   -minimize <adders|depth>:\n");
+  printf("*         Choose the sequences with the fewest additions/subtractions or\n");
+  printf("*         with the shortest chain of dependent ones. Default: adders.\n");
+  printf("*   -modular:\n");
+  printf("*         Multiply by the unsigned or signed reading of each multiplier\n");
+  printf("*         modulo 2^width instead, if that has a cheaper sequence, and report\n");
+  printf("*         how many multipliers became cheaper.\n");
+  printf("*   -vec <sse2|avx2>:\n");
+  printf("*         Follow each C99 routine by an array kernel using the SSE2 or AVX2\n");
+  printf("*         intrinsics, with a scalar tail.\n");
+  printf("*   -target <generic|x86-64|aarch64|rv64-zba>:\n");
+  printf("*         Use the operation costs of the given processor, including its\n");
+  printf("*         fused shift-and-add instructions. Default: the processor of\n");
+  printf("*         \"-x86-64\" or \"-aarch64\", else generic.\n");
+  printf("*   -profile <file>:\n");
+  printf("*         Override costs of the target with the \"key = value\" lines of\n");
+  printf("*         the given file.\n");
   printf("*   -mul <num>:\n");
   printf("*         Set the value of the multiplier. Default: 1.\n");
+  printf("*   -div <num>:\n");
+  printf("*         Emit the division by the given divisor instead of a\n");
+  printf("*         multiplication, as a magic multiplication (for widths up to 32\n");
+  printf("*         bits, 16 bits in ANSI C).\n");
+  printf("*   -mod <num>:\n");
+  printf("*         Likewise, emit the remainder of the division by the given\n");
+  printf("*         divisor.\n");
+  printf("*   -range <lo> <hi>:\n");
+  printf("*         Generate the routines for all multipliers in [lo, hi] into a\n");
+  printf("*         single output file, reusing the search results among them.\n");
+  printf("*   -report <lo> <hi>:\n");
+  printf("*         Compare the sequences of all algorithms for the multipliers in\n");
+  printf("*         [lo, hi], writing them to kmul_report_<type>_<lo>_<hi>.csv with\n");
+  printf("*         the winner of each one, and print their totals, savings over\n");
+  printf("*         binary decomposition and histograms, instead of routines.\n");
+  printf("*   -mcm <num>,<num>,...:\n");
+  printf("*         Emit a single routine computing the products of all the given\n");
+  printf("*         multipliers with a shared adder graph.\n");
+  printf("*   -threads <num>:\n");
+  printf("*         Split the range of \"-range\" among the given number of worker\n");
+  printf("*         threads. Default: 1.\n");
+  printf("*   -mktable <file>:\n");
+  printf("*         Build the table of precomputed sequences for the multipliers\n");
+  printf("*         of \"-range\" (or \"-mul\") into <file>, instead of emitting\n");
+  printf("*         routines.\n");
+  printf("*   -table <file>:\n");
+  printf("*         Emit the routines from the sequences of a table built with\n");
+  printf("*         \"-mktable\" instead of searching for them.\n");
   printf("*   -width <num>:\n");
   printf("*         Set the bitwidth of all operands: multiplier, multiplicand and\n");
   printf("*         product. Default: 32.\n");
@@ -771,6 +592,43 @@ static void print_usage()
   printf("*         Emit software routine in ANSI C (for widths up to 32 bits).\n");
   printf("*   -c99:\n");
   printf("*         Emit software routine in C99 (for widths up to 64 bits).\n");
+  printf("*   -x86-64:\n");
+  printf("*         Emit software routine as an x86-64 GNU assembly function with\n");
+  printf("*         the prototype of the C99 routine (for widths up to 64 bits).\n");
+  printf("*   -aarch64:\n");
+  printf("*         Emit software routine as an AArch64 GNU assembly function with\n");
+  printf("*         the prototype of the C99 routine (for widths up to 64 bits).\n");
+  printf("*   -llvm:\n");
+  printf("*         Emit software routine as an LLVM IR function on integers of the\n");
+  printf("*         exact width (for widths up to 64 bits).\n");
+  printf("*   -verilog:\n");
+  printf("*         Emit hardware routine as a synthesizable Verilog module of the\n");
+  printf("*         exact width (for widths up to 64 bits), with a testbench.\n");
+  printf("*   -vhdl:\n");
+  printf("*         Emit hardware routine as a synthesizable VHDL entity of the\n");
+  printf("*         exact width (for widths up to 64 bits), with a testbench.\n");
+  printf("*   -bench:\n");
+  printf("*         Verify the ANSI C/C99 routines against the native multiplication\n");
+  printf("*         (exhaustively up to 16 bits) and time both, with a harness\n");
+  printf("*         compiled by $CC (default: cc).\n");
+  printf("*   -jit:\n");
+  printf("*         Compile the multipliers of \"-range\" (or \"-mul\") to x86-64\n");
+  printf("*         machine code in memory and verify it against the native\n");
+  printf("*         multiplication, instead of emitting routines (x86-64 hosts).\n");
+  printf("*   -cxx <file>:\n");
+  printf("*         Write the self-contained C++17 header <file>, whose\n");
+  printf("*         kmul::mul<C>(x) finds and expands the sequence for C at compile\n");
+  printf("*         time, for the costs of \"-target\" and \"-profile\", instead of\n");
+  printf("*         emitting routines.\n");
+  printf("*   -stats <file>:\n");
+  printf("*         Write the search statistics of every routine (calls, pruned\n");
+  printf("*         branches, nodes, memo table probes, memory, time, cost, operations\n");
+  printf("*         and depth) to <file> as JSON lines, or as CSV if it ends in .csv,\n");
+  printf("*         followed by their histograms.\n");
+  printf("*   -pipeline <num>:\n");
+  printf("*         Spread the adders of each Verilog/VHDL routine over the given\n");
+  printf("*         number of stages, separated by registers and ending with a\n");
+  printf("*         registered output (latency of <num> cycles). Default: 0.\n");
   printf("* \n");
   printf("* For further information, please refer to the website:\n");
   printf("* http://www.nkavvadias.com\n");
@@ -782,6 +640,7 @@ int main(int argc, char *argv[])
 {
    int i;
    char *fout_name, suffix[4], ch='X', datatype[8];
+   FILE *fout;
    ConstMulAlg kmul_algorithm = BERNSTEIN_BRIGGS;
    char a = 'o';
 
@@ -810,6 +669,44 @@ int main(int argc, char *argv[])
       kmul_algorithm = BINARY_DECOMPOSITION;
       a = 'b';
     }
+    else if (strcmp("-csd", argv[i]) == 0)
+    {
+      kmul_algorithm = CSD_DECOMPOSITION;
+      a = 'c';
+    }
+    else if (strcmp("-optimal", argv[i]) == 0)
+    {
+      kmul_algorithm = OPTIMAL;
+      a = 'x';
+    }
+    else if (strcmp("-timeout",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        timeout_val = atoi(argv[i]);
+      }
+    }
+    else if (strcmp("-minimize",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        if (strcmp("adders", argv[i]) == 0)
+        {
+          objective_val = MINIMIZE_ADDERS;
+        }
+        else if (strcmp("depth", argv[i]) == 0)
+        {
+          objective_val = MINIMIZE_DEPTH;
+        }
+        else
+        {
+          fprintf(stderr, "Error: Unknown objective \"%s\" of -minimize (adders or depth).\n", argv[i]);
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
     else if (strcmp("-unsigned", argv[i]) == 0)
     {
       is_signed = 0;
@@ -830,21 +727,167 @@ int main(int argc, char *argv[])
     {
       cgen = C99;
     }
+    else if (strcmp("-x86-64", argv[i]) == 0)
+    {
+      cgen = X86_64;
+    }
+    else if (strcmp("-aarch64", argv[i]) == 0)
+    {
+      cgen = AARCH64;
+    }
+    else if (strcmp("-llvm", argv[i]) == 0)
+    {
+      cgen = LLVM;
+    }
+    else if (strcmp("-verilog", argv[i]) == 0)
+    {
+      cgen = VERILOG;
+    }
+    else if (strcmp("-vhdl", argv[i]) == 0)
+    {
+      cgen = VHDL;
+    }
     else if (strcmp("-mul",argv[i]) == 0)
     {
       if ((i+1) < argc)
       {
         i++;
-        if (argv[i][0] == '-')
+        multiplier_val = parse_multiplier(argv[i]);
+      }
+    }    
+    else if (strcmp("-div",argv[i]) == 0 || strcmp("-mod",argv[i]) == 0)
+    {
+      routine_op = (argv[i][1] == 'd') ? KMUL_ROUTINE_DIV : KMUL_ROUTINE_MOD;
+      if ((i+1) < argc)
+      {
+        i++;
+        multiplier_val = parse_multiplier(argv[i]);
+      }
+    }
+    else if (strcmp("-range",argv[i]) == 0)
+    {
+      if ((i+2) < argc)
+      {
+        lo_val = parse_multiplier(argv[i+1]);
+        hi_val = parse_multiplier(argv[i+2]);
+        enable_range = 1;
+        i += 2;
+      }
+    }
+    else if (strcmp("-report",argv[i]) == 0)
+    {
+      if ((i+2) < argc)
+      {
+        lo_val = parse_multiplier(argv[i+1]);
+        hi_val = parse_multiplier(argv[i+2]);
+        enable_report = 1;
+        i += 2;
+      }
+    }
+    else if (strcmp("-mcm",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        parse_mcm_list(argv[i]);
+      }
+    }
+    else if (strcmp("-threads",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        num_threads = atoi(argv[i]);
+      }
+    }
+    else if (strcmp("-bench", argv[i]) == 0)
+    {
+      enable_bench = 1;
+    }
+    else if (strcmp("-jit", argv[i]) == 0)
+    {
+      enable_jit = 1;
+    }
+    else if (strcmp("-modular", argv[i]) == 0)
+    {
+      enable_modular = 1;
+    }
+    else if (strcmp("-pipeline",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        pipeline_val = atoi(argv[i]);
+      }
+    }
+    else if (strcmp("-vec",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        if (strcmp("sse2", argv[i]) == 0)
         {
-          multiplier_val = -atoi(argv[i]+1);
+          vec_isa = VEC_SSE2;
+        }
+        else if (strcmp("avx2", argv[i]) == 0)
+        {
+          vec_isa = VEC_AVX2;
         }
         else
         {
-          multiplier_val = atoi(argv[i]);
+          fprintf(stderr, "Error: Unknown instruction set \"%s\" of -vec (sse2 or avx2).\n", argv[i]);
+          exit(EXIT_FAILURE);
         }
       }
-    }    
+    }
+    else if (strcmp("-target",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        target_name = argv[i];
+      }
+    }
+    else if (strcmp("-profile",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        profile_name = argv[i];
+      }
+    }
+    else if (strcmp("-mktable",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        mktable_name = argv[i];
+      }
+    }
+    else if (strcmp("-cxx",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        cxx_name = argv[i];
+      }
+    }
+    else if (strcmp("-stats",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        stats_name = argv[i];
+      }
+    }
+    else if (strcmp("-table",argv[i]) == 0)
+    {
+      if ((i+1) < argc)
+      {
+        i++;
+        table_name = argv[i];
+      }
+    }
     else if (strcmp("-width",argv[i]) == 0)
     {
       if ((i+1) < argc)
@@ -863,16 +906,207 @@ int main(int argc, char *argv[])
     }
   }
   
-  if ((is_signed == 0) && (multiplier_val < 0))
+  if ((is_signed == 0) && is_negative)
   {
     fprintf(stderr, "Error: Multiplier must be positive for unsigned multiplication.\n");
     exit(EXIT_FAILURE);
   }
+  if ((enable_range || enable_report) && (is_signed ? (lo_val > hi_val) : ((uint64_t)lo_val > (uint64_t)hi_val)))
+  {
+    fprintf(stderr, "Error: Empty multiplier range [%" PRId64 ", %" PRId64 "].\n", lo_val, hi_val);
+    exit(EXIT_FAILURE);
+  }
+  if (timeout_val < 0)
+  {
+    fprintf(stderr, "Error: The timeout must not be negative.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (vec_isa != VEC_NONE && cgen != C99)
+  {
+    fprintf(stderr, "Error: Array kernels (-vec) are only emitted in C99.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (pipeline_val < 0)
+  {
+    fprintf(stderr, "Error: The number of pipeline stages must not be negative.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (pipeline_val > 0 && cgen != VERILOG && cgen != VHDL)
+  {
+    fprintf(stderr, "Error: Pipeline registers (-pipeline) are only inserted in Verilog or VHDL.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_bench && cgen != ANSIC && cgen != C99)
+  {
+    fprintf(stderr, "Error: Benchmarks (-bench) are only run for ANSI C or C99 routines.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_bench && mcm_count > 0)
+  {
+    fprintf(stderr, "Error: Benchmarks (-bench) are not run for multiple constant multiplications.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_jit && (cgen != NAC || enable_bench || mcm_count > 0 || mktable_name != NULL))
+  {
+    fprintf(stderr, "Error: The JIT (-jit) does not emit routines, benchmarks or tables.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (cxx_name != NULL && (enable_range || enable_bench || enable_jit || mcm_count > 0 ||
+      mktable_name != NULL || routine_op != KMUL_ROUTINE_MUL))
+  {
+    fprintf(stderr, "Error: The C++ header (-cxx) does not emit routines, benchmarks or tables.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_modular && (mcm_count > 0 || mktable_name != NULL || enable_jit || cxx_name != NULL ||
+      routine_op != KMUL_ROUTINE_MUL))
+  {
+    fprintf(stderr, "Error: The modular search (-modular) only applies to the routines of -mul and -range.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (stats_name != NULL && (mcm_count > 0 || mktable_name != NULL || enable_jit || cxx_name != NULL ||
+      routine_op != KMUL_ROUTINE_MUL))
+  {
+    fprintf(stderr, "Error: Statistics (-stats) are only written for the routines of -mul and -range.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_report && (enable_range || enable_bench || enable_jit || mcm_count > 0 || mktable_name != NULL ||
+      cxx_name != NULL || stats_name != NULL || routine_op != KMUL_ROUTINE_MUL))
+  {
+    fprintf(stderr, "Error: The report (-report) does not emit routines, benchmarks or tables.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (enable_report && (width_val < 1 || width_val > 64))
+  {
+    fprintf(stderr, "Error: The report (-report) is made for widths of 1 to 64 bits.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (routine_op != KMUL_ROUTINE_MUL)
+  {
+    if (enable_range || mcm_count > 0 || mktable_name != NULL || enable_jit)
+    {
+      fprintf(stderr, "Error: Division (-div/-mod) is only emitted for a single divisor.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (cgen > C99)
+    {
+      fprintf(stderr, "Error: Division (-div/-mod) is only emitted in NAC, ANSI C or C99.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (multiplier_val == 0)
+    {
+      fprintf(stderr, "Error: Division by zero.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (width_val < 1 || width_val > ((cgen == ANSIC) ? 16 : 32))
+    {
+      fprintf(stderr, "Error: Division (-div/-mod) is emitted for widths of 1 to %d bits%s.\n",
+        (cgen == ANSIC) ? 16 : 32, (cgen == ANSIC) ? " in ANSI C" : "");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (mcm_count > 0 && cgen > C99)
+  {
+    fprintf(stderr, "Error: Multiple constant multiplications (-mcm) are only emitted in NAC, ANSI C or C99.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (num_threads < 1)
+  {
+    fprintf(stderr, "Error: The number of threads must be positive.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (!enable_range && !enable_report)
+  {
+    lo_val = multiplier_val;
+    hi_val = multiplier_val;
+  }
+
+  // The costs of the target profile, overridden by the profile file. The
+  // assembly backends default to the profile of their processor.
+  if (target_name == NULL)
+  {
+    target_name = (cgen == X86_64 || enable_jit) ? "x86-64" : (cgen == AARCH64) ? "aarch64" : "generic";
+  }
+  if (kmul_target_profile(target_name, &cost_model) != 0)
+  {
+    fprintf(stderr, "Error: Unknown target %s (generic, x86-64, aarch64 or rv64-zba).\n", target_name);
+    exit(EXIT_FAILURE);
+  }
+  if (profile_name != NULL)
+  {
+    int status = kmul_read_profile(profile_name, &cost_model);
+
+    if (status < 0)
+    {
+      fprintf(stderr, "Error: Cannot read the cost profile %s.\n", profile_name);
+      exit(EXIT_FAILURE);
+    }
+    else if (status > 0)
+    {
+      fprintf(stderr, "Error: Invalid line %d of the cost profile %s.\n", status, profile_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (cxx_name != NULL)
+  {
+    FILE *f;
+
+    if (kmul_algorithm != BERNSTEIN_BRIGGS)
+    {
+      fprintf(stderr, "Error: The C++ header (-cxx) only searches for Bernstein-Briggs sequences.\n");
+      exit(EXIT_FAILURE);
+    }
+    f = fopen(cxx_name, "w");
+    if (f == NULL)
+    {
+      fprintf(stderr, "Error: Cannot open %s for writing.\n", cxx_name);
+      exit(EXIT_FAILURE);
+    }
+    emit_cxx_header(f, &cost_model, target_name);
+    fclose(f);
+    return 0;
+  }
+  if (mktable_name != NULL)
+  {
+    KmulContext ctx;
+    int status;
+    setup_context(&ctx, NULL);
+    status = kmul_table_build(&ctx, mktable_name, lo_val, hi_val);
+    kmul_free_context(&ctx);
+    if (status != 0)
+    {
+      fprintf(stderr, "Error: Cannot build the table %s (it cannot be written, or a cost exceeds 255).\n",
+        mktable_name);
+      exit(EXIT_FAILURE);
+    }
+    return 0;
+  }
+  if (table_name != NULL)
+  {
+    table = kmul_table_open(table_name);
+    if (table == NULL)
+    {
+      fprintf(stderr, "Error: Cannot map the table %s.\n", table_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (enable_jit)
+  {
+    run_jit(kmul_algorithm);
+    kmul_table_close(table);
+    return 0;
+  }
+  if (enable_report)
+  {
+    run_report();
+    kmul_table_close(table);
+    return 0;
+  }
 
   /* Any C standard enabled */
   enable_cany = cgen >= ANSIC && cgen <= C99;
 
-  fout_name = malloc(25 * sizeof(char));
+  fout_name = malloc(96 * sizeof(char));
   if (cgen == NAC)
   {
     strcpy(suffix, "nac");
@@ -881,29 +1115,136 @@ int main(int argc, char *argv[])
   {
     strcpy(suffix, "c");
   }
+  else if (cgen == LLVM)
+  {
+    strcpy(suffix, "ll");
+  }
+  else if (cgen == VERILOG)
+  {
+    strcpy(suffix, "v");
+  }
+  else if (cgen == VHDL)
+  {
+    strcpy(suffix, "vhd");
+  }
+  else
+  {
+    strcpy(suffix, "s");
+  }
   ch = (is_signed == 0) ? 'u' : 's';
   sprintf(datatype, "%c%d", ch, width_val);
-  if (multiplier_val >= 0)
+  if (mcm_count > 0)
+  {
+    sprintf(fout_name, "kmul_mcm_%s_%d.%s", datatype, mcm_count, suffix);
+  }
+  else if (routine_op != KMUL_ROUTINE_MUL)
   {
-    sprintf(fout_name, "kmul_%c_%s_p_%d.%s", a, datatype, multiplier_val, suffix);
+    kdiv_routine_name(fout_name, routine_op, kmul_algorithm, multiplier_val, is_signed, width_val);
+    strcat(fout_name, ".");
+    strcat(fout_name, suffix);
+  }
+  else if (enable_range)
+  {
+    sprintf(fout_name, "kmul_%c_%s_range_%c%" PRIu64 "_%c%" PRIu64 ".%s", a, datatype,
+      ((!is_signed || lo_val >= 0) ? 'p' : 'm'), (is_signed ? UABS(lo_val) : (uint64_t)lo_val),
+      ((!is_signed || hi_val >= 0) ? 'p' : 'm'), (is_signed ? UABS(hi_val) : (uint64_t)hi_val), suffix);
+  }
+  else if (!is_signed || multiplier_val >= 0)
+  {
+    sprintf(fout_name, "kmul_%c_%s_p_%" PRIu64 ".%s", a, datatype, (uint64_t)multiplier_val, suffix);
   }
   else
   {
-    sprintf(fout_name, "kmul_%c_%s_m_%d.%s", a, datatype, ABS(multiplier_val), suffix);
+    sprintf(fout_name, "kmul_%c_%s_m_%" PRIu64 ".%s", a, datatype, UABS(multiplier_val), suffix);
   }
   fout = fopen(fout_name, "w");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "Error: Cannot open %s for writing.\n", fout_name);
+    exit(EXIT_FAILURE);
+  }
+  if (stats_name != NULL)
+  {
+    size_t len = strlen(stats_name);
+    FILE *f = fopen(stats_name, "w");
 
-  if (cgen == NAC)
+    if (f == NULL)
+    {
+      fprintf(stderr, "Error: Cannot open %s for writing.\n", stats_name);
+      exit(EXIT_FAILURE);
+    }
+    kmul_stats_init(&stats, f, (len >= 4 && strcmp(stats_name + len - 4, ".csv") == 0));
+    kmul_stats_header(&stats);
+  }
+
+  if (enable_cany)
   {
-    emit_kmul_nac(fout, kmul_algorithm, multiplier_val, is_signed, width_val);
+    emit_cany_prologue(fout, cgen);
+    if (vec_isa != VEC_NONE)
+    {
+      emit_vec_prologue(fout, vec_isa);
+    }
   }
-  else if (enable_cany)
+  else if (cgen == X86_64 || cgen == AARCH64)
+  {
+    emit_asm_prologue(fout);
+  }
+  if (mcm_count > 0)
+  {
+    emit_kmul_mcm_list(fout, kmul_algorithm);
+  }
+  else if (routine_op != KMUL_ROUTINE_MUL)
+  {
+    KmulContext ctx;
+    setup_context(&ctx, fout);
+    emit_kdiv(&ctx, routine_op, kmul_algorithm, multiplier_val, is_signed, width_val);
+    kmul_free_context(&ctx);
+  }
+  else if (num_threads > 1)
+  {
+    emit_kmul_range_threaded(fout, kmul_algorithm, num_threads);
+  }
+  else
+  {
+    // The hash table is shared by all routines of the output file, so that
+    // sub-factors already solved for earlier multipliers are not searched
+    // again.
+    KmulContext ctx;
+    setup_context(&ctx, fout);
+    emit_kmul_range(&ctx, kmul_algorithm, lo_val, hi_val);
+    add_modular_stats(&ctx);
+    kmul_free_context(&ctx);
+  }
+  if (enable_modular)
+  {
+    printf("Info: %" PRIu64 " of %" PRIu64 " multipliers cheaper modulo 2^%d, saving a cost of %" PRIu64 ".\n",
+      modular_gains, modular_count, width_val, modular_savings);
+  }
+  if (stats_name != NULL)
   {
-    emit_kmul_cany(fout, kmul_algorithm, multiplier_val, is_signed, width_val);
+    kmul_stats_summary(&stats, stdout);
+    fclose(stats.f);
+  }
+
+  if (cgen == VERILOG || cgen == VHDL)
+  {
+    emit_testbench_file(fout_name, suffix, kmul_algorithm);
+  }
+  if (enable_bench)
+  {
+    // The routines are complete once the file is closed.
+    fclose(fout);
+    fout = NULL;
+    run_bench(fout_name, suffix, kmul_algorithm);
   }
 
   free(fout_name);
-  fclose(fout);
+  free(mcm_vals);
+  if (fout != NULL)
+  {
+    fclose(fout);
+  }
+  kmul_table_close(table);
 
   return 0;
 }
@@ -0,0 +1,490 @@
+/*
+ * File       : kmul.h
+ * Description: Public interface of libkmul, the library behind the kmul
+ *              generator of multiplication by integer constant routines.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KMUL_H
+#define KMUL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Initial number of slots of the memo table (a power of two)
+#define HASH_SIZE 4096
+// Operand number standing for the multiplicand "x" in a KmulOp
+#define KMUL_X      (-1)
+// Maximum number of steps in a chain
+#define KMUL_MAX_CHAIN 64
+// Number of steps of a chain falling back to the multiplier unit
+#define KMUL_CHAIN_MUL (-1)
+// Maximum number of additions/subtractions of an adder graph
+#define KMUL_MAX_GRAPH 16
+// Size of a routine name buffer for kmul_routine_name()
+#define KMUL_NAME_SIZE 48
+// Widest odd part of a multiplier of mcm_graph(); fundamentals are kept below
+// 2^(bits+1), and three times that must fit in 64 bits.
+#define KMUL_MCM_MAX_BITS 61
+
+// Code generation mode
+typedef enum
+{
+  NAC,
+  ANSIC,
+  C99,
+  X86_64,     /* GNU assembly for x86-64 (System V ABI) */
+  AARCH64,    /* GNU assembly for AArch64 (AAPCS64) */
+  LLVM,       /* LLVM IR on integers of the exact data width */
+  VERILOG,    /* Verilog-2001 module of the exact data width */
+  VHDL        /* VHDL-93 entity of the exact data width */
+} CodegenMode;
+
+// Instruction set of the array kernels emitted along with C99 routines
+typedef enum
+{
+  VEC_NONE,
+  VEC_SSE2,
+  VEC_AVX2
+} KmulVecIsa;
+
+// Constant multiplication algorithm to use
+typedef enum
+{
+  BINARY_DECOMPOSITION, /* just use binary decomposition */
+  CSD_DECOMPOSITION,    /* canonical signed digit (non-adjacent form) recoding */
+  BERNSTEIN_BRIGGS,     /* the Bernstein-Briggs dynamic programming algorithm */
+  OPTIMAL               /* exhaustive search for a minimum adder graph */
+} ConstMulAlg;
+
+// Objective of the choice among operation sequences
+typedef enum
+{
+  MINIMIZE_ADDERS,      /* fewest additions/subtractions (cost) */
+  MINIMIZE_DEPTH        /* shortest chain of dependent additions/subtractions */
+} KmulObjective;
+
+// Operation of the routines by a constant
+typedef enum
+{
+  KMUL_ROUTINE_MUL,     /* x * c */
+  KMUL_ROUTINE_DIV,     /* x / c, truncated towards zero */
+  KMUL_ROUTINE_MOD      /* x % c, with the sign of x */
+} KmulRoutineOp;
+
+// Type definitions <7a>
+typedef enum
+{
+  IDENTITY,   /* used for n = 1 */
+  NEGATE,     /* used for n = 1 */
+  SHIFT_ADD,  /* used for makeOdd(n  1) */
+  SHIFT_SUB,  /* used for makeOdd(n + 1) */
+  SHIFT_REV,  /* used for makeOdd(1  n) */
+  FACTOR_ADD, /* used for n/(2i  1) */
+  FACTOR_SUB, /* used for n/(2i + 1) */
+  FACTOR_REV  /* used for n/(1  2i) */
+} MulOp;
+
+// Type definitions <7c>
+/* Nodes live in a single arena and refer to each other by their 32-bit
+ * arena index; index NIL_NODE stands for the null node.
+ */
+typedef struct node
+{
+  int64_t value;
+  int cost;
+  unsigned int parent;
+  // Other fields in Node <10a>
+  unsigned char opcode;
+} Node;
+
+/* A slot of the memo table, mapping a value to its node; empty slots hold
+ * NIL_NODE. The value is kept in the slot so that probing does not touch the
+ * arena.
+ */
+typedef struct
+{
+  int64_t value;
+  unsigned int node;
+} MemoSlot;
+
+/* A step of a Bernstein-Briggs chain, computing the next value of the chain
+ * from the previous one (p) as e.g. (p << shift) + 1 for SHIFT_ADD.
+ */
+typedef struct
+{
+  unsigned char opcode;
+  unsigned char shift;
+} KmulStep;
+
+/* The chain of steps leading from 1 to the odd part of "target", which is
+ * then shifted left by "shift".
+ */
+typedef struct
+{
+  int64_t target;
+  int cost;
+  int num_steps;
+  int shift;
+  KmulStep steps[KMUL_MAX_CHAIN];
+} KmulChain;
+
+/* An addition or subtraction of an adder graph, computing a new fundamental
+ * from two earlier ones "a" and "b" (fundamental 0 is the multiplicand):
+ * (a << shift) + b for KMUL_ADD, (a << shift) - b for KMUL_SUB, or
+ * b - (a << shift) for KMUL_SUB with "reverse" set.
+ */
+typedef struct
+{
+  unsigned char opcode;
+  unsigned char reverse;
+  unsigned char shift;
+  unsigned short a, b;
+} KmulAdderOp;
+
+/* An adder graph whose last fundamental is the odd part of "target", which
+ * is then negated if "negate" is set and shifted left by "shift".
+ */
+typedef struct
+{
+  int64_t target;
+  int cost;
+  int num_ops;
+  int negate;
+  int shift;
+  KmulAdderOp ops[KMUL_MAX_GRAPH];
+} KmulGraph;
+
+/* A multiple constant multiplication: a single adder graph whose
+ * fundamentals include the odd parts of all the multipliers "targets".
+ * Product i is fundamental "fundamental[i]" (-1 for a zero multiplier),
+ * negated for a negative multiplier and shifted left by "shift[i]".
+ */
+typedef struct
+{
+  int num_targets;
+  int64_t *targets;
+  int *fundamental;
+  int *shift;
+  KmulAdderOp *ops;
+  int num_ops, max_ops;
+  // Cost of the whole graph, including negations and shifts of products
+  int cost;
+  // Temporary holding each product, set by emit_mcm()
+  int *outputs;
+} KmulMcm;
+
+/* Operations of a generated routine. */
+typedef enum
+{
+  KMUL_MOV,   /* dst = src1 */
+  KMUL_LDC,   /* dst = imm */
+  KMUL_SHL,   /* dst = src1 << imm */
+  KMUL_ADD,   /* dst = src1 + src2 */
+  KMUL_SUB,   /* dst = src1 - src2 */
+  KMUL_NEG,   /* dst = -src1 */
+  KMUL_MUL    /* dst = src1 * imm, when no cheaper sequence exists */
+} KmulOpcode;
+
+/* A single operation on the temporaries t<n> of a routine. Operands are
+ * temporary numbers, or KMUL_X for the multiplicand.
+ */
+typedef struct
+{
+  KmulOpcode opcode;
+  int dst, src1, src2;
+  int64_t imm;
+} KmulOp;
+
+/* The operation sequence computing a constant multiplication. Sequences
+ * returned by kmul_sequence() are in SSA form: operation i is the only one
+ * assigning temporary i.
+ */
+typedef struct
+{
+  KmulOp *ops;
+  int num_ops, max_ops;
+  // Temporary holding the product
+  int result;
+  // Multiplier computed by the sequence, which may differ from the requested
+  // one modulo 2^W in the modular search
+  int64_t multiplier;
+  // Delay cost of the single-constant multiplier (SCM)
+  int cost;
+  // Number of additions/subtractions (negations included) and the adder
+  // depth of the result, i.e. the most of them on any dependency path; a
+  // multiplication counts as a single level
+  int adders, depth;
+} KmulSequence;
+
+/* Cost of each primitive operation of the target processor. An addition or
+ * subtraction with an operand shifted left by 1 to the "fused_*_shift" limit
+ * is a single operation, e.g. lea on x86-64 or add with a shifted register on
+ * AArch64: (a << k) + b for "add", (a << k) - b for "sub" and b - (a << k) for
+ * "rsb"; 0 if there is no such operation. Multiplier constants that do not
+ * fit in an immediate of "imm_bits" bits (signed) take an extra "ldc_cost" to
+ * load.
+ */
+typedef struct
+{
+  int add_cost, sub_cost, neg_cost, shift_cost, mult_cost;
+  int fused_add_shift, fused_sub_shift, fused_rsb_shift;
+  int imm_bits, ldc_cost;
+} KmulCostModel;
+
+/* Magic numbers of the division by an invariant constant, computed by
+ * kmul_div_magic(). A magic of 0 stands for a division by a power of two.
+ */
+typedef struct
+{
+  uint64_t magic;
+  // Right shift of an unsigned dividend before its multiplication by the
+  // magic, and of the product (or the rounded sum of "add") after it
+  int pre_shift, shift;
+  // Whether the unsigned magic is m - 2^W, for a W+1-bit m
+  int add;
+} KmulDivMagic;
+
+/* A table of precomputed chains for the multipliers in [lo, hi], mapped from
+ * a file built by kmul_table_build().
+ */
+typedef struct
+{
+  const unsigned char *data;
+  size_t size;
+  const unsigned char *records;
+  int64_t lo, hi;
+  unsigned int max_steps, record_size;
+  KmulCostModel cost_model;
+} KmulTable;
+
+/* Counters of the Bernstein-Briggs search of a context, which only grow:
+ * memo table lookups, slots probed past the home slot of a value, nodes
+ * created, find_sequence() and do_try() calls, and calls of find_sequence()
+ * cut off by their cost limit.
+ */
+typedef struct
+{
+  uint64_t lookups, probes, nodes;
+  uint64_t finds, tries, pruned;
+} KmulCounters;
+
+// Number of buckets of a histogram of KmulStats
+#define KMUL_HIST_SIZE 65
+
+/* Statistics of the routines of a batch, written by kmul_stats_record() as
+ * JSON lines (or CSV rows) to "f", and aggregated into histograms of exact
+ * values (the last bucket gathering all larger ones) or of powers of two
+ * (bucket k holding [2^(k-1), 2^k), bucket 0 holding 0).
+ */
+typedef struct
+{
+  FILE *f;
+  int csv;
+  uint64_t count;
+  double seconds;
+  // Exact values
+  uint64_t cost[KMUL_HIST_SIZE], ops[KMUL_HIST_SIZE], depth[KMUL_HIST_SIZE];
+  uint64_t max_probes[KMUL_HIST_SIZE];
+  // Powers of two
+  uint64_t finds[KMUL_HIST_SIZE], nodes[KMUL_HIST_SIZE], time_us[KMUL_HIST_SIZE];
+} KmulStats;
+
+/* Search and emission state of a single generator instance. Everything that
+ * is modified while generating a routine lives here, so that independent
+ * contexts can be used concurrently.
+ */
+typedef struct
+{
+  // Cost model and the derived costs per MulOp for the Bernstein-Briggs
+  // algorithm
+  KmulCostModel cost_model;
+  int costs[8];
+  // Largest shift fused with each MulOp, and the cost of a new node, a lower
+  // bound of the cost of any step
+  int fused_shift[8];
+  int node_cost;
+  // Variable definitions <10c>
+  // Memo table of the searched values: open addressing with linear probing
+  // over a power-of-two number of slots, grown to stay at most half full.
+  MemoSlot *memo;
+  unsigned int memo_mask, memo_used;
+  // Node arena; nodes are bump-allocated and released all at once by
+  // init_multiply().
+  Node *arena;
+  unsigned int arena_used, arena_size;
+  // Operation sequence of the last multiplier
+  KmulSequence seq;
+  // Precomputed chains used instead of the search, if any
+  const KmulTable *table;
+  // Counter enumerating the number of operations for a const. mult.
+  int count;
+  // Output stream and language of the emitted routines
+  FILE *fout;
+  CodegenMode cgen;
+  // Instruction set of the array kernel emitted after each C99 routine
+  KmulVecIsa vec;
+  // Number of register stages of the Verilog/VHDL routines (0 for purely
+  // combinational ones)
+  int pipeline;
+  // Whether sequences are chosen for their cost or their adder depth
+  KmulObjective objective;
+  // Whether the multipliers of W-bit routines may be replaced by congruent
+  // ones modulo 2^W, and the number of multipliers searched so, of those
+  // that became cheaper and of the cost saved on them
+  int modular;
+  uint64_t modular_count, modular_gains, modular_savings;
+  // Stream receiving the adders and depth of every emitted routine, if any
+  FILE *finfo;
+  // Time budget of the OPTIMAL search per multiplier in milliseconds (0 for
+  // none)
+  int timeout_ms;
+  // Enable debug/diagnostic output
+  int debug;
+  // Search counters, for benchmarking and statistics, and the longest probe
+  // sequence of a lookup since it was last reset
+  KmulCounters counters;
+  unsigned int max_probes;
+  // Statistics receiving a record per emitted routine, if any
+  KmulStats *stats;
+} KmulContext;
+
+/* Function multiplying its argument by a constant, compiled at run time. */
+typedef uint64_t (*KmulJitFn)(uint64_t x);
+
+/* Compiled function of a multiplier in the JIT cache; fn is NULL for an
+ * empty slot.
+ */
+typedef struct
+{
+  int64_t m;
+  KmulJitFn fn;
+} KmulJitEntry;
+
+/* Pages of machine code holding the functions of a JIT compiler, of which
+ * the first "used" bytes are allocated.
+ */
+typedef struct
+{
+  uint8_t *base;
+  size_t size, used;
+} KmulJitChunk;
+
+/* JIT compiler of the multiplications by constants known only at run time.
+ * The functions are cached per multiplier in a table with open addressing
+ * and linear probing, grown to stay at most half full. Their code is
+ * allocated in turn from chunks of executable pages, shared by many
+ * functions.
+ */
+typedef struct
+{
+  KmulContext *ctx;
+  ConstMulAlg alg;
+  KmulJitEntry *entries;
+  unsigned int mask, used;
+  KmulJitChunk *chunks;
+  unsigned int num_chunks, max_chunks;
+  // Bytes of machine code compiled
+  size_t code_bytes;
+} KmulJit;
+
+/* Context management. */
+void kmul_init_context(KmulContext *ctx, FILE *fout, CodegenMode cgen);
+void kmul_set_cost_model(KmulContext *ctx, const KmulCostModel *cm);
+void kmul_free_context(KmulContext *ctx);
+void init_multiply(KmulContext *ctx);
+
+/* Operation sequence generation. */
+void multiply_chain(KmulContext *ctx, int64_t target, KmulChain *chain);
+void emit_chain(KmulContext *ctx, const KmulChain *chain);
+void multiply(KmulContext *ctx, int64_t target);
+void binary_decomposition(KmulContext *ctx, int64_t target);
+void csd_decomposition(KmulContext *ctx, int64_t target);
+void balanced_decomposition(KmulContext *ctx, int64_t target, int signed_digits);
+int optimal_graph(KmulContext *ctx, int64_t target, int limit, KmulGraph *graph);
+void emit_graph(KmulContext *ctx, const KmulGraph *graph);
+int mcm_graph(KmulContext *ctx, const int64_t *m, int n, KmulMcm *mcm);
+void kmul_mcm_free(KmulMcm *mcm);
+void emit_mcm(KmulContext *ctx, KmulMcm *mcm);
+const KmulSequence *kmul_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m);
+const KmulSequence *kmul_routine_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m, unsigned int W);
+
+/* Operation sequence passes. */
+void kmul_optimize_sequence(KmulSequence *seq, int *outputs, int num_outputs);
+int kmul_assign_temps(const KmulSequence *seq, const int *outputs, int num_outputs, int *var);
+KmulOp kmul_rename_op(const KmulOp *op, const int *var);
+
+/* Cost models. */
+int kmul_adder_cost(const KmulCostModel *cm, KmulOpcode opcode, int reverse, unsigned int shift);
+int kmul_target_profile(const char *name, KmulCostModel *cm);
+int kmul_read_profile(const char *path, KmulCostModel *cm);
+
+/* Routine emission. */
+unsigned int set_data_width(CodegenMode cgen, unsigned int W);
+char *get_c_type(CodegenMode cgen, int s, unsigned int W);
+void emit_cany_prologue(FILE *f, CodegenMode cgen);
+void kmul_routine_name(char *name, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_kmul_nac(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_kmul_cany(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_kmul(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_kmul_mcm(KmulContext *ctx, KmulMcm *mcm, int s, unsigned int W);
+void emit_vec_prologue(FILE *f, KmulVecIsa isa);
+void emit_asm_prologue(FILE *f);
+void emit_kmul_asm(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+size_t kmul_encode_x86_64(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W,
+  uint8_t *code, size_t size);
+void emit_kmul_llvm(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_kmul_rtl(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_bench_harness(FILE *f, const char *routines, CodegenMode cgen, KmulRoutineOp op,
+  ConstMulAlg alg, int64_t lo, int64_t hi, int s, unsigned int W);
+void emit_rtl_testbench(FILE *f, CodegenMode cgen, const char *name, ConstMulAlg alg,
+  int64_t lo, int64_t hi, int s, unsigned int W, int pipeline);
+void emit_kmul_vec(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W);
+void emit_cxx_header(FILE *f, const KmulCostModel *cm, const char *target);
+
+/* Search statistics. */
+void kmul_stats_init(KmulStats *stats, FILE *f, int csv);
+void kmul_stats_header(const KmulStats *stats);
+double kmul_stats_clock(void);
+uint64_t kmul_context_memory(const KmulContext *ctx);
+void kmul_stats_record(KmulStats *stats, const KmulContext *ctx, const char *name, int64_t m, int s,
+  const KmulCounters *before, double seconds);
+void kmul_stats_merge(KmulStats *stats, const KmulStats *other);
+void kmul_stats_summary(const KmulStats *stats, FILE *report);
+
+/* Quality report of the algorithms. */
+void kmul_report(KmulContext *ctx, FILE *csv, FILE *summary, int64_t lo, int64_t hi, int s, unsigned int W);
+
+/* Division and remainder by constants. */
+int kmul_div_magic(int64_t d, int s, unsigned int W, unsigned int wide, KmulDivMagic *mg);
+void kdiv_routine_name(char *name, KmulRoutineOp op, ConstMulAlg alg, int64_t c, int s, unsigned int W);
+void emit_kdiv(KmulContext *ctx, KmulRoutineOp op, ConstMulAlg alg, int64_t d, int s, unsigned int W);
+
+/* Run-time compilation to x86-64 machine code. */
+int kmul_jit_init(KmulJit *jit, KmulContext *ctx, ConstMulAlg alg);
+KmulJitFn kmul_jit(KmulJit *jit, int64_t m);
+void kmul_jit_free(KmulJit *jit);
+
+/* Precomputed tables of chains. */
+int kmul_table_build(KmulContext *ctx, const char *path, int64_t lo, int64_t hi);
+KmulTable *kmul_table_open(const char *path);
+void kmul_table_close(KmulTable *table);
+int kmul_use_table(KmulContext *ctx, const KmulTable *table);
+int kmul_table_chain(const KmulTable *table, int64_t m, KmulChain *chain);
+
+#endif /* KMUL_H */
@@ -0,0 +1,1881 @@
+/*
+ * File       : libkmul.c
+ * Description: Generator and calculator for multiplication by integer constant
+ *              routines. Based on the implementation of Bernstein's algorithm
+ *              in the technical report (Multiplication by Integer Constants)
+ *              by:
+ *              Preston Briggs <preston@cs.rice.edu>
+ *              Tim Harvey     <harv@cs.rice.edu>
+ *              July 13, 1994
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files <3b>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+/* dprintf: debugging printf enable by "enable" flag. */
+#define dprintf(enable, debug_f, ...) \
+if (enable==1) fprintf(debug_f, __VA_ARGS__);
+#define _d_(arg) arg
+
+// Function definitions <3c>, ...
+// Function definitions <3c>
+#define IS_ODD(c)         ((c) & 1)
+#define IS_EVEN(c)        (!IS_ODD(c))
+/* Absolute value of an integer, as an unsigned 64-bit integer. */
+#define UABS(x)           ((x) >= 0 ? (uint64_t)(x) : (uint64_t)0 - (uint64_t)(x))
+
+// Index of the null node in the node arena
+#define NIL_NODE    0
+// Initial number of nodes in the node arena
+#define ARENA_SIZE  4096
+// Number of arena nodes above which the hash table is reset between constants
+#define ARENA_LIMIT (1 << 20)
+// Initial number of operations in an operation sequence
+#define SEQ_SIZE    32
+
+// Function definitions <15b>
+// The final version of try <12b>
+static void do_try(KmulContext *ctx, int64_t factor, unsigned int node, MulOp opcode, unsigned int shift);
+// The final version of find_sequence <12a>
+static unsigned int find_sequence(KmulContext *ctx, int64_t c, int limit);
+
+
+/* Print a configurable number of space characters to an output file (specified
+ * by the given filename; the file is assumed already opened).
+ */
+static void print_spaces(FILE *f, int nspaces)
+{
+  int i;
+  for (i = 0; i < nspaces; i++)
+  {
+    fprintf(f, " ");
+  }
+}
+
+/* fprintf prefixed by a number of space characters.
+ */
+static void pfprintf(FILE *f, int nspaces, char *fmt, ...)
+{
+  va_list args;
+  print_spaces(f, nspaces);
+  va_start(args, fmt);
+  vfprintf(f, fmt, args);
+  va_end(args);
+}
+
+/* Initialize costs for the Bernstein-Briggs algorithm
+ */
+static void init_costs_for_mult_const_optimization(KmulContext *ctx)
+{
+  KmulCostModel *cm = &ctx->cost_model;
+
+  ctx->costs[0] = 0;                                /* for IDENTITY  */
+  ctx->costs[1] = cm->neg_cost;                     /* for NEGATE    */
+  ctx->costs[2] = cm->shift_cost + cm->add_cost;    /* for SHIFTADD  */
+  ctx->costs[3] = cm->shift_cost + cm->sub_cost;    /* for SHIFTSUB  */
+  ctx->costs[4] = cm->shift_cost + cm->sub_cost;    /* for SHIFTREV  */
+  ctx->costs[5] = cm->shift_cost + cm->add_cost;    /* for FACTORADD */
+  ctx->costs[6] = cm->shift_cost + cm->sub_cost;    /* for FACTORSUB */
+  ctx->costs[7] = cm->shift_cost + cm->sub_cost;    /* for FACTORREV */
+
+  // A step whose shift is fused into the addition/subtraction saves the
+  // shift.
+  ctx->fused_shift[0] = ctx->fused_shift[1] = 0;
+  ctx->fused_shift[2] = ctx->fused_shift[5] = cm->fused_add_shift;
+  ctx->fused_shift[3] = ctx->fused_shift[6] = cm->fused_sub_shift;
+  ctx->fused_shift[4] = ctx->fused_shift[7] = cm->fused_rsb_shift;
+  ctx->node_cost = cm->shift_cost;
+  if (cm->fused_add_shift > 0 && cm->add_cost < ctx->node_cost)
+  {
+    ctx->node_cost = cm->add_cost;
+  }
+  if ((cm->fused_sub_shift > 0 || cm->fused_rsb_shift > 0) && cm->sub_cost < ctx->node_cost)
+  {
+    ctx->node_cost = cm->sub_cost;
+  }
+}
+
+/* Cost of the addition (KMUL_ADD) or subtraction (KMUL_SUB) of an operand
+ * shifted left by "shift", (a << shift) +/- b, or b - (a << shift) if
+ * "reverse" is set.
+ */
+int kmul_adder_cost(const KmulCostModel *cm, KmulOpcode opcode, int reverse, unsigned int shift)
+{
+  int fused = (opcode == KMUL_ADD) ? cm->fused_add_shift :
+    (reverse ? cm->fused_rsb_shift : cm->fused_sub_shift);
+  int cost = (opcode == KMUL_ADD) ? cm->add_cost : cm->sub_cost;
+
+  if (shift > 0 && (int)shift > fused)
+  {
+    cost += cm->shift_cost;
+  }
+  return cost;
+}
+
+/* Initialize a context with the default cost model. Routines are emitted to
+ * "fout" (which may be NULL when only kmul_sequence() is used) in the "cgen"
+ * language.
+ */
+void kmul_init_context(KmulContext *ctx, FILE *fout, CodegenMode cgen)
+{
+  memset(ctx, 0, sizeof(KmulContext));
+  kmul_target_profile("generic", &ctx->cost_model);
+  ctx->fout = fout;
+  ctx->cgen = cgen;
+  init_multiply(ctx);
+}
+
+/* Switch the context to another cost model. The search results obtained with
+ * the previous one are dropped.
+ */
+void kmul_set_cost_model(KmulContext *ctx, const KmulCostModel *cm)
+{
+  ctx->cost_model = *cm;
+  init_multiply(ctx);
+}
+
+/* Release the memory held by a context.
+ */
+void kmul_free_context(KmulContext *ctx)
+{
+  free(ctx->arena);
+  free(ctx->memo);
+  free(ctx->seq.ops);
+  ctx->arena = NULL;
+  ctx->memo = NULL;
+  ctx->memo_mask = 0;
+  ctx->memo_used = 0;
+  ctx->arena_used = 0;
+  ctx->arena_size = 0;
+  ctx->seq.ops = NULL;
+  ctx->seq.num_ops = 0;
+  ctx->seq.max_ops = 0;
+}
+
+// Function definitions <3d>
+/* Return the odd part of the even value "c", and the number of halvings in
+ * "shift".
+ */
+static int64_t makeOdd(int64_t c, unsigned int *shift)
+{
+  *shift = 0;
+  do
+  {
+    c = c / 2;
+    (*shift)++;
+  } while (IS_EVEN(c));
+
+  return c;
+}
+
+/* makeOdd() for the positive values c+1 and 1-c, which may not fit in an
+ * int64_t (for c = INT64_MAX and c = INT64_MIN+1), but whose odd part does.
+ */
+static int64_t makeOddU(uint64_t c, unsigned int *shift)
+{
+  *shift = 0;
+  do
+  {
+    c = c / 2;
+    (*shift)++;
+  } while (IS_EVEN(c));
+
+  return (int64_t)c;
+}
+
+/* Allocate a node from the arena, growing the arena when it is full. Growing
+ * may move the arena, so callers must only keep node indices across calls.
+ */
+static unsigned int alloc_node(KmulContext *ctx)
+{
+  if (ctx->arena_used == ctx->arena_size)
+  {
+    ctx->arena_size = (ctx->arena_size == 0) ? ARENA_SIZE : 2 * ctx->arena_size;
+    ctx->arena = realloc(ctx->arena, ctx->arena_size * sizeof(Node));
+    if (ctx->arena == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for %u search nodes.\n", ctx->arena_size);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return ctx->arena_used++;
+}
+
+/* Hash a value to a memo slot index (before masking). The MurmurHash3
+ * finalizer spreads both small consecutive values and multiples of large
+ * powers of two over all the bits.
+ */
+static unsigned int memo_hash(int64_t c)
+{
+  uint64_t h = (uint64_t)c;
+
+  h ^= h >> 33;
+  h *= UINT64_C(0xFF51AFD7ED558CCD);
+  h ^= h >> 33;
+  h *= UINT64_C(0xC4CEB9FE1A85EC53);
+  h ^= h >> 33;
+  return (unsigned int)h;
+}
+
+/* Allocate an empty memo table of "size" slots (a power of two).
+ */
+static void alloc_memo(KmulContext *ctx, unsigned int size)
+{
+  ctx->memo = calloc(size, sizeof(MemoSlot));
+  if (ctx->memo == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %u memo table slots.\n", size);
+    exit(EXIT_FAILURE);
+  }
+  ctx->memo_mask = size - 1;
+  ctx->memo_used = 0;
+}
+
+/* Double the size of the memo table and reinsert all of its entries.
+ */
+static void grow_memo(KmulContext *ctx)
+{
+  MemoSlot *old = ctx->memo;
+  unsigned int old_size = ctx->memo_mask + 1;
+  unsigned int used = ctx->memo_used;
+  unsigned int i, j;
+
+  alloc_memo(ctx, 2 * old_size);
+  for (i = 0; i < old_size; i++)
+  {
+    if (old[i].node != NIL_NODE)
+    {
+      j = memo_hash(old[i].value) & ctx->memo_mask;
+      while (ctx->memo[j].node != NIL_NODE)
+      {
+        j = (j + 1) & ctx->memo_mask;
+      }
+      ctx->memo[j] = old[i];
+    }
+  }
+  ctx->memo_used = used;
+  free(old);
+}
+
+// Function definitions <10d>
+static unsigned int lookup(KmulContext *ctx, int64_t c)
+{
+  unsigned int i = memo_hash(c) & ctx->memo_mask;
+  unsigned int node, probes = 0;
+
+  ctx->counters.lookups++;
+  while ((node = ctx->memo[i].node) != NIL_NODE)
+  {
+    if (ctx->memo[i].value == c)
+    {
+      break;
+    }
+    i = (i + 1) & ctx->memo_mask;
+    probes++;
+  }
+  ctx->counters.probes += probes;
+  if (probes > ctx->max_probes)
+  {
+    ctx->max_probes = probes;
+  }
+  if (node != NIL_NODE)
+  {
+    return node;
+  }
+
+  // Create a new Node and add it to the empty memo slot <10e>
+  // Create and initialize node <8b>
+  node = alloc_node(ctx);
+  ctx->counters.nodes++;
+  ctx->arena[node].value = c;
+  ctx->arena[node].parent = NIL_NODE;
+  // Create and initialize node <12c>
+  ctx->arena[node].cost = ctx->node_cost;
+
+  ctx->memo[i].value = c;
+  ctx->memo[i].node = node;
+  if (2 * ++ctx->memo_used > ctx->memo_mask + 1)
+  {
+    grow_memo(ctx);
+  }
+
+  return node;
+}
+
+// The final version of find_sequence <12a>
+static unsigned int find_sequence(KmulContext *ctx, int64_t c, int limit)
+{
+  unsigned int node = lookup(ctx, c);
+
+  ctx->counters.finds++;
+  if (ctx->arena[node].parent == NIL_NODE && ctx->arena[node].cost >= limit)
+  {
+    ctx->counters.pruned++;
+  }
+  else if (ctx->arena[node].parent == NIL_NODE)
+  {
+    ctx->arena[node].cost = limit;
+
+    unsigned int shift;
+    // The odd factor is found before do_try() is called, which must get the
+    // shift of that factor: the order in which arguments are evaluated is
+    // unspecified.
+    int64_t factor;
+
+    // A fused (x << 1) + x, such as lea on x86-64, is a factor of 3 in a
+    // single step.
+    if (ctx->fused_shift[FACTOR_ADD] > 0 && c % 3 == 0 && c != 3 && c != -3)
+    {
+      do_try(ctx, c / 3, node, FACTOR_ADD, 1);
+    }
+    // Handle the positive case <9a>
+    if (c > 0)
+    {
+      int64_t power = 4;
+      int64_t edge = c >> 1;
+
+      for (shift = 2; power < edge; shift++)
+      {
+      	if (c % (power - 1) == 0)
+        {
+          do_try(ctx, c / (power - 1), node, FACTOR_SUB, shift);
+        }
+        if (c % (power + 1) == 0)
+        {
+          do_try(ctx, c / (power + 1), node, FACTOR_ADD, shift);
+        }
+        power = power << 1;
+      }
+      factor = makeOdd(c - 1, &shift);
+      do_try(ctx, factor, node, SHIFT_ADD, shift);
+      factor = makeOddU((uint64_t)c + 1, &shift);
+      do_try(ctx, factor, node, SHIFT_SUB, shift);
+    }
+    // Handle the negative case <9b>
+    else
+    {
+      int64_t power = 4;
+      int64_t edge = (-c) >> 1;
+
+      for (shift = 2; power < edge; shift++)
+      {
+      	if (c % (1 - power) == 0)
+        {
+          do_try(ctx, c / (1 - power), node, FACTOR_REV, shift);
+        }
+        if (c % (power + 1) == 0)
+        {
+          do_try(ctx, c / (power + 1), node, FACTOR_ADD, shift);
+        }
+        power = power << 1;
+      }
+      factor = makeOddU(1 - (uint64_t)c, &shift);
+      do_try(ctx, factor, node, SHIFT_REV, shift);
+      factor = makeOdd(c + 1, &shift);
+      do_try(ctx, factor, node, SHIFT_SUB, shift);
+    }
+  }
+
+  return node;
+}
+
+// The final version of try <12b>
+static void do_try(KmulContext *ctx, int64_t factor, unsigned int node, MulOp opcode, unsigned int shift)
+{
+  int cost = ctx->costs[opcode];
+
+  ctx->counters.tries++;
+  if ((int)shift <= ctx->fused_shift[opcode])
+  {
+    cost -= ctx->cost_model.shift_cost;
+  }
+  int limit = ctx->arena[node].cost - cost;
+  unsigned int factor_node = find_sequence(ctx, factor, limit);
+
+  if (ctx->arena[factor_node].parent != NIL_NODE && ctx->arena[factor_node].cost < limit)
+  {
+    ctx->arena[node].parent = factor_node;
+    ctx->arena[node].opcode = opcode;
+    ctx->arena[node].cost = ctx->arena[factor_node].cost + cost;
+  }
+}
+
+/* Append an operation to the operation sequence of the context.
+ */
+static void emit_op(KmulContext *ctx, KmulOpcode opcode, int dst, int src1, int src2, int64_t imm)
+{
+  KmulSequence *seq = &ctx->seq;
+  KmulOp *op;
+
+  if (seq->num_ops == seq->max_ops)
+  {
+    seq->max_ops = (seq->max_ops == 0) ? SEQ_SIZE : 2 * seq->max_ops;
+    seq->ops = realloc(seq->ops, seq->max_ops * sizeof(KmulOp));
+    if (seq->ops == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for %d operations.\n", seq->max_ops);
+      exit(EXIT_FAILURE);
+    }
+  }
+  op = &seq->ops[seq->num_ops++];
+  op->opcode = opcode;
+  op->dst = dst;
+  op->src1 = src1;
+  op->src2 = src2;
+  op->imm = imm;
+}
+
+/* Return the adder depth of each temporary after the operation sequence
+ * (indexed by temporary; to be freed by the caller), and count its
+ * additions/subtractions into seq->adders. Temporaries may be overwritten,
+ * so the depths are tracked in program order.
+ */
+static int *sequence_depths(KmulSequence *seq)
+{
+  int *depth;
+  int i, num_temps = 1;
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (seq->ops[i].dst >= num_temps)
+    {
+      num_temps = seq->ops[i].dst + 1;
+    }
+  }
+  depth = calloc(num_temps, sizeof(int));
+  if (depth == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %d temporaries.\n", num_temps);
+    exit(EXIT_FAILURE);
+  }
+  seq->adders = 0;
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+    int d1 = (op->src1 == KMUL_X) ? 0 : depth[op->src1];
+    int d2 = (op->src2 == KMUL_X) ? 0 : depth[op->src2];
+
+    switch (op->opcode)
+    {
+      case KMUL_MOV:
+      case KMUL_SHL:
+        depth[op->dst] = d1;
+        break;
+      case KMUL_LDC:
+        depth[op->dst] = 0;
+        break;
+      case KMUL_ADD:
+      case KMUL_SUB:
+        depth[op->dst] = ((d1 > d2) ? d1 : d2) + 1;
+        seq->adders++;
+        break;
+      case KMUL_NEG:
+        depth[op->dst] = d1 + 1;
+        seq->adders++;
+        break;
+      case KMUL_MUL:
+        depth[op->dst] = d1 + 1;
+        break;
+    }
+  }
+  return depth;
+}
+
+/* Set the number of additions/subtractions and the adder depth of the
+ * operation sequence of the context.
+ */
+static void measure_sequence(KmulContext *ctx)
+{
+  int *depth = sequence_depths(&ctx->seq);
+
+  ctx->seq.depth = depth[ctx->seq.result];
+  free(depth);
+}
+
+/* Return the amount by which "source" has to be shifted left to give
+ * "shifted", both as 64-bit patterns.
+ */
+static unsigned int shift_amount(uint64_t shifted, uint64_t source)
+{
+  uint64_t temp = source;
+  unsigned int i = 0;
+
+  do
+  {
+    temp <<= 1;
+    i++;
+  } while (shifted != temp && i < 64);
+
+  return i;
+}
+
+/* Return the value computed by a step of a chain from the value "source" of
+ * the previous step, modulo 2^64.
+ */
+static int64_t step_value(MulOp opcode, int64_t source, unsigned int shift)
+{
+  uint64_t s = (uint64_t)source, shifted = s << shift;
+
+  switch (opcode)
+  {
+    case IDENTITY:
+      return source;
+    case NEGATE:
+      return (int64_t)(0 - s);
+    case SHIFT_ADD:
+      return (int64_t)(shifted + 1);
+    case SHIFT_SUB:
+      return (int64_t)(shifted - 1);
+    case SHIFT_REV:
+      return (int64_t)(1 - shifted);
+    case FACTOR_ADD:
+      return (int64_t)(shifted + s);
+    case FACTOR_SUB:
+      return (int64_t)(shifted - s);
+    case FACTOR_REV:
+      return (int64_t)(s - shifted);
+  }
+  return source;
+}
+
+// Function definitions <13a>
+static void emit_shift(KmulContext *ctx, int64_t target, int64_t source, unsigned int i)
+{
+  dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " << %u\n", target, source, i);
+  emit_op(ctx, KMUL_SHL, ctx->count+1, ctx->count, 0, i);
+  ctx->count++;
+}
+
+// Function definitions <13b>
+static void emit_step(KmulContext *ctx, MulOp opcode, unsigned int shift, int64_t target, int64_t source)
+{
+  // The shifted source, modulo 2^64 as the target
+  int64_t shifted = (int64_t)((uint64_t)source << shift);
+
+  switch (opcode)
+  {
+    // Opcode cases <13c>
+    case IDENTITY:
+      break;
+    // Opcode cases <13d>
+    case NEGATE:
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = 0 - %" PRId64 "\n", target, source);
+      emit_op(ctx, KMUL_NEG, ctx->count+1, ctx->count, 0, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <14a>
+    case SHIFT_ADD:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " + 1\n", target, shifted);
+      emit_op(ctx, KMUL_ADD, ctx->count+1, ctx->count, KMUL_X, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <14b>
+    case SHIFT_SUB:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " - 1\n", target, shifted);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, ctx->count, KMUL_X, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <14c>
+    case SHIFT_REV:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = 1 - %" PRId64 "\n", target, shifted);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, KMUL_X, ctx->count, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <14d>
+    case FACTOR_ADD:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " + %" PRId64 "\n", target, shifted, source);
+      emit_op(ctx, KMUL_ADD, ctx->count+1, ctx->count, ctx->count-1, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <14e>
+    case FACTOR_SUB:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " - %" PRId64 "\n", target, shifted, source);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, ctx->count, ctx->count-1, 0);
+      ctx->count++;
+      break;
+    // Opcode cases <15a>
+    case FACTOR_REV:
+      emit_shift(ctx, shifted, source, shift);
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " - %" PRId64 "\n", target, source, shifted);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, ctx->count-1, ctx->count, 0);
+      ctx->count++;
+      break;
+  }
+}
+
+/* Collect the steps leading from 1 to the value of "node" into "chain".
+ */
+static void get_chain(KmulContext *ctx, unsigned int node, KmulChain *chain)
+{
+  int n = 0;
+  int i;
+
+  while (ctx->arena[node].opcode != IDENTITY)
+  {
+    unsigned int parent = ctx->arena[node].parent;
+    // Recover the shifts modulo 2^64, like the values of the search.
+    uint64_t target = (uint64_t)ctx->arena[node].value;
+    uint64_t source = (uint64_t)ctx->arena[parent].value;
+    KmulStep *step = &chain->steps[n++];
+
+    assert(n <= KMUL_MAX_CHAIN);
+    step->opcode = ctx->arena[node].opcode;
+    switch (step->opcode)
+    {
+      case SHIFT_ADD:  step->shift = shift_amount(target - 1, source); break;
+      case SHIFT_SUB:  step->shift = shift_amount(target + 1, source); break;
+      case SHIFT_REV:  step->shift = shift_amount(1 - target, source); break;
+      case FACTOR_ADD: step->shift = shift_amount(target - source, source); break;
+      case FACTOR_SUB: step->shift = shift_amount(target + source, source); break;
+      case FACTOR_REV: step->shift = shift_amount(source - target, source); break;
+      default:         step->shift = 0; break;
+    }
+    node = parent;
+  }
+  // Steps were collected from the target down to 1.
+  for (i = 0; i < n/2; i++)
+  {
+    KmulStep temp = chain->steps[i];
+    chain->steps[i] = chain->steps[n-1-i];
+    chain->steps[n-1-i] = temp;
+  }
+  chain->num_steps = n;
+}
+
+/* Emit the operations of a chain to the operation sequence of the context.
+ */
+void emit_chain(KmulContext *ctx, const KmulChain *chain)
+{
+  int64_t source = 1;
+  int i;
+
+  emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+  if (chain->num_steps == KMUL_CHAIN_MUL)
+  {
+    // No sequence is cheaper than the multiplier unit
+    emit_op(ctx, KMUL_MUL, ctx->count+1, KMUL_X, 0, chain->target);
+    ctx->count++;
+  }
+  else
+  {
+    for (i = 0; i < chain->num_steps; i++)
+    {
+      int64_t target = step_value(chain->steps[i].opcode, source, chain->steps[i].shift);
+      emit_step(ctx, chain->steps[i].opcode, chain->steps[i].shift, target, source);
+      source = target;
+    }
+    if (chain->shift > 0)
+    {
+      emit_shift(ctx, chain->target, source, chain->shift);
+    }
+  }
+  ctx->seq.cost = chain->cost;
+  ctx->seq.result = ctx->count;
+}
+
+/* Emit the A-operations of an adder graph, computing the value and the
+ * temporary of every fundamental into "value" and "temp" (fundamental 0, the
+ * multiplicand, must be set up by the caller).
+ */
+static void emit_adder_ops(KmulContext *ctx, const KmulAdderOp *ops, int num_ops, int64_t *value, int *temp)
+{
+  int i;
+
+  for (i = 0; i < num_ops; i++)
+  {
+    const KmulAdderOp *op = &ops[i];
+    int64_t shifted = (int64_t)((uint64_t)value[op->a] << op->shift);
+    int src = temp[op->a];
+
+    // Unlike in a chain, the shifted fundamental is not always the last one.
+    if (op->shift > 0)
+    {
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " << %u\n", shifted, value[op->a], op->shift);
+      emit_op(ctx, KMUL_SHL, ctx->count+1, src, 0, op->shift);
+      ctx->count++;
+      src = ctx->count;
+    }
+    if (op->opcode == KMUL_ADD)
+    {
+      value[i+1] = shifted + value[op->b];
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " + %" PRId64 "\n", value[i+1], shifted, value[op->b]);
+      emit_op(ctx, KMUL_ADD, ctx->count+1, src, temp[op->b], 0);
+    }
+    else if (op->reverse)
+    {
+      value[i+1] = value[op->b] - shifted;
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " - %" PRId64 "\n", value[i+1], value[op->b], shifted);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, temp[op->b], src, 0);
+    }
+    else
+    {
+      value[i+1] = shifted - value[op->b];
+      dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " - %" PRId64 "\n", value[i+1], shifted, value[op->b]);
+      emit_op(ctx, KMUL_SUB, ctx->count+1, src, temp[op->b], 0);
+    }
+    ctx->count++;
+    temp[i+1] = ctx->count;
+  }
+}
+
+/* Emit the product of a fundamental (of value "value" in temporary "temp")
+ * negated if "negate" is set and shifted left by "shift". Returns the
+ * temporary holding the product.
+ */
+static int emit_product(KmulContext *ctx, int64_t value, int temp, int negate, int shift)
+{
+  if (negate)
+  {
+    dprintf(ctx->debug, stdout, "Info: %" PRId64 " = 0 - %" PRId64 "\n", -value, value);
+    emit_op(ctx, KMUL_NEG, ctx->count+1, temp, 0, 0);
+    ctx->count++;
+    temp = ctx->count;
+    value = -value;
+  }
+  if (shift > 0)
+  {
+    dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " << %d\n", (int64_t)((uint64_t)value << shift), value, shift);
+    emit_op(ctx, KMUL_SHL, ctx->count+1, temp, 0, shift);
+    ctx->count++;
+    temp = ctx->count;
+  }
+  return temp;
+}
+
+/* Emit the operations of an adder graph to the operation sequence of the
+ * context.
+ */
+void emit_graph(KmulContext *ctx, const KmulGraph *graph)
+{
+  int64_t value[KMUL_MAX_GRAPH+1];
+  int temp[KMUL_MAX_GRAPH+1];
+
+  emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+  value[0] = 1;
+  temp[0] = ctx->count;
+  emit_adder_ops(ctx, graph->ops, graph->num_ops, value, temp);
+  ctx->seq.result = emit_product(ctx, value[graph->num_ops], temp[graph->num_ops],
+    graph->negate, graph->shift);
+  ctx->seq.cost = graph->cost;
+}
+
+/* Emit the operations of a multiple constant multiplication to the operation
+ * sequence of the context, and set the temporary holding each product.
+ */
+void emit_mcm(KmulContext *ctx, KmulMcm *mcm)
+{
+  int64_t *value = malloc((mcm->num_ops + 1) * sizeof(int64_t));
+  int *temp = malloc((mcm->num_ops + 1) * sizeof(int));
+  int i;
+
+  if (value == NULL || temp == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %d fundamentals.\n", mcm->num_ops + 1);
+    exit(EXIT_FAILURE);
+  }
+  ctx->seq.num_ops = 0;
+  ctx->count = 0;
+  emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+  value[0] = 1;
+  temp[0] = ctx->count;
+  emit_adder_ops(ctx, mcm->ops, mcm->num_ops, value, temp);
+  for (i = 0; i < mcm->num_targets; i++)
+  {
+    int f = mcm->fundamental[i];
+    int j;
+
+    // Repeated multipliers share their product.
+    for (j = 0; j < i && mcm->targets[j] != mcm->targets[i]; j++)
+      ;
+    if (j < i)
+    {
+      mcm->outputs[i] = mcm->outputs[j];
+    }
+    else if (f < 0)
+    {
+      emit_op(ctx, KMUL_LDC, ctx->count+1, 0, 0, 0);
+      ctx->count++;
+      mcm->outputs[i] = ctx->count;
+    }
+    else
+    {
+      mcm->outputs[i] = emit_product(ctx, value[f], temp[f], (mcm->targets[i] < 0), mcm->shift[i]);
+    }
+  }
+  ctx->seq.cost = mcm->cost;
+  kmul_optimize_sequence(&ctx->seq, mcm->outputs, mcm->num_targets);
+  ctx->seq.result = ctx->seq.num_ops - 1;
+  free(value);
+  free(temp);
+  // The depth of the routine is that of its deepest product.
+  temp = sequence_depths(&ctx->seq);
+  ctx->seq.depth = 0;
+  for (i = 0; i < mcm->num_targets; i++)
+  {
+    if (temp[mcm->outputs[i]] > ctx->seq.depth)
+    {
+      ctx->seq.depth = temp[mcm->outputs[i]];
+    }
+  }
+  free(temp);
+}
+
+// Function definitions <15c>
+static int estimate_cost(KmulContext *ctx, int64_t c)
+{
+  const KmulCostModel *cm = &ctx->cost_model;
+  int64_t limit;
+
+  // Multiplication cost for the multiplier unit, plus loading the constant
+  // unless it fits in the immediate of the multiplication
+  if (cm->imm_bits >= 64)
+  {
+    return (cm->mult_cost);
+  }
+  limit = (cm->imm_bits > 0) ? (INT64_C(1) << (cm->imm_bits - 1)) : 0;
+  if (c >= -limit && c < limit)
+  {
+    return (cm->mult_cost);
+  }
+  return (cm->mult_cost + cm->ldc_cost);
+}
+
+/* The simplest possible algorithm using binary decomposition
+ */
+void binary_decomposition(KmulContext *ctx, int64_t target) {
+  int64_t x = target;
+  int mul = 0;
+  uint64_t x_abs = UABS(x);
+
+  ctx->seq.cost = 0;
+  while (x_abs > 0) {
+    unsigned bit = x_abs & 1;
+    if (bit) {
+      if (mul == 0) {
+        emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+      } else {
+        emit_op(ctx, KMUL_SHL, ctx->count, KMUL_X, 0, mul);
+      }
+      // The shift may be fused into the addition.
+      if (ctx->count > 0) {
+        emit_op(ctx, KMUL_ADD, ctx->count, ctx->count, ctx->count-1, 0);
+        ctx->seq.cost += kmul_adder_cost(&ctx->cost_model, KMUL_ADD, 0, mul);
+      } else if (mul > 0) {
+        ctx->seq.cost += ctx->cost_model.shift_cost;
+      }
+      ctx->count++;
+    }
+    x_abs >>= 1;
+    mul++;
+  }
+  if (x < 0)
+  {
+    emit_op(ctx, KMUL_NEG, ctx->count, ctx->count-1, 0, 0);
+    ctx->seq.cost += ctx->cost_model.neg_cost;
+    ctx->count++;
+  }
+  ctx->seq.result = ctx->count-1;
+}
+
+/* Recode "x" into its non-adjacent form (NAF), which has the fewest nonzero
+ * digits among the signed binary forms and no two adjacent ones. Digits
+ * beyond bit 63 vanish modulo 2^64 and are dropped. Returns the position of
+ * the leading nonzero digit, or -1 for zero.
+ */
+static int naf_digits(uint64_t x, signed char *digit)
+{
+  int i, top = -1;
+
+  for (i = 0; i < 64; i++)
+  {
+    digit[i] = 0;
+    if (x & 1)
+    {
+      // 1 for ...01 and -1 for ...11, which clears the next bit
+      digit[i] = (signed char)(2 - (int)(x & 3));
+      x -= (uint64_t)(int64_t)digit[i];
+      top = i;
+    }
+    x >>= 1;
+  }
+  return top;
+}
+
+/* Canonical signed digit decomposition: add or subtract a shifted
+ * multiplicand for each nonzero digit of the NAF of the magnitude of
+ * "target", from the most significant one down.
+ */
+void csd_decomposition(KmulContext *ctx, int64_t target)
+{
+  signed char digit[64];
+  int i, top = naf_digits(UABS(target), digit);
+
+  ctx->seq.cost = 0;
+  for (i = top; i >= 0; i--)
+  {
+    if (digit[i] == 0)
+    {
+      continue;
+    }
+    if (i == 0)
+    {
+      emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+    }
+    else
+    {
+      emit_op(ctx, KMUL_SHL, ctx->count, KMUL_X, 0, i);
+    }
+    // The shifts of the lower digits may be fused into the
+    // additions/subtractions.
+    if (i == top)
+    {
+      ctx->seq.cost += (i > 0) ? ctx->cost_model.shift_cost : 0;
+      // The leading digit is -1 only if a digit beyond bit 63 was dropped.
+      if (digit[i] < 0)
+      {
+        emit_op(ctx, KMUL_NEG, ctx->count, ctx->count, 0, 0);
+        ctx->seq.cost += ctx->cost_model.neg_cost;
+      }
+    }
+    else if (digit[i] > 0)
+    {
+      emit_op(ctx, KMUL_ADD, ctx->count, ctx->count-1, ctx->count, 0);
+      ctx->seq.cost += kmul_adder_cost(&ctx->cost_model, KMUL_ADD, 0, i);
+    }
+    else
+    {
+      emit_op(ctx, KMUL_SUB, ctx->count, ctx->count-1, ctx->count, 0);
+      ctx->seq.cost += kmul_adder_cost(&ctx->cost_model, KMUL_SUB, 1, i);
+    }
+    ctx->count++;
+  }
+  if (target < 0)
+  {
+    emit_op(ctx, KMUL_NEG, ctx->count, ctx->count-1, 0, 0);
+    ctx->seq.cost += ctx->cost_model.neg_cost;
+    ctx->count++;
+  }
+  ctx->seq.result = ctx->count-1;
+}
+
+/* Cost of an adder of the tree combining the operands "a" and "b", which are
+ * the multiplicand shifted left by "shift_a" and "shift_b" if those are
+ * positive (leaves whose shifts have not been charged yet), with the shift of
+ * one leaf fused into it if the cost model allows. "b" is subtracted from "a"
+ * for a KMUL_SUB.
+ */
+static int tree_adder_cost(const KmulCostModel *cm, KmulOpcode opcode, int shift_a, int shift_b)
+{
+  int fuse_a = kmul_adder_cost(cm, opcode, 0, (shift_a > 0) ? shift_a : 0) + ((shift_b > 0) ? cm->shift_cost : 0);
+  int fuse_b = kmul_adder_cost(cm, opcode, (opcode == KMUL_SUB), (shift_b > 0) ? shift_b : 0) +
+    ((shift_a > 0) ? cm->shift_cost : 0);
+
+  return (fuse_a < fuse_b) ? fuse_a : fuse_b;
+}
+
+/* Sum the shifted multiplicands of the binary digits of "target" (or of its
+ * NAF digits, if "signed_digits" is set) as a balanced tree instead of a
+ * chain: the same number of additions/subtractions, but an adder depth of
+ * only ceil(log2(n)) for n nonzero digits. As in the chains, the shift of a
+ * leaf is fused into the adder taking it where the cost model allows, but an
+ * adder of two leaves fuses only one of them, so that the tree may cost more
+ * than the chain under fused shift-and-add operations.
+ */
+void balanced_decomposition(KmulContext *ctx, int64_t target, int signed_digits)
+{
+  signed char digit[64];
+  int term[64], sign[64], shift[64];
+  uint64_t x_abs = UABS(target);
+  int i, n = 0;
+
+  if (signed_digits)
+  {
+    naf_digits(x_abs, digit);
+  }
+  else
+  {
+    for (i = 0; i < 64; i++)
+    {
+      digit[i] = (signed char)((x_abs >> i) & 1);
+    }
+  }
+
+  // The leaves of the tree: the shifted multiplicands and their signs.
+  ctx->seq.cost = 0;
+  for (i = 63; i >= 0; i--)
+  {
+    if (digit[i] == 0)
+    {
+      continue;
+    }
+    if (i == 0)
+    {
+      emit_op(ctx, KMUL_MOV, ctx->count, KMUL_X, 0, 0);
+    }
+    else
+    {
+      emit_op(ctx, KMUL_SHL, ctx->count, KMUL_X, 0, i);
+    }
+    // The shift is charged with the adder taking the leaf.
+    shift[n] = i;
+    term[n] = ctx->count++;
+    sign[n++] = digit[i];
+  }
+  if (n == 1 && shift[0] > 0)
+  {
+    ctx->seq.cost += ctx->cost_model.shift_cost;
+  }
+
+  // Combine neighbouring partial sums level by level, folding their signs
+  // into the choice among an addition and the two subtractions.
+  while (n > 1)
+  {
+    int m = 0;
+
+    for (i = 0; i + 1 < n; i += 2)
+    {
+      if (sign[i] == sign[i+1])
+      {
+        emit_op(ctx, KMUL_ADD, ctx->count, term[i], term[i+1], 0);
+        ctx->seq.cost += tree_adder_cost(&ctx->cost_model, KMUL_ADD, shift[i], shift[i+1]);
+      }
+      else
+      {
+        int pos = (sign[i] > 0) ? i : i+1;
+
+        emit_op(ctx, KMUL_SUB, ctx->count, term[pos], term[2*i+1-pos], 0);
+        ctx->seq.cost += tree_adder_cost(&ctx->cost_model, KMUL_SUB, shift[pos], shift[2*i+1-pos]);
+      }
+      sign[m] = (sign[i] == sign[i+1]) ? sign[i] : 1;
+      shift[m] = 0;
+      term[m++] = ctx->count++;
+    }
+    if (i < n)
+    {
+      sign[m] = sign[i];
+      shift[m] = shift[i];
+      term[m++] = term[i];
+    }
+    n = m;
+  }
+  // A negative sum of the tree may cancel out with a negative multiplier.
+  if ((sign[0] < 0) != (target < 0))
+  {
+    emit_op(ctx, KMUL_NEG, ctx->count, term[0], 0, 0);
+    ctx->seq.cost += ctx->cost_model.neg_cost;
+    term[0] = ctx->count++;
+  }
+  ctx->seq.result = term[0];
+}
+
+// Function definitions <15d>
+void multiply_chain(KmulContext *ctx, int64_t target, KmulChain *chain)
+{
+  int multiply_cost = estimate_cost(ctx, target);
+  int shift_cost = ctx->cost_model.shift_cost;
+
+  // Keep the memory footprint of long batch runs flat.
+  if (ctx->arena_used > ARENA_LIMIT)
+  {
+    init_multiply(ctx);
+  }
+  chain->target = target;
+  chain->cost = multiply_cost;
+  chain->num_steps = KMUL_CHAIN_MUL;
+  chain->shift = 0;
+  // Handle the (straightforward) odd case <16a>
+  if (IS_ODD(target))
+  {
+    unsigned int result = find_sequence(ctx, target, multiply_cost);
+
+    if (ctx->arena[result].parent != NIL_NODE && ctx->arena[result].cost < multiply_cost)
+    {
+      get_chain(ctx, result, chain);
+      chain->cost = ctx->arena[result].cost;
+    }
+  }
+  // Handle the (relatively complex) even case <16b>
+  else
+  {
+    unsigned int shift;
+    unsigned int result = find_sequence(ctx, makeOdd(target, &shift), multiply_cost - shift_cost);
+
+    if (ctx->arena[result].parent != NIL_NODE && ctx->arena[result].cost + shift_cost < multiply_cost)
+    {
+      get_chain(ctx, result, chain);
+      chain->shift = shift_amount((uint64_t)target, (uint64_t)ctx->arena[result].value);
+      chain->cost = ctx->arena[result].cost;
+    }
+  }
+}
+
+void multiply(KmulContext *ctx, int64_t target)
+{
+  KmulChain chain;
+
+  multiply_chain(ctx, target, &chain);
+  emit_chain(ctx, &chain);
+}
+
+// Function definitions <16c>
+void init_multiply(KmulContext *ctx)
+{
+  unsigned int node, node1;
+
+  // Clear the memo table, keeping the size it has grown to.
+  if (ctx->memo == NULL)
+  {
+    alloc_memo(ctx, HASH_SIZE);
+  }
+  else
+  {
+    memset(ctx->memo, 0, (ctx->memo_mask + 1) * sizeof(MemoSlot));
+    ctx->memo_used = 0;
+  }
+  // Release all nodes at once; the first one stands for the null node.
+  ctx->arena_used = 0;
+  alloc_node(ctx);
+  init_costs_for_mult_const_optimization(ctx);
+  node1 = lookup(ctx, 1);
+  ctx->arena[node1].parent = node1;    // must not be NIL_NODE
+  ctx->arena[node1].opcode = IDENTITY;
+  ctx->arena[node1].cost = 0;
+  node = lookup(ctx, -1);
+  ctx->arena[node].parent = node1;
+  ctx->arena[node].opcode = NEGATE;
+  ctx->arena[node].cost = ctx->cost_model.neg_cost;
+}
+
+/* Replace the operation sequence of the context by the balanced sum of the
+ * NAF digits of "m" if that is shallower, or as deep but cheaper.
+ */
+static void shallowest_sequence(KmulContext *ctx, int64_t m)
+{
+  KmulSequence seq = ctx->seq;
+  int count = ctx->count;
+
+  measure_sequence(ctx);
+  seq.depth = ctx->seq.depth;
+  // Build the alternative in a fresh buffer, keeping the current one.
+  ctx->seq.ops = NULL;
+  ctx->seq.num_ops = 0;
+  ctx->seq.max_ops = 0;
+  ctx->count = 0;
+  balanced_decomposition(ctx, m, 1);
+  measure_sequence(ctx);
+  if (ctx->seq.depth < seq.depth || (ctx->seq.depth == seq.depth && ctx->seq.cost < seq.cost))
+  {
+    free(seq.ops);
+  }
+  else
+  {
+    free(ctx->seq.ops);
+    ctx->seq = seq;
+    ctx->count = count;
+  }
+}
+
+/* Compute the operation sequence for the multiplication by "m" with the given
+ * algorithm into the context.
+ */
+static void search_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m)
+{
+  ctx->seq.num_ops = 0;
+  ctx->count = 0;
+  if (m == 0)
+  {
+    emit_op(ctx, KMUL_LDC, 0, 0, 0, 0);
+    ctx->seq.result = 0;
+    ctx->seq.cost = 0;
+  }
+  else if (alg == BINARY_DECOMPOSITION || alg == CSD_DECOMPOSITION)
+  {
+    // The balanced sum of the digits has as many additions/subtractions as
+    // the chain, but may fuse fewer shifts into them.
+    if (ctx->objective == MINIMIZE_DEPTH)
+    {
+      balanced_decomposition(ctx, m, (alg == CSD_DECOMPOSITION));
+    }
+    else if (alg == BINARY_DECOMPOSITION)
+    {
+      binary_decomposition(ctx, m);
+    }
+    else
+    {
+      csd_decomposition(ctx, m);
+    }
+  }
+  else
+  {
+    KmulChain chain;
+    KmulGraph graph;
+
+    // Precomputed chains take the place of the search
+    if (ctx->table != NULL && kmul_table_chain(ctx->table, m, &chain))
+    {
+      emit_chain(ctx, &chain);
+    }
+    else
+    {
+      multiply(ctx, m);
+    }
+    // The Bernstein-Briggs sequence bounds the search for a minimum adder
+    // graph, and is kept if no cheaper graph is found in time.
+    if (alg == OPTIMAL && optimal_graph(ctx, m, ctx->seq.cost, &graph))
+    {
+      ctx->seq.num_ops = 0;
+      ctx->count = 0;
+      emit_graph(ctx, &graph);
+    }
+    if (ctx->objective == MINIMIZE_DEPTH)
+    {
+      shallowest_sequence(ctx, m);
+    }
+  }
+  kmul_optimize_sequence(&ctx->seq, &ctx->seq.result, 1);
+  measure_sequence(ctx);
+  ctx->seq.multiplier = m;
+}
+
+/* Return whether the operation sequence "seq" shifts by "W" bits or more,
+ * which is undefined for W-bit C operands.
+ */
+static int has_wide_shift(const KmulSequence *seq, unsigned int W)
+{
+  int i;
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (seq->ops[i].opcode == KMUL_SHL && seq->ops[i].imm >= (int64_t)W)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Return whether the operation sequence "a" is better than "b" for the
+ * objective of the context, when computed modulo 2^W.
+ */
+static int better_sequence(const KmulContext *ctx, const KmulSequence *a, const KmulSequence *b,
+  unsigned int W)
+{
+  int wide_a = has_wide_shift(a, W), wide_b = has_wide_shift(b, W);
+
+  if (wide_a != wide_b)
+  {
+    return (wide_b);
+  }
+  if (ctx->objective == MINIMIZE_DEPTH && a->depth != b->depth)
+  {
+    return (a->depth < b->depth);
+  }
+  if (a->cost != b->cost)
+  {
+    return (a->cost < b->cost);
+  }
+  return (a->depth < b->depth);
+}
+
+/* Replace the operation sequence of the context for "m" by the one of its
+ * unsigned or signed W-bit reading, which are congruent to it modulo 2^W,
+ * if better. "m" wins ties, so that only cheaper (or shallower) sequences, or
+ * those avoiding a shift by W bits or more, replace its own.
+ */
+static void congruent_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m, unsigned int W)
+{
+  // 2^W and the readings modulo 2^64, which holds them for W = 63 as well
+  uint64_t period = UINT64_C(1) << W;
+  uint64_t u = (uint64_t)m & (period - 1);
+  int64_t readings[2];
+  int i;
+
+  readings[0] = (int64_t)u;
+  readings[1] = (u != 0) ? (int64_t)(u - period) : 0;
+  for (i = 0; i < 2; i++)
+  {
+    KmulSequence seq = ctx->seq;
+    int count = ctx->count;
+
+    if (readings[i] == m || (i == 1 && readings[1] == readings[0]))
+    {
+      continue;
+    }
+    // Search in a fresh buffer, keeping the current one.
+    ctx->seq.ops = NULL;
+    ctx->seq.num_ops = 0;
+    ctx->seq.max_ops = 0;
+    search_sequence(ctx, alg, readings[i]);
+    if (better_sequence(ctx, &ctx->seq, &seq, W))
+    {
+      free(seq.ops);
+    }
+    else
+    {
+      free(ctx->seq.ops);
+      ctx->seq = seq;
+      ctx->count = count;
+    }
+  }
+}
+
+/* Compute the operation sequence for the multiplication by "m" modulo 2^W,
+ * as the best one for "m" itself and for its unsigned and signed W-bit
+ * readings.
+ */
+static void modular_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m, unsigned int W)
+{
+  int base_cost;
+
+  search_sequence(ctx, alg, m);
+  base_cost = ctx->seq.cost;
+  congruent_sequence(ctx, alg, m, W);
+  ctx->modular_count++;
+  if (ctx->seq.cost < base_cost)
+  {
+    ctx->modular_gains++;
+    ctx->modular_savings += (uint64_t)(base_cost - ctx->seq.cost);
+  }
+  if (ctx->seq.multiplier != m)
+  {
+    dprintf(ctx->debug, stdout, "Info: %" PRId64 " = %" PRId64 " modulo 2^%u, cost %d instead of %d\n",
+      m, ctx->seq.multiplier, W, ctx->seq.cost, base_cost);
+  }
+}
+
+/* Compute the operation sequence for the multiplication by "m" with the given
+ * algorithm. The sequence is owned by the context and remains valid until the
+ * next call.
+ */
+const KmulSequence *kmul_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m)
+{
+  search_sequence(ctx, alg, m);
+  return (&ctx->seq);
+}
+
+/* Compute the operation sequence of a W-bit routine multiplying by "m", i.e.
+ * kmul_sequence() modulo 2^W if the modular search of the context is enabled.
+ * Otherwise, a sequence shifting by W bits or more, which is undefined for
+ * W-bit C operands (e.g. x << 32 - x for 2^32 - 1 in 32 bits), is replaced by
+ * the one of a congruent reading of "m" (-x).
+ */
+const KmulSequence *kmul_routine_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m, unsigned int W)
+{
+  if (ctx->modular && W < 64)
+  {
+    modular_sequence(ctx, alg, m, W);
+  }
+  else
+  {
+    search_sequence(ctx, alg, m);
+    if (W < 64 && has_wide_shift(&ctx->seq, W))
+    {
+      congruent_sequence(ctx, alg, m, W);
+    }
+  }
+  return (&ctx->seq);
+}
+
+/* Print an operand of an operation.
+ */
+static void print_operand(FILE *f, int operand)
+{
+  if (operand == KMUL_X)
+  {
+    fprintf(f, "x");
+  }
+  else
+  {
+    fprintf(f, "t%d", operand);
+  }
+}
+
+/* Print an operation in NAC.
+ */
+static void print_op_nac(FILE *f, const KmulOp *op)
+{
+  static const char *mnemonic[] = { "mov", "ldc", "shl", "add", "sub", "neg", "mul" };
+
+  pfprintf(f, 2, "t%d <= %s ", op->dst, mnemonic[op->opcode]);
+  switch (op->opcode)
+  {
+    case KMUL_LDC:
+      fprintf(f, "%" PRId64, op->imm);
+      break;
+    case KMUL_MOV:
+    case KMUL_NEG:
+      print_operand(f, op->src1);
+      break;
+    case KMUL_SHL:
+    case KMUL_MUL:
+      print_operand(f, op->src1);
+      fprintf(f, ", %" PRId64, op->imm);
+      break;
+    case KMUL_ADD:
+    case KMUL_SUB:
+      print_operand(f, op->src1);
+      fprintf(f, ", ");
+      print_operand(f, op->src2);
+      break;
+  }
+  fprintf(f, ";\n");
+}
+
+/* Print an integer constant as an ANSI C/C99 literal. Constants that do not
+ * fit in 32 bits are printed in the unsigned form of their (at most 32-bit
+ * for ANSI C, 64-bit for C99) representation.
+ */
+static void print_c_constant(FILE *f, CodegenMode cgen, int64_t c)
+{
+  if (c >= -INT32_MAX && c <= INT32_MAX)
+  {
+    fprintf(f, "%" PRId64, c);
+  }
+  else if (cgen == ANSIC)
+  {
+    fprintf(f, "%" PRIu32 "UL", (uint32_t)c);
+  }
+  else
+  {
+    fprintf(f, "UINT64_C(%" PRIu64 ")", (uint64_t)c);
+  }
+}
+
+/* Print an operation as an ANSI C/C99 statement.
+ */
+static void print_op_cany(FILE *f, CodegenMode cgen, const KmulOp *op)
+{
+  pfprintf(f, 2, "t%d = ", op->dst);
+  switch (op->opcode)
+  {
+    case KMUL_LDC:
+      print_c_constant(f, cgen, op->imm);
+      break;
+    case KMUL_MOV:
+      print_operand(f, op->src1);
+      break;
+    case KMUL_NEG:
+      fprintf(f, "-");
+      print_operand(f, op->src1);
+      break;
+    case KMUL_SHL:
+      print_operand(f, op->src1);
+      fprintf(f, " << %" PRId64, op->imm);
+      break;
+    case KMUL_MUL:
+      print_operand(f, op->src1);
+      fprintf(f, " * ");
+      print_c_constant(f, cgen, op->imm);
+      break;
+    case KMUL_ADD:
+    case KMUL_SUB:
+      print_operand(f, op->src1);
+      fprintf(f, (op->opcode == KMUL_ADD) ? " + " : " - ");
+      print_operand(f, op->src2);
+      break;
+  }
+  fprintf(f, ";\n");
+}
+
+/* Return the variable of each temporary of the operation sequence "seq" with
+ * the products "outputs", as assigned by kmul_assign_temps(), and set
+ * "num_vars" to the number of variables.
+ */
+static int *sequence_vars(const KmulSequence *seq, const int *outputs, int num_outputs, int *num_vars)
+{
+  int *var = malloc(((seq->num_ops > 0) ? seq->num_ops : 1) * sizeof(int));
+
+  if (var == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %d temporaries.\n", seq->num_ops);
+    exit(EXIT_FAILURE);
+  }
+  *num_vars = kmul_assign_temps(seq, outputs, num_outputs, var);
+  return var;
+}
+
+/* Print the name of the routine for the multiplication by "m" into "name"
+ * (at least KMUL_NAME_SIZE characters), e.g. "kmul_o_u32_p_23". Multipliers
+ * of unsigned routines are named by their unsigned 64-bit value.
+ */
+void kmul_routine_name(char *name, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  char a = 'o';
+
+  switch (alg)
+  {
+    case BINARY_DECOMPOSITION: a = 'b'; break;
+    case CSD_DECOMPOSITION:    a = 'c'; break;
+    case OPTIMAL:              a = 'x'; break;
+    default:                            break;
+  }
+
+  if ((s == 0 && m != 0) || m > 0)
+  {
+    sprintf(name, "kmul_%c_%c%u_p_%" PRIu64, a, (s ? 's' : 'u'), W, (uint64_t)m);
+  }
+  else
+  {
+    sprintf(name, "kmul_%c_%c%u_m_%" PRIu64, a, (s ? 's' : 'u'), W, UABS(m));
+  }
+}
+
+/* Emit the NAC (generic assembly language) implementation of unsigned/signed
+ * multiplication by constant. Calls "kmul_sequence" which in turn calls
+ * "multiply", "binary_decomposition" or "csd_decomposition".
+ */
+void emit_kmul_nac(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  char c = ((s) ? 's' : 'u');
+  int num_vars = 0;
+  int *var = NULL;
+  char name[KMUL_NAME_SIZE];
+  const KmulSequence *seq;
+
+  // Apply constant multiplication optimization.
+  if (m != 0)
+  {
+    seq = kmul_routine_sequence(ctx, alg, m, W);
+    var = sequence_vars(seq, &seq->result, 1, &num_vars);
+  }
+  kmul_routine_name(name, alg, m, s, W);
+  pfprintf(f, 0, "procedure %s (in %c%d x, out %c%d y)\n", name, c, W, c, W);
+  pfprintf(f, 0, "{\n");
+  if (m == 0)
+  {
+    pfprintf(f, 2, "localvar %c%d t;\n", c, W);
+  }
+  else
+  {
+    for (int i = 0; i < num_vars; i++)
+    {
+      pfprintf(f, 2, "localvar %c%d t%d;\n", c, W, i);
+    }
+  }
+  pfprintf(f, 0, "S_1:\n");
+
+  if (m == 0)
+  {
+    pfprintf(f, 2, "t <= ldc 0;\n");
+    pfprintf(f, 2, "y <= mov t;\n");
+  }
+  else
+  {
+    for (int i = 0; i < seq->num_ops; i++)
+    {
+      KmulOp op = kmul_rename_op(&seq->ops[i], var);
+
+      print_op_nac(f, &op);
+    }
+    pfprintf(f, 2, "y <= mov t%d;\n", var[seq->result]);
+  }
+  pfprintf(f, 0, "}\n");
+  free(var);
+}
+
+/* For a given data width, set the effective data width for the corresponding integer
+ * C data type.
+ */
+unsigned int set_data_width(CodegenMode cgen, unsigned int W)
+{
+  unsigned int effective_width = 0;
+
+  if (W > 0 && W <= 8)
+  {
+    effective_width = 8;
+  }
+  else if (W > 8 && W <= 16)
+  {
+    effective_width = 16;
+  }
+  else if (W > 16 && W <= 32)
+  {
+    effective_width = 32;
+  }
+  else if ((W > 32 && W <= 64) && cgen != ANSIC)
+  {
+    effective_width = 64;
+  }
+  if ((W > 32 && cgen == ANSIC) || (W > 64))
+  {
+    fprintf(stderr, "Error: Data widths higher than %d bits are not supported.\n", (cgen == ANSIC ? 32 : 64));
+    exit(EXIT_FAILURE);
+  }
+
+  return (effective_width);
+}
+
+/* For the given signedness (s) and data width (W) return the corresponding
+ * C data type for either ANSI C or C99.
+ */
+char *get_c_type(CodegenMode cgen, int s, unsigned int W)
+{
+  char *c_type_str = malloc((strlen("unsigned long long int")+1) * sizeof(char));
+
+  if (cgen == C99)
+  {
+    int offset = 0;
+    if (s == 0)
+    {
+      strcpy(c_type_str, "u");
+      offset = 1;
+    }
+    sprintf(c_type_str+offset, "int%u_t", set_data_width(cgen, W));
+  }
+  else if (cgen == ANSIC)
+  {
+    // Plain char may be either signed or unsigned.
+    strcpy(c_type_str, (s == 0) ? "unsigned " : "");
+    if (set_data_width(cgen, W) == 8)
+    {
+      strcat(c_type_str, (s == 0) ? "char" : "signed char");
+    }
+    else if (set_data_width(cgen, W) == 16)
+    {
+      strcat(c_type_str, "short");
+    }
+    else if (set_data_width(cgen, W) == 32)
+    {
+      strcat(c_type_str, "long");
+    }
+  }
+  else
+  {
+    strncpy(c_type_str, "UNSUPPORTED", sizeof("UNSUPPORTED")+1);
+    fprintf(stderr, "Error: Unsupported C data type in get_c_type(). Exiting...\n");
+    exit(EXIT_FAILURE);
+  }
+  if ((W > 32 && cgen == ANSIC) || (W > 64))
+  {
+    fprintf(stderr, "Error: Data widths higher than %d bits are not supported.\n", (cgen == ANSIC ? 32 : 64));
+    exit(EXIT_FAILURE);
+  }
+
+  return (c_type_str);
+}
+
+/* Emit the preamble shared by all ANSI C or C99 routines of an output file.
+ */
+void emit_cany_prologue(FILE *f, CodegenMode cgen)
+{
+  if (cgen == C99)
+  {
+    pfprintf(f, 0, "#include <stdint.h>\n");
+  }
+}
+
+/* Emit the ANSI C or C99 implementation of unsigned/signed multiplication by
+ * constant.
+ */
+void emit_kmul_cany(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  char *dt = NULL;
+  int num_vars = 0;
+  int *var = NULL;
+  char name[KMUL_NAME_SIZE];
+  const KmulSequence *seq;
+
+  dt = get_c_type(ctx->cgen, s, W);
+
+  // Apply constant multiplication optimization.
+  if (m != 0)
+  {
+    seq = kmul_routine_sequence(ctx, alg, m, W);
+    var = sequence_vars(seq, &seq->result, 1, &num_vars);
+  }
+  kmul_routine_name(name, alg, m, s, W);
+  pfprintf(f, 0, "%s %s (%s x)\n", dt, name, dt);
+  pfprintf(f, 0, "{\n");
+  if (m == 0)
+  {
+    pfprintf(f, 2, "%s t;\n", dt);
+  }
+  else
+  {
+    for (int i = 0; i < num_vars; i++)
+    {
+      pfprintf(f, 2, "%s t%d;\n", dt, i);
+    }
+  }
+  pfprintf(f, 2, "%s y;\n", dt);
+
+  if (m == 0)
+  {
+    pfprintf(f, 2, "t = 0;\n");
+    pfprintf(f, 2, "y = t;\n");
+  }
+  else
+  {
+    for (int i = 0; i < seq->num_ops; i++)
+    {
+      KmulOp op = kmul_rename_op(&seq->ops[i], var);
+
+      print_op_cany(f, ctx->cgen, &op);
+    }
+    pfprintf(f, 2, "y = t%d;\n", var[seq->result]);
+  }
+  pfprintf(f, 2, "return (y);\n");
+  pfprintf(f, 0, "}\n");
+
+  free(var);
+  free(dt);
+}
+
+/* Emit a single routine computing all the products of a multiple constant
+ * multiplication (built by mcm_graph()), in the language of the context. The
+ * NAC procedure has an output y<i> per multiplier, while the C function
+ * stores product i to y[i].
+ */
+void emit_kmul_mcm(KmulContext *ctx, KmulMcm *mcm, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  char c = ((s) ? 's' : 'u');
+  char *dt = NULL;
+  int num_vars;
+  int *var;
+  int i;
+
+  emit_mcm(ctx, mcm);
+  var = sequence_vars(&ctx->seq, mcm->outputs, mcm->num_targets, &num_vars);
+  if (ctx->cgen == NAC)
+  {
+    pfprintf(f, 0, "procedure kmul_mcm_%c%u_%d (in %c%u x", c, W, mcm->num_targets, c, W);
+    for (i = 0; i < mcm->num_targets; i++)
+    {
+      fprintf(f, ", out %c%u y%d", c, W, i);
+    }
+    fprintf(f, ")\n");
+    pfprintf(f, 0, "{\n");
+    for (i = 0; i < num_vars; i++)
+    {
+      pfprintf(f, 2, "localvar %c%u t%d;\n", c, W, i);
+    }
+    pfprintf(f, 0, "S_1:\n");
+    for (i = 0; i < ctx->seq.num_ops; i++)
+    {
+      KmulOp op = kmul_rename_op(&ctx->seq.ops[i], var);
+
+      print_op_nac(f, &op);
+    }
+    for (i = 0; i < mcm->num_targets; i++)
+    {
+      pfprintf(f, 2, "y%d <= mov t%d;\n", i, var[mcm->outputs[i]]);
+    }
+    pfprintf(f, 0, "}\n");
+  }
+  else
+  {
+    dt = get_c_type(ctx->cgen, s, W);
+    pfprintf(f, 0, "void kmul_mcm_%c%u_%d (%s x, %s *y)\n", c, W, mcm->num_targets, dt, dt);
+    pfprintf(f, 0, "{\n");
+    for (i = 0; i < num_vars; i++)
+    {
+      pfprintf(f, 2, "%s t%d;\n", dt, i);
+    }
+    for (i = 0; i < ctx->seq.num_ops; i++)
+    {
+      KmulOp op = kmul_rename_op(&ctx->seq.ops[i], var);
+
+      print_op_cany(f, ctx->cgen, &op);
+    }
+    for (i = 0; i < mcm->num_targets; i++)
+    {
+      pfprintf(f, 2, "y[%d] = t%d;\n", i, var[mcm->outputs[i]]);
+    }
+    pfprintf(f, 0, "}\n");
+    free(dt);
+  }
+  free(var);
+}
+
+/* Emit the routine for the multiplication by "m" in the language of the
+ * context, and report its additions/subtractions and adder depth to the info
+ * stream of the context, if any, and its search to the statistics of the
+ * context, if any. C99 routines are followed by their array kernel if the
+ * context has a vector instruction set.
+ */
+void emit_kmul(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  KmulCounters before = ctx->counters;
+  double start = 0.0;
+
+  if (ctx->stats != NULL)
+  {
+    ctx->max_probes = 0;
+    start = kmul_stats_clock();
+  }
+  if (ctx->cgen == NAC)
+  {
+    emit_kmul_nac(ctx, alg, m, s, W);
+  }
+  else if (ctx->cgen == X86_64 || ctx->cgen == AARCH64)
+  {
+    emit_kmul_asm(ctx, alg, m, s, W);
+  }
+  else if (ctx->cgen == LLVM)
+  {
+    emit_kmul_llvm(ctx, alg, m, s, W);
+  }
+  else if (ctx->cgen == VERILOG || ctx->cgen == VHDL)
+  {
+    emit_kmul_rtl(ctx, alg, m, s, W);
+  }
+  else
+  {
+    emit_kmul_cany(ctx, alg, m, s, W);
+  }
+  if (ctx->finfo != NULL)
+  {
+    char name[KMUL_NAME_SIZE];
+
+    kmul_routine_name(name, alg, m, s, W);
+    fprintf(ctx->finfo, "Info: %s: %d additions/subtractions, adder depth %d", name,
+      (m == 0) ? 0 : ctx->seq.adders, (m == 0) ? 0 : ctx->seq.depth);
+    if (m != 0 && ctx->seq.multiplier != m)
+    {
+      fprintf(ctx->finfo, ", as %" PRId64 " modulo 2^%u", ctx->seq.multiplier, W);
+    }
+    fprintf(ctx->finfo, ".\n");
+  }
+  if (ctx->stats != NULL)
+  {
+    char name[KMUL_NAME_SIZE];
+
+    kmul_routine_name(name, alg, m, s, W);
+    kmul_stats_record(ctx->stats, ctx, name, m, s, &before, kmul_stats_clock() - start);
+  }
+  if (ctx->cgen == C99 && ctx->vec != VEC_NONE)
+  {
+    emit_kmul_vec(ctx, alg, m, s, W);
+  }
+}
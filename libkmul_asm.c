@@ -0,0 +1,952 @@
+/*
+ * File       : libkmul_asm.c
+ * Description: Emission of the routines as x86-64 or AArch64 GNU assembly
+ *              functions following the System V/AAPCS64 calling conventions,
+ *              with register allocation of the temporaries and shifts fused
+ *              into lea or shifted register operands.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+// Maximum number of allocatable registers of a target
+#define ASM_MAX_REGS 18
+
+/* The registers of a target available to a leaf function without saving
+ * them, in allocation order, and those passing the multiplicand and
+ * returning the product.
+ */
+typedef struct
+{
+  int num_regs;
+  const char *reg32[ASM_MAX_REGS];
+  const char *reg64[ASM_MAX_REGS];
+  int arg_reg, ret_reg;
+} AsmTarget;
+
+static const AsmTarget x86_64_target =
+{
+  9,
+  {"eax", "ecx", "edx", "esi", "edi", "r8d", "r9d", "r10d", "r11d"},
+  {"rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"},
+  4, 0
+};
+
+static const AsmTarget aarch64_target =
+{
+  18,
+  {"w0", "w1", "w2", "w3", "w4", "w5", "w6", "w7", "w8", "w9",
+   "w10", "w11", "w12", "w13", "w14", "w15", "w16", "w17"},
+  {"x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9",
+   "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17"},
+  0, 0
+};
+
+/* An operation of the sequence in SSA form: operands are the numbers of the
+ * operations defining them (the number of operations standing for "x"), and
+ * the second operand (the first one of a negation) may be shifted left by
+ * "shift" when a shift has been fused into the operation.
+ */
+typedef struct
+{
+  KmulOpcode opcode;
+  int src1, src2;
+  int64_t imm;
+  unsigned int shift;
+  int skip;
+} AsmOp;
+
+/* Register allocation state of a routine. */
+typedef struct
+{
+  const AsmTarget *target;
+  FILE *f;
+  CodegenMode cgen;
+  unsigned int bits;
+  AsmOp *ops;
+  int num_ops, result;
+  int *last_use, *reg, *slot;
+  int owner[ASM_MAX_REGS];
+  int num_slots;
+  // Buffer of the x86-64 machine code, encoded instead of printed when not
+  // NULL; "code_len" keeps counting beyond "code_size".
+  uint8_t *code;
+  size_t code_len, code_size;
+} AsmState;
+
+/* Hardware numbers of the registers of x86_64_target, and of rsp. */
+static const int x86_hw[] = {0, 1, 2, 6, 7, 8, 9, 10, 11};
+#define X86_RSP 4
+
+
+/* Emit the directives shared by all routines of an assembly output file. */
+void emit_asm_prologue(FILE *f)
+{
+  fprintf(f, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+  fprintf(f, "\t.text\n");
+}
+
+/* Print an instruction, unless only counting the spill slots. */
+static void asm_insn(AsmState *st, const char *fmt, ...)
+{
+  va_list args;
+
+  if (st->f == NULL)
+  {
+    return;
+  }
+  fprintf(st->f, "\t");
+  va_start(args, fmt);
+  vfprintf(st->f, fmt, args);
+  va_end(args);
+  fprintf(st->f, "\n");
+}
+
+/* Append "n" bytes of the little-endian value "v" to the machine code. */
+static void put_bytes(AsmState *st, uint64_t v, int n)
+{
+  int k;
+
+  if (st->code == NULL)
+  {
+    return;
+  }
+  for (k = 0; k < n; k++)
+  {
+    if (st->code_len < st->code_size)
+    {
+      st->code[st->code_len] = (uint8_t)(v >> (8 * k));
+    }
+    st->code_len++;
+  }
+}
+
+/* Append the REX prefix (if needed) and the opcode "op" (of "n" bytes, most
+ * significant first) of an instruction with register "reg" in the ModRM reg
+ * field and "rm" as its ModRM r/m or SIB base, and "index" as its SIB index
+ * (-1 for none), all hardware numbers.
+ */
+static void put_x86_opcode(AsmState *st, int w, int reg, int index, int rm, unsigned int op, int n)
+{
+  int rex = (w ? 8 : 0) | ((reg >> 3) << 2) | ((index > 0 ? index >> 3 : 0) << 1) | (rm >> 3);
+
+  if (rex != 0)
+  {
+    put_bytes(st, 0x40 | rex, 1);
+  }
+  for (n--; n >= 0; n--)
+  {
+    put_bytes(st, op >> (8 * n), 1);
+  }
+}
+
+/* Instruction "op" between hardware registers "reg" (ModRM reg field) and
+ * "rm" (ModRM r/m field, register direct).
+ */
+static void put_x86_rr(AsmState *st, int w, unsigned int op, int n, int reg, int rm)
+{
+  put_x86_opcode(st, w, reg, -1, rm, op, n);
+  put_bytes(st, 0xC0 | ((reg & 7) << 3) | (rm & 7), 1);
+}
+
+/* Print or encode "<mnem>{l,q} %src, %dst" of opcode "op" (r/m, reg form). */
+static void x86_alu(AsmState *st, const char *mnem, unsigned int op, int w, int src, int dst)
+{
+  const char *const *names = w ? st->target->reg64 : st->target->reg32;
+
+  asm_insn(st, "%s%c\t%%%s, %%%s", mnem, w ? 'q' : 'l', names[src], names[dst]);
+  put_x86_rr(st, w, op, 1, x86_hw[src], x86_hw[dst]);
+}
+
+/* Print or encode "lea{l,q} (%base,%index,scale), %dst", or
+ * "0(,%index,scale)" without a base (base < 0).
+ */
+static void x86_lea(AsmState *st, int w, int base, int index, unsigned int shift, int dst)
+{
+  const char *rd = w ? st->target->reg64[dst] : st->target->reg32[dst];
+
+  if (base < 0)
+  {
+    asm_insn(st, "lea%c\t0(,%%%s,%d), %%%s", w ? 'q' : 'l', st->target->reg64[index], 1 << shift, rd);
+  }
+  else if (shift > 0)
+  {
+    asm_insn(st, "lea%c\t(%%%s,%%%s,%d), %%%s", w ? 'q' : 'l', st->target->reg64[base], st->target->reg64[index], 1 << shift, rd);
+  }
+  else
+  {
+    asm_insn(st, "lea%c\t(%%%s,%%%s), %%%s", w ? 'q' : 'l', st->target->reg64[base], st->target->reg64[index], rd);
+  }
+  // ModRM r/m = 100 selects a SIB byte, whose base 101 with mod 00 stands
+  // for a 32-bit displacement instead of a base register (none of the
+  // allocated ones is rbp or r13).
+  put_x86_opcode(st, w, x86_hw[dst], x86_hw[index], (base < 0) ? 5 : x86_hw[base], 0x8D, 1);
+  put_bytes(st, ((x86_hw[dst] & 7) << 3) | 4, 1);
+  put_bytes(st, (shift << 6) | ((x86_hw[index] & 7) << 3) | ((base < 0) ? 5 : (x86_hw[base] & 7)), 1);
+  if (base < 0)
+  {
+    put_bytes(st, 0, 4);
+  }
+}
+
+/* Print or encode the spill (store) or reload of register "r" to or from
+ * "disp"(%rsp).
+ */
+static void x86_stack(AsmState *st, int store, int r, int disp)
+{
+  if (store)
+  {
+    asm_insn(st, "movq\t%%%s, %d(%%rsp)", st->target->reg64[r], disp);
+  }
+  else
+  {
+    asm_insn(st, "movq\t%d(%%rsp), %%%s", disp, st->target->reg64[r]);
+  }
+  put_x86_opcode(st, 1, x86_hw[r], -1, X86_RSP, store ? 0x89 : 0x8B, 1);
+  put_bytes(st, ((disp == 0) ? 0x00 : (disp < 128) ? 0x40 : 0x80) | ((x86_hw[r] & 7) << 3) | X86_RSP, 1);
+  put_bytes(st, 0x24, 1);
+  if (disp > 0)
+  {
+    put_bytes(st, (uint64_t)disp, (disp < 128) ? 1 : 4);
+  }
+}
+
+/* Print or encode "subq $frame, %rsp" or "addq $frame, %rsp". */
+static void x86_frame(AsmState *st, int sub, int frame)
+{
+  asm_insn(st, "%sq\t$%d, %%rsp", sub ? "sub" : "add", frame);
+  put_x86_rr(st, 1, (frame < 128) ? 0x83 : 0x81, 1, sub ? 5 : 0, X86_RSP);
+  put_bytes(st, (uint64_t)frame, (frame < 128) ? 1 : 4);
+}
+
+/* Name of register "r" at the width of the routine. */
+static const char *reg_name(AsmState *st, int r)
+{
+  return (st->bits == 64) ? st->target->reg64[r] : st->target->reg32[r];
+}
+
+/* Number of the first operation after "i" reading value "v", or num_ops if
+ * "v" is the product.
+ */
+static int next_use(AsmState *st, int v, int i)
+{
+  int j;
+
+  for (j = i + 1; j < st->num_ops; j++)
+  {
+    if (!st->ops[j].skip && (st->ops[j].src1 == v || st->ops[j].src2 == v))
+    {
+      return j;
+    }
+  }
+  return (v == st->result) ? st->num_ops : INT32_MAX;
+}
+
+/* Return a free register for operation "i", spilling the value used
+ * furthest away (but not one in register "keep1" or "keep2") if none is free.
+ */
+static int get_reg(AsmState *st, int i, int keep1, int keep2)
+{
+  int r, victim = -1, victim_use = -1;
+
+  for (r = 0; r < st->target->num_regs; r++)
+  {
+    if (st->owner[r] < 0)
+    {
+      return r;
+    }
+  }
+  for (r = 0; r < st->target->num_regs; r++)
+  {
+    int use = next_use(st, st->owner[r], i);
+    if (r != keep1 && r != keep2 && use > victim_use)
+    {
+      victim = r;
+      victim_use = use;
+    }
+  }
+  r = victim;
+  if (st->slot[st->owner[r]] < 0)
+  {
+    st->slot[st->owner[r]] = st->num_slots++;
+    if (st->cgen == X86_64)
+    {
+      x86_stack(st, 1, r, 8 * st->slot[st->owner[r]]);
+    }
+    else
+    {
+      asm_insn(st, "str\t%s, [sp, #%d]", st->target->reg64[r], 8 * st->slot[st->owner[r]]);
+    }
+  }
+  st->reg[st->owner[r]] = -1;
+  st->owner[r] = -1;
+  return r;
+}
+
+/* Bring value "v" to a register for operation "i", reloading it if spilled,
+ * without evicting register "keep".
+ */
+static int load_value(AsmState *st, int v, int i, int keep)
+{
+  int r = st->reg[v];
+
+  if (r >= 0)
+  {
+    return r;
+  }
+  r = get_reg(st, i, keep, -1);
+  if (st->cgen == X86_64)
+  {
+    x86_stack(st, 0, r, 8 * st->slot[v]);
+  }
+  else
+  {
+    asm_insn(st, "ldr\t%s, [sp, #%d]", st->target->reg64[r], 8 * st->slot[v]);
+  }
+  st->reg[v] = r;
+  st->owner[r] = v;
+  return r;
+}
+
+/* Print the instructions loading the constant "imm" into register "d". */
+static void print_ldc(AsmState *st, int d, int64_t imm)
+{
+  if (st->cgen == X86_64)
+  {
+    if (st->bits < 64)
+    {
+      asm_insn(st, "movl\t$%" PRId32 ", %%%s", (int32_t)(uint32_t)imm, reg_name(st, d));
+      put_x86_opcode(st, 0, 0, -1, x86_hw[d], 0xB8 | (x86_hw[d] & 7), 1);
+      put_bytes(st, (uint64_t)imm, 4);
+    }
+    else if (imm >= INT32_MIN && imm <= INT32_MAX)
+    {
+      asm_insn(st, "movq\t$%" PRId64 ", %%%s", imm, reg_name(st, d));
+      put_x86_rr(st, 1, 0xC7, 1, 0, x86_hw[d]);
+      put_bytes(st, (uint64_t)imm, 4);
+    }
+    else
+    {
+      asm_insn(st, "movabsq\t$%" PRId64 ", %%%s", imm, reg_name(st, d));
+      put_x86_opcode(st, 1, 0, -1, x86_hw[d], 0xB8 | (x86_hw[d] & 7), 1);
+      put_bytes(st, (uint64_t)imm, 8);
+    }
+  }
+  else
+  {
+    uint64_t u = (st->bits < 64) ? (uint32_t)imm : (uint64_t)imm;
+    unsigned int k;
+
+    // movz sets the low halfword, movk each nonzero one above it
+    asm_insn(st, "movz\t%s, #0x%x", reg_name(st, d), (unsigned int)(u & 0xFFFF));
+    for (k = 16; k < st->bits; k += 16)
+    {
+      if (((u >> k) & 0xFFFF) != 0)
+      {
+        asm_insn(st, "movk\t%s, #0x%x, lsl #%u", reg_name(st, d), (unsigned int)((u >> k) & 0xFFFF), k);
+      }
+    }
+  }
+}
+
+/* Print operation "op" computing register "d" from registers "a" and "b"
+ * in x86-64 assembly.
+ */
+static void print_op_x86_64(AsmState *st, const AsmOp *op, int d, int a, int b)
+{
+  int w = (st->bits == 64);
+  const char *rd = reg_name(st, d);
+
+  switch (op->opcode)
+  {
+    case KMUL_LDC:
+      print_ldc(st, d, op->imm);
+      break;
+    case KMUL_SHL:
+      if (op->imm >= (int64_t)st->bits)
+      {
+        x86_alu(st, "xor", 0x31, 0, d, d);
+      }
+      else if (d != a && op->imm <= 3)
+      {
+        x86_lea(st, w, -1, a, (unsigned int)op->imm, d);
+      }
+      else
+      {
+        if (d != a)
+        {
+          x86_alu(st, "mov", 0x89, w, a, d);
+        }
+        asm_insn(st, "shl%c\t$%" PRId64 ", %%%s", w ? 'q' : 'l', op->imm, rd);
+        // Shifts by 1 have their own opcode (D1 /4).
+        put_x86_rr(st, w, (op->imm == 1) ? 0xD1 : 0xC1, 1, 4, x86_hw[d]);
+        if (op->imm != 1)
+        {
+          put_bytes(st, (uint64_t)op->imm, 1);
+        }
+      }
+      break;
+    case KMUL_NEG:
+      if (d != a)
+      {
+        x86_alu(st, "mov", 0x89, w, a, d);
+      }
+      asm_insn(st, "neg%c\t%%%s", w ? 'q' : 'l', rd);
+      put_x86_rr(st, w, 0xF7, 1, 3, x86_hw[d]);
+      break;
+    case KMUL_ADD:
+      if (op->shift > 0)
+      {
+        x86_lea(st, w, a, b, op->shift, d);
+      }
+      else if (d == a || d == b)
+      {
+        x86_alu(st, "add", 0x01, w, (d == a) ? b : a, d);
+      }
+      else
+      {
+        x86_lea(st, w, a, b, 0, d);
+      }
+      break;
+    case KMUL_SUB:
+      if (d == b && d != a)
+      {
+        asm_insn(st, "neg%c\t%%%s", w ? 'q' : 'l', rd);
+        put_x86_rr(st, w, 0xF7, 1, 3, x86_hw[d]);
+        x86_alu(st, "add", 0x01, w, a, d);
+      }
+      else
+      {
+        if (d != a)
+        {
+          x86_alu(st, "mov", 0x89, w, a, d);
+        }
+        x86_alu(st, "sub", 0x29, w, b, d);
+      }
+      break;
+    case KMUL_MUL:
+      if (!w || (op->imm >= INT32_MIN && op->imm <= INT32_MAX))
+      {
+        if (!w)
+        {
+          asm_insn(st, "imull\t$%" PRId32 ", %%%s, %%%s", (int32_t)(uint32_t)op->imm, reg_name(st, a), rd);
+        }
+        else
+        {
+          asm_insn(st, "imulq\t$%" PRId64 ", %%%s, %%%s", op->imm, reg_name(st, a), rd);
+        }
+        // imul with a sign-extended 8-bit immediate if it fits (6B ib), else
+        // a 32-bit one (69 id)
+        if ((int32_t)(uint32_t)op->imm >= -128 && (int32_t)(uint32_t)op->imm <= 127)
+        {
+          put_x86_rr(st, w, 0x6B, 1, x86_hw[d], x86_hw[a]);
+          put_bytes(st, (uint64_t)op->imm, 1);
+        }
+        else
+        {
+          put_x86_rr(st, w, 0x69, 1, x86_hw[d], x86_hw[a]);
+          put_bytes(st, (uint64_t)op->imm, 4);
+        }
+      }
+      else
+      {
+        print_ldc(st, d, op->imm);
+        asm_insn(st, "imulq\t%%%s, %%%s", reg_name(st, a), rd);
+        put_x86_rr(st, 1, 0x0FAF, 2, x86_hw[d], x86_hw[a]);
+      }
+      break;
+    case KMUL_MOV:
+      break;
+  }
+}
+
+/* Print operation "op" computing register "d" from registers "a" and "b"
+ * in AArch64 assembly.
+ */
+static void print_op_aarch64(AsmState *st, const AsmOp *op, int d, int a, int b)
+{
+  const char *rd = reg_name(st, d);
+
+  switch (op->opcode)
+  {
+    case KMUL_LDC:
+      print_ldc(st, d, op->imm);
+      break;
+    case KMUL_SHL:
+      if (op->imm >= (int64_t)st->bits)
+      {
+        asm_insn(st, "mov\t%s, %s", rd, (st->bits == 64) ? "xzr" : "wzr");
+      }
+      else
+      {
+        asm_insn(st, "lsl\t%s, %s, #%" PRId64, rd, reg_name(st, a), op->imm);
+      }
+      break;
+    case KMUL_NEG:
+      if (op->shift > 0)
+      {
+        asm_insn(st, "neg\t%s, %s, lsl #%u", rd, reg_name(st, a), op->shift);
+      }
+      else
+      {
+        asm_insn(st, "neg\t%s, %s", rd, reg_name(st, a));
+      }
+      break;
+    case KMUL_ADD:
+    case KMUL_SUB:
+      if (op->shift > 0)
+      {
+        asm_insn(st, "%s\t%s, %s, %s, lsl #%u", (op->opcode == KMUL_ADD) ? "add" : "sub",
+          rd, reg_name(st, a), reg_name(st, b), op->shift);
+      }
+      else
+      {
+        asm_insn(st, "%s\t%s, %s, %s", (op->opcode == KMUL_ADD) ? "add" : "sub",
+          rd, reg_name(st, a), reg_name(st, b));
+      }
+      break;
+    case KMUL_MUL:
+      print_ldc(st, d, op->imm);
+      asm_insn(st, "mul\t%s, %s, %s", rd, reg_name(st, a), rd);
+      break;
+    case KMUL_MOV:
+      break;
+  }
+}
+
+/* Release the registers "a" and "b" of the operands of operation "i" read
+ * for the last time. Returns the released register of the first operand if
+ * any, else that of the second one, or -1.
+ */
+static int free_dying(AsmState *st, const AsmOp *op, int i, int a, int b)
+{
+  int d = -1;
+
+  if (b >= 0 && st->last_use[op->src2] == i)
+  {
+    st->owner[b] = -1;
+    st->reg[op->src2] = -1;
+    d = b;
+  }
+  if (a >= 0 && st->last_use[op->src1] == i)
+  {
+    st->owner[a] = -1;
+    st->reg[op->src1] = -1;
+    d = a;
+  }
+  return d;
+}
+
+/* Allocate the registers of the operations and print or encode them (or
+ * only count the spill slots if "st" has neither an output stream nor a code
+ * buffer). Returns the register holding the product.
+ */
+static int allocate(AsmState *st)
+{
+  int x = st->num_ops;
+  int i, r;
+
+  for (r = 0; r < ASM_MAX_REGS; r++)
+  {
+    st->owner[r] = -1;
+  }
+  for (i = 0; i <= st->num_ops; i++)
+  {
+    st->reg[i] = -1;
+    st->slot[i] = -1;
+  }
+  st->num_slots = 0;
+  st->reg[x] = st->target->arg_reg;
+  st->owner[st->target->arg_reg] = x;
+
+  for (i = 0; i < st->num_ops; i++)
+  {
+    AsmOp *op = &st->ops[i];
+    int a = -1, b = -1, d = -1, no_reuse;
+
+    if (op->skip)
+    {
+      continue;
+    }
+    if (op->src1 >= 0)
+    {
+      a = load_value(st, op->src1, i, -1);
+    }
+    if (op->src2 >= 0)
+    {
+      b = load_value(st, op->src2, i, a);
+    }
+    // A multiplication loading its constant to the result register needs
+    // its operand in another one.
+    no_reuse = op->opcode == KMUL_MUL && (st->cgen == AARCH64 ||
+      (st->bits == 64 && (op->imm < INT32_MIN || op->imm > INT32_MAX)));
+    // Otherwise registers of operands read for the last time are reused for
+    // the result, preferably that of the first operand, as x86-64
+    // instructions overwrite it.
+    if (!no_reuse)
+    {
+      d = free_dying(st, op, i, a, b);
+    }
+    // The product goes to the return register if it is free.
+    if (i == st->result && st->owner[st->target->ret_reg] < 0)
+    {
+      d = st->target->ret_reg;
+    }
+    else if (d < 0)
+    {
+      d = get_reg(st, i, a, b);
+    }
+    if (st->cgen == X86_64)
+    {
+      print_op_x86_64(st, op, d, a, b);
+    }
+    else
+    {
+      print_op_aarch64(st, op, d, a, b);
+    }
+    if (no_reuse)
+    {
+      free_dying(st, op, i, a, b);
+    }
+    st->owner[d] = i;
+    st->reg[i] = d;
+  }
+  return load_value(st, st->result, st->num_ops, -1);
+}
+
+/* Convert the sequence of the context to SSA form in "st": copies are
+ * coalesced with their source, and each shift read by a single later
+ * operation that can shift its operand for free (lea on x86-64 for shifts
+ * of 1 to 3, shifted register operands on AArch64) is fused into it.
+ */
+static void build_ops(AsmState *st, const KmulSequence *seq)
+{
+  int x = seq->num_ops;
+  int num_temps = seq->result + 1;
+  int *def, *uses;
+  int i, t;
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (seq->ops[i].dst >= num_temps)
+    {
+      num_temps = seq->ops[i].dst + 1;
+    }
+  }
+  def = malloc(num_temps * sizeof(int));
+  uses = calloc(seq->num_ops + 1, sizeof(int));
+  if (def == NULL || uses == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for the operations of a routine.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < num_temps; i++)
+  {
+    def[i] = -1;
+  }
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+    AsmOp *aop = &st->ops[i];
+
+    aop->opcode = op->opcode;
+    aop->imm = op->imm;
+    aop->shift = 0;
+    aop->skip = 0;
+    aop->src1 = -1;
+    aop->src2 = -1;
+    switch (op->opcode)
+    {
+      case KMUL_MOV:
+        aop->skip = 1;
+        def[op->dst] = (op->src1 == KMUL_X) ? x : def[op->src1];
+        continue;
+      case KMUL_LDC:
+        break;
+      case KMUL_ADD:
+      case KMUL_SUB:
+        aop->src2 = (op->src2 == KMUL_X) ? x : def[op->src2];
+        // fall through
+      default:
+        aop->src1 = (op->src1 == KMUL_X) ? x : def[op->src1];
+        break;
+    }
+    def[op->dst] = i;
+  }
+  st->result = def[seq->result];
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (!st->ops[i].skip)
+    {
+      if (st->ops[i].src1 >= 0) uses[st->ops[i].src1]++;
+      if (st->ops[i].src2 >= 0) uses[st->ops[i].src2]++;
+    }
+  }
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    AsmOp *op = &st->ops[i];
+    int *fused = NULL;
+
+    if (op->skip)
+    {
+      continue;
+    }
+    if (st->cgen == X86_64)
+    {
+      // lea computes a + (b << k) for k <= 3
+      if (op->opcode == KMUL_ADD)
+      {
+        for (t = 0; t < 2 && fused == NULL; t++)
+        {
+          int v = (t == 0) ? op->src2 : op->src1;
+          if (v < x && v != st->result && uses[v] == 1 && st->ops[v].opcode == KMUL_SHL &&
+              st->ops[v].imm >= 1 && st->ops[v].imm <= 3)
+          {
+            fused = (t == 0) ? &op->src2 : &op->src1;
+          }
+        }
+      }
+    }
+    else
+    {
+      // The second operand of add/sub and the operand of neg may be
+      // shifted by any amount below the register width.
+      int *cand[2] = { NULL, NULL };
+
+      if (op->opcode == KMUL_ADD)
+      {
+        cand[0] = &op->src2;
+        cand[1] = &op->src1;
+      }
+      else if (op->opcode == KMUL_SUB)
+      {
+        cand[0] = &op->src2;
+      }
+      else if (op->opcode == KMUL_NEG)
+      {
+        cand[0] = &op->src1;
+      }
+      for (t = 0; t < 2 && fused == NULL; t++)
+      {
+        int v = (cand[t] != NULL) ? *cand[t] : x;
+        if (v < x && v != st->result && uses[v] == 1 && st->ops[v].opcode == KMUL_SHL &&
+            st->ops[v].imm >= 1 && st->ops[v].imm < (int64_t)st->bits)
+        {
+          fused = cand[t];
+        }
+      }
+    }
+    if (fused != NULL)
+    {
+      int v = *fused;
+
+      st->ops[v].skip = 1;
+      op->shift = (unsigned int)st->ops[v].imm;
+      if (op->opcode == KMUL_NEG)
+      {
+        op->src1 = st->ops[v].src1;
+      }
+      else
+      {
+        // The shifted operand of an addition or subtraction goes second.
+        if (fused == &op->src1)
+        {
+          op->src1 = op->src2;
+        }
+        op->src2 = st->ops[v].src1;
+      }
+    }
+  }
+
+  for (i = 0; i <= seq->num_ops; i++)
+  {
+    st->last_use[i] = -1;
+  }
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (!st->ops[i].skip)
+    {
+      if (st->ops[i].src1 >= 0) st->last_use[st->ops[i].src1] = i;
+      if (st->ops[i].src2 >= 0) st->last_use[st->ops[i].src2] = i;
+    }
+  }
+  if (st->result >= 0)
+  {
+    st->last_use[st->result] = seq->num_ops;
+  }
+  free(def);
+  free(uses);
+}
+
+/* Print or encode the body of the function of "st" for the multiplication by
+ * "m" on "width"-bit data, from the entry to the return.
+ */
+static void asm_function(AsmState *st, KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int width)
+{
+  FILE *f = st->f;
+  uint8_t *code = st->code;
+  int frame = 0, r = 0;
+
+  st->bits = (width == 64) ? 64 : 32;
+  st->ops = NULL;
+  st->last_use = st->reg = st->slot = NULL;
+  if (m != 0)
+  {
+    const KmulSequence *seq = kmul_routine_sequence(ctx, alg, m, width);
+
+    st->num_ops = seq->num_ops;
+    st->ops = malloc(seq->num_ops * sizeof(AsmOp));
+    st->last_use = malloc((seq->num_ops + 1) * sizeof(int));
+    st->reg = malloc((seq->num_ops + 1) * sizeof(int));
+    st->slot = malloc((seq->num_ops + 1) * sizeof(int));
+    if (st->ops == NULL || st->last_use == NULL || st->reg == NULL || st->slot == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for the registers of a routine.\n");
+      exit(EXIT_FAILURE);
+    }
+    build_ops(st, seq);
+    // The first pass only counts the spill slots to size the frame.
+    st->f = NULL;
+    st->code = NULL;
+    allocate(st);
+    frame = (8 * st->num_slots + 15) & ~15;
+  }
+
+  st->f = f;
+  st->code = code;
+  if (frame > 0)
+  {
+    if (st->cgen == X86_64)
+    {
+      x86_frame(st, 1, frame);
+    }
+    else
+    {
+      asm_insn(st, "sub\tsp, sp, #%d", frame);
+    }
+  }
+  if (m == 0)
+  {
+    if (st->cgen == X86_64)
+    {
+      x86_alu(st, "xor", 0x31, 0, st->target->ret_reg, st->target->ret_reg);
+    }
+    else
+    {
+      asm_insn(st, "mov\tw0, #0");
+    }
+  }
+  else
+  {
+    r = allocate(st);
+    if (r != st->target->ret_reg && st->cgen == X86_64)
+    {
+      x86_alu(st, "mov", 0x89, st->bits == 64, r, st->target->ret_reg);
+    }
+    else if (r != st->target->ret_reg)
+    {
+      asm_insn(st, "mov\t%s, %s", reg_name(st, st->target->ret_reg), reg_name(st, r));
+    }
+  }
+  if (width < 32)
+  {
+    if (st->cgen == X86_64)
+    {
+      asm_insn(st, "mov%c%cl\t%%%s, %%eax", s ? 's' : 'z', (width == 8) ? 'b' : 'w', (width == 8) ? "al" : "ax");
+      // movzbl/movsbl are 0F B6/BE, movzwl/movswl 0F B7/BF
+      put_x86_rr(st, 0, 0x0FB6 | (s ? 8 : 0) | ((width == 8) ? 0 : 1), 2, 0, 0);
+    }
+    else
+    {
+      asm_insn(st, "%cxt%c\tw0, w0", s ? 's' : 'u', (width == 8) ? 'b' : 'h');
+    }
+  }
+  if (frame > 0)
+  {
+    if (st->cgen == X86_64)
+    {
+      x86_frame(st, 0, frame);
+    }
+    else
+    {
+      asm_insn(st, "add\tsp, sp, #%d", frame);
+    }
+  }
+  asm_insn(st, "ret");
+  put_bytes(st, 0xC3, 1);
+
+  free(st->ops);
+  free(st->last_use);
+  free(st->reg);
+  free(st->slot);
+}
+
+/* Emit the x86-64 or AArch64 assembly function (according to the language
+ * of the context) for the multiplication by "m", with the C prototype of the
+ * C99 routine. The multiplicand arrives in edi/rdi (w0/x0) and the product
+ * is returned in eax/rax (w0/x0), sign- or zero-extended to 32 bits for 8-
+ * and 16-bit data types. Values are spilled to the stack only when the
+ * caller-saved registers run out.
+ */
+void emit_kmul_asm(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  unsigned int width = set_data_width(C99, W);
+  char name[KMUL_NAME_SIZE];
+  AsmState st;
+
+  st.target = (ctx->cgen == X86_64) ? &x86_64_target : &aarch64_target;
+  st.cgen = ctx->cgen;
+  st.f = f;
+  st.code = NULL;
+
+  kmul_routine_name(name, alg, m, s, W);
+  fprintf(f, "\t.globl\t%s\n", name);
+  fprintf(f, "\t.p2align\t%d\n", (ctx->cgen == X86_64) ? 4 : 2);
+  fprintf(f, "\t.type\t%s, %s\n", name, (ctx->cgen == X86_64) ? "@function" : "%function");
+  fprintf(f, "%s:\n", name);
+  asm_function(&st, ctx, alg, m, s, width);
+  fprintf(f, "\t.size\t%s, .-%s\n", name, name);
+}
+
+/* Encode the x86-64 machine code of the function emitted by emit_kmul_asm()
+ * for the multiplication by "m" into the "size" bytes of "code". Returns the
+ * length of the code, which is only complete if it does not exceed "size".
+ */
+size_t kmul_encode_x86_64(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W,
+  uint8_t *code, size_t size)
+{
+  AsmState st;
+
+  st.target = &x86_64_target;
+  st.cgen = X86_64;
+  st.f = NULL;
+  st.code = code;
+  st.code_len = 0;
+  st.code_size = size;
+  asm_function(&st, ctx, alg, m, s, set_data_width(C99, W));
+  return st.code_len;
+}
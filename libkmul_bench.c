@@ -0,0 +1,250 @@
+/*
+ * File       : libkmul_bench.c
+ * Description: Emission of a harness verifying the C routines against the
+ *              native multiplication and timing both of them.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+// Widths up to this one are verified for every input
+#define BENCH_EXHAUSTIVE_WIDTH 16
+
+
+/* Emit the parts of the harness that do not depend on the routines: the
+ * timer, the verification of a routine and the timing loops.
+ */
+static void emit_bench_common(FILE *f, unsigned int bits)
+{
+  fprintf(f, "#define BENCH_BUFFER  4096\n");
+  fprintf(f, "#define BENCH_REPEAT  256\n");
+  fprintf(f, "#define BENCH_OPS     (BENCH_BUFFER * BENCH_REPEAT)\n");
+  fprintf(f, "#define BENCH_RUNS    5\n");
+  fprintf(f, "#define BENCH_SAMPLES (1 << 20)\n");
+  fprintf(f, "\n");
+  fprintf(f, "static bench_t bench_in[BENCH_BUFFER];\n");
+  fprintf(f, "static volatile bench_t bench_sink;\n");
+  fprintf(f, "\n");
+  fprintf(f, "static double bench_now (void)\n");
+  fprintf(f, "{\n");
+  fprintf(f, "  struct timespec ts;\n");
+  fprintf(f, "  clock_gettime(CLOCK_MONOTONIC, &ts);\n");
+  fprintf(f, "  return ts.tv_sec * 1e9 + ts.tv_nsec;\n");
+  fprintf(f, "}\n");
+  fprintf(f, "\n");
+  fprintf(f, "static uint64_t bench_next (uint64_t *seed)\n");
+  fprintf(f, "{\n");
+  fprintf(f, "  *seed ^= *seed << 13;\n");
+  fprintf(f, "  *seed ^= *seed >> 7;\n");
+  fprintf(f, "  *seed ^= *seed << 17;\n");
+  fprintf(f, "  return *seed;\n");
+  fprintf(f, "}\n");
+  fprintf(f, "\n");
+  fprintf(f, "/* Compare f(x) with the native g(x) for every value of the data type, or\n");
+  fprintf(f, " * for edge values and pseudo-random ones, counting the inputs in \"inputs\". */\n");
+  fprintf(f, "static unsigned long bench_verify (bench_t (*f)(bench_t), bench_t (*g)(bench_t), const char *name,\n");
+  fprintf(f, "  uint64_t *inputs)\n");
+  fprintf(f, "{\n");
+  fprintf(f, "  uint64_t %si, n;\n", (bits <= BENCH_EXHAUSTIVE_WIDTH) ? "" : "seed = UINT64_C(0x2545F4914F6CDD1D), ");
+  fprintf(f, "  unsigned long failures = 0;\n");
+  fprintf(f, "  bench_t x, y;\n");
+  if (bits <= BENCH_EXHAUSTIVE_WIDTH)
+  {
+    fprintf(f, "  n = UINT64_C(1) << %u;\n", bits);
+  }
+  else
+  {
+    fprintf(f, "  n = BENCH_SAMPLES;\n");
+  }
+  fprintf(f, "  for (i = 0; i < n; i++)\n");
+  fprintf(f, "  {\n");
+  if (bits <= BENCH_EXHAUSTIVE_WIDTH)
+  {
+    fprintf(f, "    x = (bench_t)i;\n");
+  }
+  else
+  {
+    fprintf(f, "    x = (bench_t)((i < 4) ? (uint64_t)0 - i : (i < 8) ? (UINT64_C(1) << %u) - (i - 4) : bench_next(&seed));\n",
+      bits - 1);
+  }
+  fprintf(f, "    y = f(x);\n");
+  fprintf(f, "    if (y != g(x) && failures++ < 10)\n");
+  fprintf(f, "    {\n");
+  fprintf(f, "      printf(\"FAIL: %%s(%%\" PRId64 \") = %%\" PRId64 \", expected %%\" PRId64 \"\\n\", name,\n");
+  fprintf(f, "        (int64_t)x, (int64_t)y, (int64_t)g(x));\n");
+  fprintf(f, "    }\n");
+  fprintf(f, "  }\n");
+  fprintf(f, "  *inputs = n;\n");
+  fprintf(f, "  return failures;\n");
+  fprintf(f, "}\n");
+  fprintf(f, "\n");
+  fprintf(f, "/* Throughput (independent operations) and latency (chain of dependent\n");
+  fprintf(f, " * operations) of \"f\" in ns/op, the best of BENCH_RUNS runs. */\n");
+  fprintf(f, "#define BENCH_LOOPS(f) \\\n");
+  fprintf(f, "static double f##_throughput (void) \\\n");
+  fprintf(f, "{ \\\n");
+  fprintf(f, "  double t, best = 0.0; \\\n");
+  fprintf(f, "  int run, r, i; \\\n");
+  fprintf(f, "  for (run = 0; run < BENCH_RUNS; run++) \\\n");
+  fprintf(f, "  { \\\n");
+  fprintf(f, "    bench_t acc = 0; \\\n");
+  fprintf(f, "    t = bench_now(); \\\n");
+  fprintf(f, "    for (r = 0; r < BENCH_REPEAT; r++) \\\n");
+  fprintf(f, "      for (i = 0; i < BENCH_BUFFER; i++) \\\n");
+  fprintf(f, "        acc ^= f((bench_t)(bench_in[i] ^ r)); \\\n");
+  fprintf(f, "    t = bench_now() - t; \\\n");
+  fprintf(f, "    bench_sink = acc; \\\n");
+  fprintf(f, "    best = (run == 0 || t < best) ? t : best; \\\n");
+  fprintf(f, "  } \\\n");
+  fprintf(f, "  return best / BENCH_OPS; \\\n");
+  fprintf(f, "} \\\n");
+  fprintf(f, "static double f##_latency (void) \\\n");
+  fprintf(f, "{ \\\n");
+  fprintf(f, "  double t, best = 0.0; \\\n");
+  fprintf(f, "  int run; \\\n");
+  fprintf(f, "  long i; \\\n");
+  fprintf(f, "  for (run = 0; run < BENCH_RUNS; run++) \\\n");
+  fprintf(f, "  { \\\n");
+  fprintf(f, "    bench_t x = bench_in[run]; \\\n");
+  fprintf(f, "    t = bench_now(); \\\n");
+  fprintf(f, "    for (i = 0; i < BENCH_OPS; i++) \\\n");
+  fprintf(f, "      x = f(x); \\\n");
+  fprintf(f, "    t = bench_now() - t; \\\n");
+  fprintf(f, "    bench_sink = x; \\\n");
+  fprintf(f, "    best = (run == 0 || t < best) ? t : best; \\\n");
+  fprintf(f, "  } \\\n");
+  fprintf(f, "  return best / BENCH_OPS; \\\n");
+  fprintf(f, "}\n");
+  fprintf(f, "\n");
+  fprintf(f, "/* Verify and time routine \"f\" against the native multiplication \"g\". */\n");
+  fprintf(f, "#define BENCH(f, g) \\\n");
+  fprintf(f, "  do \\\n");
+  fprintf(f, "  { \\\n");
+  fprintf(f, "    uint64_t inputs; \\\n");
+  fprintf(f, "    unsigned long n = bench_verify(f, g, #f, &inputs); \\\n");
+  fprintf(f, "    failures += n; \\\n");
+  fprintf(f, "    printf(\"%%-36s %%-7s %%9\" PRIu64 \" %%-4s %%9.3f %%9.3f %%9.3f %%9.3f\\n\", #f, \\\n");
+  fprintf(f, "      (n == 0) ? \"ok\" : \"FAILED\", inputs, \"%s\", \\\n",
+    (bits <= BENCH_EXHAUSTIVE_WIDTH) ? "all" : "rand");
+  fprintf(f, "      f##_throughput(), g##_throughput(), f##_latency(), g##_latency()); \\\n");
+  fprintf(f, "  } while (0)\n");
+  fprintf(f, "\n");
+}
+
+/* Emit the native operation "op" of x by "c" as the body of a function. */
+static void emit_bench_native(FILE *f, KmulRoutineOp op, int64_t c, int s)
+{
+  if (op == KMUL_ROUTINE_MUL)
+  {
+    fprintf(f, "  return (bench_t)((uint64_t)x * UINT64_C(%" PRIu64 "));\n", (uint64_t)c);
+  }
+  else if (s && c == -1)
+  {
+    // The quotient of the most negative value by -1 overflows.
+    fprintf(f, "  return (bench_t)%s;\n", (op == KMUL_ROUTINE_DIV) ? "(0 - (uint64_t)x)" : "0");
+  }
+  else if (s)
+  {
+    fprintf(f, "  return (bench_t)(x %c (bench_t)INT64_C(%" PRId64 "));\n", (op == KMUL_ROUTINE_DIV) ? '/' : '%', c);
+  }
+  else
+  {
+    fprintf(f, "  return (bench_t)(x %c (bench_t)UINT64_C(%" PRIu64 "));\n", (op == KMUL_ROUTINE_DIV) ? '/' : '%',
+      (uint64_t)c);
+  }
+}
+
+/* Emit the harness of the C routines (ANSI C or C99, according to "cgen") in
+ * file "routines" of operation "op" (multiplication, division or remainder)
+ * by the constants in [lo, hi]. The harness includes the routines, so that
+ * they are inlined like the native operation "(T)(x * m)", "x / d" or
+ * "x % d" they are compared with. Each routine is verified for every input
+ * when its C type has at most 16 bits, or else for edge values and 2^20
+ * pseudo-random inputs. Both are then timed in a throughput loop of
+ * independent operations and a latency loop where each operation takes the
+ * previous result, reporting ns/op. The harness returns a nonzero status if
+ * any routine fails.
+ */
+void emit_bench_harness(FILE *f, const char *routines, CodegenMode cgen, KmulRoutineOp op,
+  ConstMulAlg alg, int64_t lo, int64_t hi, int s, unsigned int W)
+{
+  unsigned int bits = set_data_width(cgen, W);
+  char *dt = get_c_type(cgen, s, W);
+  char name[KMUL_NAME_SIZE];
+  uint64_t u;
+
+  fprintf(f, "/* Verification and micro-benchmark of the routines of %s. */\n", routines);
+  fprintf(f, "#define _POSIX_C_SOURCE 199309L\n");
+  fprintf(f, "#include <stdio.h>\n");
+  fprintf(f, "#include <stdint.h>\n");
+  fprintf(f, "#include <inttypes.h>\n");
+  fprintf(f, "#include <time.h>\n");
+  fprintf(f, "#include \"%s\"\n", routines);
+  fprintf(f, "\n");
+  fprintf(f, "typedef %s bench_t;\n", dt);
+  fprintf(f, "\n");
+  emit_bench_common(f, bits);
+
+  for (u = (uint64_t)lo; ; u++)
+  {
+    kdiv_routine_name(name, op, alg, (int64_t)u, s, W);
+    fprintf(f, "static bench_t %s_native (bench_t x)\n", name);
+    fprintf(f, "{\n");
+    emit_bench_native(f, op, (int64_t)u, s);
+    fprintf(f, "}\n");
+    fprintf(f, "BENCH_LOOPS(%s)\n", name);
+    fprintf(f, "BENCH_LOOPS(%s_native)\n", name);
+    fprintf(f, "\n");
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+
+  fprintf(f, "int main (void)\n");
+  fprintf(f, "{\n");
+  fprintf(f, "  uint64_t seed = UINT64_C(0x9E3779B97F4A7C15);\n");
+  fprintf(f, "  unsigned long failures = 0;\n");
+  fprintf(f, "  int i;\n");
+  fprintf(f, "\n");
+  fprintf(f, "  for (i = 0; i < BENCH_BUFFER; i++)\n");
+  fprintf(f, "  {\n");
+  fprintf(f, "    bench_in[i] = (bench_t)bench_next(&seed);\n");
+  fprintf(f, "  }\n");
+  fprintf(f, "  printf(\"%%-36s %%-7s %%14s %%9s %%9s %%9s %%9s\\n\", \"routine\", \"check\", \"inputs\",\n");
+  fprintf(f, "    \"thr ns/op\", \"native\", \"lat ns/op\", \"native\");\n");
+  for (u = (uint64_t)lo; ; u++)
+  {
+    kdiv_routine_name(name, op, alg, (int64_t)u, s, W);
+    fprintf(f, "  BENCH(%s, %s_native);\n", name, name);
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "  return (failures != 0);\n");
+  fprintf(f, "}\n");
+
+  free(dt);
+}
@@ -0,0 +1,555 @@
+/*
+ * File       : libkmul_cxx.c
+ * Description: Emission of a self-contained C++17 header, whose templates
+ *              search for the Bernstein-Briggs sequence of a constant and
+ *              expand it into shift-and-add code at compile time.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+// Include files
+#include <stdio.h>
+#include "kmul.h"
+
+
+/* The header up to the cost model of the target. */
+static const char *cxx_prologue[] =
+{
+  "#ifndef KMUL_HPP",
+  "#define KMUL_HPP",
+  "",
+  "#include <cstddef>",
+  "#include <cstdint>",
+  "#include <limits>",
+  "#include <type_traits>",
+  "#include <utility>",
+  "",
+  "namespace kmul",
+  "{",
+  "",
+  "// Costs of the primitive operations of the target",
+  "struct cost_model",
+  "{",
+  "  int add, sub, neg, shift, mult;",
+  "  int fused_add_shift, fused_sub_shift, fused_rsb_shift;",
+  "  int imm_bits, ldc;",
+  "};",
+  "",
+  NULL
+};
+
+/* The rest of the header: the constexpr port of find_sequence() and
+ * multiply_chain() of libkmul.c, and the templates expanding its chains.
+ */
+static const char *cxx_body[] =
+{
+  "",
+  "namespace detail",
+  "{",
+  "",
+  "// Steps of a chain, computing a value from the one of the previous step p",
+  "// and the multiplicand x, as in libkmul.c",
+  "enum op : int",
+  "{",
+  "  identity,     // p",
+  "  negate,       // -p",
+  "  shift_add,    // (p << s) + x",
+  "  shift_sub,    // (p << s) - x",
+  "  shift_rev,    // x - (p << s)",
+  "  factor_add,   // (p << s) + p",
+  "  factor_sub,   // (p << s) - p",
+  "  factor_rev    // p - (p << s)",
+  "};",
+  "",
+  "// Longest chain, as KMUL_MAX_CHAIN",
+  "inline constexpr int max_chain = 128;",
+  "// Search nodes per constant; the search gives up on the values it cannot",
+  "// add once they are exhausted, keeping within the constexpr limits of the",
+  "// compilers.",
+  "inline constexpr int max_nodes = 1024;",
+  "inline constexpr int memo_slots = 2 * max_nodes;",
+  "",
+  "struct step",
+  "{",
+  "  int opcode;",
+  "  unsigned int shift;",
+  "};",
+  "",
+  "// A chain of steps from 1 followed by a final shift, or the native",
+  "// multiplication if \"native\" is set",
+  "struct chain",
+  "{",
+  "  step steps[max_chain];",
+  "  int num_steps;",
+  "  unsigned int shift;",
+  "  int cost;",
+  "  int additions;",
+  "  bool native;",
+  "};",
+  "",
+  "struct node",
+  "{",
+  "  std::int64_t value;",
+  "  int parent;",
+  "  int opcode;",
+  "  int cost;",
+  "};",
+  "",
+  "constexpr std::int64_t make_odd(std::uint64_t c, unsigned int &shift)",
+  "{",
+  "  shift = 0;",
+  "  do",
+  "  {",
+  "    c = c / 2;",
+  "    shift++;",
+  "  } while (c % 2 == 0);",
+  "  return static_cast<std::int64_t>(c);",
+  "}",
+  "",
+  "constexpr std::int64_t make_odd(std::int64_t c, unsigned int &shift)",
+  "{",
+  "  shift = 0;",
+  "  do",
+  "  {",
+  "    c = c / 2;",
+  "    shift++;",
+  "  } while (c % 2 == 0);",
+  "  return c;",
+  "}",
+  "",
+  "constexpr unsigned int hash(std::int64_t c)",
+  "{",
+  "  std::uint64_t h = static_cast<std::uint64_t>(c);",
+  "",
+  "  h ^= h >> 33;",
+  "  h *= 0xFF51AFD7ED558CCDull;",
+  "  h ^= h >> 33;",
+  "  h *= 0xC4CEB9FE1A85EC53ull;",
+  "  h ^= h >> 33;",
+  "  return static_cast<unsigned int>(h);",
+  "}",
+  "",
+  "// The memoized branch-and-bound search of find_sequence() in libkmul.c",
+  "class search",
+  "{",
+  "public:",
+  "  constexpr search() : arena(), memo(), used(0), costs(), fused(), node_cost(0)",
+  "  {",
+  "    costs[identity] = 0;",
+  "    costs[negate] = kmul::costs.neg;",
+  "    costs[shift_add] = costs[factor_add] = kmul::costs.shift + kmul::costs.add;",
+  "    costs[shift_sub] = costs[factor_sub] = kmul::costs.shift + kmul::costs.sub;",
+  "    costs[shift_rev] = costs[factor_rev] = kmul::costs.shift + kmul::costs.sub;",
+  "    fused[shift_add] = fused[factor_add] = kmul::costs.fused_add_shift;",
+  "    fused[shift_sub] = fused[factor_sub] = kmul::costs.fused_sub_shift;",
+  "    fused[shift_rev] = fused[factor_rev] = kmul::costs.fused_rsb_shift;",
+  "    node_cost = kmul::costs.shift;",
+  "    if (kmul::costs.fused_add_shift > 0 && kmul::costs.add < node_cost)",
+  "    {",
+  "      node_cost = kmul::costs.add;",
+  "    }",
+  "    if ((kmul::costs.fused_sub_shift > 0 || kmul::costs.fused_rsb_shift > 0) && kmul::costs.sub < node_cost)",
+  "    {",
+  "      node_cost = kmul::costs.sub;",
+  "    }",
+  "    for (int i = 0; i < memo_slots; i++)",
+  "    {",
+  "      memo[i] = -1;",
+  "    }",
+  "    int node1 = lookup(1);",
+  "    arena[node1].parent = node1;",
+  "    arena[node1].opcode = identity;",
+  "    arena[node1].cost = 0;",
+  "    int node = lookup(-1);",
+  "    arena[node].parent = node1;",
+  "    arena[node].opcode = negate;",
+  "    arena[node].cost = kmul::costs.neg;",
+  "  }",
+  "",
+  "  // The cheapest chain for \"target\", as multiply_chain() in libkmul.c",
+  "  constexpr chain multiply(std::int64_t target)",
+  "  {",
+  "    chain c = {};",
+  "    int limit = estimate_cost(target);",
+  "    unsigned int shift = 0;",
+  "    int result = -1;",
+  "",
+  "    c.cost = limit;",
+  "    c.native = true;",
+  "    if (target == 0)",
+  "    {",
+  "      return c;",
+  "    }",
+  "    if (target % 2 != 0)",
+  "    {",
+  "      result = find_sequence(target, limit);",
+  "    }",
+  "    else",
+  "    {",
+  "      limit -= kmul::costs.shift;",
+  "      result = find_sequence(make_odd(target, shift), limit);",
+  "    }",
+  "    if (result >= 0 && arena[result].parent >= 0 && arena[result].cost < limit)",
+  "    {",
+  "      int n = 0;",
+  "",
+  "      c.cost = arena[result].cost + ((shift > 0) ? kmul::costs.shift : 0);",
+  "      c.native = false;",
+  "      c.shift = shift;",
+  "      // Steps are found from the target down to 1.",
+  "      for (int i = result; arena[i].opcode != identity; i = arena[i].parent)",
+  "      {",
+  "        n++;",
+  "      }",
+  "      c.num_steps = n;",
+  "      for (int i = result; arena[i].opcode != identity; i = arena[i].parent)",
+  "      {",
+  "        std::int64_t value = arena[i].value;",
+  "        std::int64_t source = arena[arena[i].parent].value;",
+  "        step &s = c.steps[--n];",
+  "",
+  "        s.opcode = arena[i].opcode;",
+  "        switch (s.opcode)",
+  "        {",
+  "          case shift_add:  s.shift = shift_amount(static_cast<std::uint64_t>(value) - 1, source); break;",
+  "          case shift_sub:  s.shift = shift_amount(static_cast<std::uint64_t>(value) + 1, source); break;",
+  "          case shift_rev:  s.shift = shift_amount(1 - static_cast<std::uint64_t>(value), source); break;",
+  "          case factor_add: s.shift = shift_amount(static_cast<std::uint64_t>(value) - static_cast<std::uint64_t>(source), source); break;",
+  "          case factor_sub: s.shift = shift_amount(static_cast<std::uint64_t>(value) + static_cast<std::uint64_t>(source), source); break;",
+  "          case factor_rev: s.shift = shift_amount(static_cast<std::uint64_t>(source) - static_cast<std::uint64_t>(value), source); break;",
+  "          default:         s.shift = 0; break;",
+  "        }",
+  "        // A negation is a subtraction from 0.",
+  "        c.additions++;",
+  "      }",
+  "    }",
+  "    return c;",
+  "  }",
+  "",
+  "private:",
+  "  node arena[max_nodes];",
+  "  int memo[memo_slots];",
+  "  int used;",
+  "  int costs[8];",
+  "  int fused[8];",
+  "  int node_cost;",
+  "",
+  "  static constexpr int estimate_cost(std::int64_t c)",
+  "  {",
+  "    if (kmul::costs.imm_bits >= 64)",
+  "    {",
+  "      return kmul::costs.mult;",
+  "    }",
+  "    std::int64_t limit = (kmul::costs.imm_bits > 0) ? (std::int64_t(1) << (kmul::costs.imm_bits - 1)) : 0;",
+  "    if (c >= -limit && c < limit)",
+  "    {",
+  "      return kmul::costs.mult;",
+  "    }",
+  "    return kmul::costs.mult + kmul::costs.ldc;",
+  "  }",
+  "",
+  "  // The shift s for which target = source << s (modulo 2^64)",
+  "  static constexpr unsigned int shift_amount(std::uint64_t target, std::int64_t source)",
+  "  {",
+  "    unsigned int s = 0;",
+  "",
+  "    while ((static_cast<std::uint64_t>(source) << s) != target && s < 63)",
+  "    {",
+  "      s++;",
+  "    }",
+  "    return s;",
+  "  }",
+  "",
+  "  // The node of \"c\", or -1 if there are no more nodes",
+  "  constexpr int lookup(std::int64_t c)",
+  "  {",
+  "    unsigned int i = hash(c) & (memo_slots - 1);",
+  "",
+  "    while (memo[i] >= 0)",
+  "    {",
+  "      if (arena[memo[i]].value == c)",
+  "      {",
+  "        return memo[i];",
+  "      }",
+  "      i = (i + 1) & (memo_slots - 1);",
+  "    }",
+  "    if (used == max_nodes)",
+  "    {",
+  "      return -1;",
+  "    }",
+  "    arena[used].value = c;",
+  "    arena[used].parent = -1;",
+  "    arena[used].opcode = identity;",
+  "    arena[used].cost = node_cost;",
+  "    memo[i] = used;",
+  "    return used++;",
+  "  }",
+  "",
+  "  constexpr int find_sequence(std::int64_t c, int limit)",
+  "  {",
+  "    int node = lookup(c);",
+  "",
+  "    if (node >= 0 && arena[node].parent < 0 && arena[node].cost < limit)",
+  "    {",
+  "      unsigned int shift = 0;",
+  "",
+  "      arena[node].cost = limit;",
+  "      // A fused (x << 1) + x is a factor of 3 in a single step.",
+  "      if (fused[factor_add] > 0 && c % 3 == 0 && c != 3 && c != -3)",
+  "      {",
+  "        try_factor(c / 3, node, factor_add, 1);",
+  "      }",
+  "      if (c > 0)",
+  "      {",
+  "        std::int64_t power = 4;",
+  "        std::int64_t edge = c >> 1;",
+  "",
+  "        for (shift = 2; power < edge; shift++)",
+  "        {",
+  "          if (c % (power - 1) == 0)",
+  "          {",
+  "            try_factor(c / (power - 1), node, factor_sub, shift);",
+  "          }",
+  "          if (c % (power + 1) == 0)",
+  "          {",
+  "            try_factor(c / (power + 1), node, factor_add, shift);",
+  "          }",
+  "          power = power << 1;",
+  "        }",
+  "        std::int64_t f = make_odd(c - 1, shift);",
+  "        try_factor(f, node, shift_add, shift);",
+  "        f = make_odd(static_cast<std::uint64_t>(c) + 1, shift);",
+  "        try_factor(f, node, shift_sub, shift);",
+  "      }",
+  "      else",
+  "      {",
+  "        std::int64_t power = 4;",
+  "        std::int64_t edge = static_cast<std::int64_t>(0 - static_cast<std::uint64_t>(c)) >> 1;",
+  "",
+  "        for (shift = 2; power < edge; shift++)",
+  "        {",
+  "          if (c % (1 - power) == 0)",
+  "          {",
+  "            try_factor(c / (1 - power), node, factor_rev, shift);",
+  "          }",
+  "          if (c % (power + 1) == 0)",
+  "          {",
+  "            try_factor(c / (power + 1), node, factor_add, shift);",
+  "          }",
+  "          power = power << 1;",
+  "        }",
+  "        std::int64_t f = make_odd(1 - static_cast<std::uint64_t>(c), shift);",
+  "        try_factor(f, node, shift_rev, shift);",
+  "        f = make_odd(c + 1, shift);",
+  "        try_factor(f, node, shift_sub, shift);",
+  "      }",
+  "    }",
+  "    return node;",
+  "  }",
+  "",
+  "  constexpr void try_factor(std::int64_t factor, int node, int opcode, unsigned int shift)",
+  "  {",
+  "    int cost = costs[opcode];",
+  "",
+  "    if (static_cast<int>(shift) <= fused[opcode])",
+  "    {",
+  "      cost -= kmul::costs.shift;",
+  "    }",
+  "    int limit = arena[node].cost - cost;",
+  "    int factor_node = find_sequence(factor, limit);",
+  "",
+  "    if (factor_node >= 0 && arena[factor_node].parent >= 0 && arena[factor_node].cost < limit)",
+  "    {",
+  "      arena[node].parent = factor_node;",
+  "      arena[node].opcode = opcode;",
+  "      arena[node].cost = arena[factor_node].cost + cost;",
+  "    }",
+  "  }",
+  "};",
+  "",
+  "constexpr chain find_chain(std::int64_t m)",
+  "{",
+  "  search s;",
+  "  return s.multiply(m);",
+  "}",
+  "",
+  "// The multiplier C modulo 2^N for the N-bit type T, sign-extended to 64 bits",
+  "// (\"negative\") or not.",
+  "template <typename T, typename C>",
+  "constexpr std::int64_t reduce(C c, bool negative)",
+  "{",
+  "  constexpr int n = std::numeric_limits<T>::digits + std::numeric_limits<T>::is_signed;",
+  "  std::uint64_t v = static_cast<std::uint64_t>(c);",
+  "",
+  "  if (n < 64)",
+  "  {",
+  "    std::uint64_t mask = (std::uint64_t(1) << (n % 64)) - 1;",
+  "    v &= mask;",
+  "    if (negative && (v >> (n - 1)) != 0)",
+  "    {",
+  "      v |= ~mask;",
+  "    }",
+  "  }",
+  "  // Two's complement without the implementation-defined conversion.",
+  "  return (v > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) ?",
+  "    -static_cast<std::int64_t>(~v) - 1 : static_cast<std::int64_t>(v);",
+  "}",
+  "",
+  "// The chain for C on T: of either reading of C modulo 2^N, whichever is",
+  "// cheaper, preferring the one of the signedness of T.",
+  "template <typename T, auto C>",
+  "struct plan",
+  "{",
+  "  static constexpr std::int64_t first = reduce<T>(C, std::numeric_limits<T>::is_signed);",
+  "  static constexpr std::int64_t second = reduce<T>(C, !std::numeric_limits<T>::is_signed);",
+  "  static constexpr chain first_chain = find_chain(first);",
+  "  static constexpr bool use_second = (second != first) && find_chain(second).cost < first_chain.cost;",
+  "  static constexpr std::int64_t multiplier = use_second ? second : first;",
+  "  static constexpr chain value = use_second ? find_chain(second) : first_chain;",
+  "};",
+  "",
+  "// x << s in the unsigned arithmetic of W, 0 for shifts out of the word",
+  "template <typename W>",
+  "constexpr W shl(W x, unsigned int s)",
+  "{",
+  "  return (s < static_cast<unsigned int>(std::numeric_limits<W>::digits)) ? static_cast<W>(x << s) : W(0);",
+  "}",
+  "",
+  "template <typename W, int Opcode, unsigned int Shift>",
+  "constexpr W apply(W x, W p)",
+  "{",
+  "  if constexpr (Opcode == negate)",
+  "  {",
+  "    return static_cast<W>(W(0) - p);",
+  "  }",
+  "  else if constexpr (Opcode == shift_add)",
+  "  {",
+  "    return static_cast<W>(shl(p, Shift) + x);",
+  "  }",
+  "  else if constexpr (Opcode == shift_sub)",
+  "  {",
+  "    return static_cast<W>(shl(p, Shift) - x);",
+  "  }",
+  "  else if constexpr (Opcode == shift_rev)",
+  "  {",
+  "    return static_cast<W>(x - shl(p, Shift));",
+  "  }",
+  "  else if constexpr (Opcode == factor_add)",
+  "  {",
+  "    return static_cast<W>(shl(p, Shift) + p);",
+  "  }",
+  "  else if constexpr (Opcode == factor_sub)",
+  "  {",
+  "    return static_cast<W>(shl(p, Shift) - p);",
+  "  }",
+  "  else if constexpr (Opcode == factor_rev)",
+  "  {",
+  "    return static_cast<W>(p - shl(p, Shift));",
+  "  }",
+  "  else",
+  "  {",
+  "    return p;",
+  "  }",
+  "}",
+  "",
+  "// The steps of the chain unrolled into straight-line code by a fold",
+  "// expression",
+  "template <typename W, const chain &Chain, std::size_t... I>",
+  "constexpr W expand(W x, std::index_sequence<I...>)",
+  "{",
+  "  W p = x;",
+  "",
+  "  ((p = apply<W, Chain.steps[I].opcode, Chain.steps[I].shift>(x, p)), ...);",
+  "  return shl(p, Chain.shift);",
+  "}",
+  "",
+  "} // namespace detail",
+  "",
+  "// The sequence of kmul::mul<C> on T",
+  "template <auto C, typename T>",
+  "struct sequence",
+  "{",
+  "  static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,",
+  "    \"kmul: the multiplicand must be an integer\");",
+  "  static_assert(std::numeric_limits<T>::digits + std::numeric_limits<T>::is_signed <= 64,",
+  "    \"kmul: the multiplicand must have at most 64 bits\");",
+  "",
+  "  // The multiplier modulo 2^N, as the 64-bit value searched for",
+  "  static constexpr std::int64_t multiplier = detail::plan<T, C>::multiplier;",
+  "  // Whether no sequence is cheaper than the native multiplication",
+  "  static constexpr bool native = detail::plan<T, C>::value.native;",
+  "  // Cost under kmul::costs, and the number of additions/subtractions",
+  "  static constexpr int cost = detail::plan<T, C>::value.cost;",
+  "  static constexpr int additions = detail::plan<T, C>::value.additions;",
+  "};",
+  "",
+  "// x * C, modulo 2^N for the N-bit integer type T",
+  "template <auto C, typename T>",
+  "constexpr T mul(T x) noexcept",
+  "{",
+  "  using U = typename std::make_unsigned<T>::type;",
+  "  // Unsigned arithmetic of at least the width of unsigned int, so that",
+  "  // neither the promotion of narrower types nor signed overflow is undefined",
+  "  using W = typename std::common_type<U, unsigned int>::type;",
+  "  using P = detail::plan<T, C>;",
+  "",
+  "  if constexpr (sequence<C, T>::native)",
+  "  {",
+  "    return static_cast<T>(static_cast<W>(static_cast<W>(x) * static_cast<W>(P::multiplier)));",
+  "  }",
+  "  else",
+  "  {",
+  "    return static_cast<T>(detail::expand<W, P::value>(static_cast<W>(x),",
+  "      std::make_index_sequence<static_cast<std::size_t>(P::value.num_steps)>()));",
+  "  }",
+  "}",
+  "",
+  "} // namespace kmul",
+  "",
+  "#endif // KMUL_HPP",
+  NULL
+};
+
+
+/* Print the lines of "text" to "f". */
+static void print_lines(FILE *f, const char **text)
+{
+  int i;
+
+  for (i = 0; text[i] != NULL; i++)
+  {
+    fprintf(f, "%s\n", text[i]);
+  }
+}
+
+/* Emit the C++17 header of kmul::mul<C>(x) to "f", for the costs "cm" of
+ * the "target" processor.
+ */
+void emit_cxx_header(FILE *f, const KmulCostModel *cm, const char *target)
+{
+  fprintf(f, "// kmul.hpp: multiplications by constants expanded at compile time.\n");
+  fprintf(f, "//\n");
+  fprintf(f, "// Generated by kmul (http://www.nkavvadias.com) for the costs of the\n");
+  fprintf(f, "// \"%s\" target. kmul::mul<C>(x) returns x * C for an integer x of up to\n", target);
+  fprintf(f, "// 64 bits, computed by the Bernstein-Briggs shift-and-add sequence for C,\n");
+  fprintf(f, "// which is found at compile time. Requires C++17.\n");
+  print_lines(f, cxx_prologue);
+  fprintf(f, "inline constexpr cost_model costs = { %d, %d, %d, %d, %d, %d, %d, %d, %d, %d };\n",
+    cm->add_cost, cm->sub_cost, cm->neg_cost, cm->shift_cost, cm->mult_cost,
+    cm->fused_add_shift, cm->fused_sub_shift, cm->fused_rsb_shift, cm->imm_bits, cm->ldc_cost);
+  print_lines(f, cxx_body);
+}
@@ -0,0 +1,540 @@
+/*
+ * File       : libkmul_div.c
+ * Description: Division and remainder by invariant integer constants for
+ *              libkmul: the magic multipliers of Granlund and Montgomery,
+ *              with the magic multiplication expanded into shifts and
+ *              additions.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+/* Operations of a division routine: those of KmulOpcode (in the same order)
+ * and the right shift, arithmetic on signed operands.
+ */
+typedef enum
+{
+  DIV_MOV, DIV_LDC, DIV_SHL, DIV_ADD, DIV_SUB, DIV_NEG, DIV_MUL,
+  DIV_SHR
+} DivOpcode;
+
+
+/* Return the number of bits of the data type of the routines of "cgen" for
+ * data width W: exactly W in NAC, else the width of the C type.
+ */
+static unsigned int div_width(CodegenMode cgen, unsigned int W)
+{
+  return (cgen == NAC) ? W : set_data_width(cgen, W);
+}
+
+/* Return the number of bits of the wide type holding the magic products: the
+ * 32 bits guaranteed for long in ANSI C, else 64.
+ */
+static unsigned int div_wide_width(CodegenMode cgen)
+{
+  return (cgen == ANSIC) ? 32 : 64;
+}
+
+/* Return floor(2^p / d) for p <= 64 and d > 1 not a power of two. */
+static uint64_t pow2_div(unsigned int p, uint64_t d)
+{
+  // 2^64 is not divisible by d, so floor(2^64 / d) = floor((2^64-1) / d).
+  return (p == 64) ? UINT64_MAX / d : (UINT64_C(1) << p) / d;
+}
+
+/* Return the smallest "s" in [0, l] for which m = floor(2^(base+s) / d) + 1
+ * satisfies m*d - 2^(base+s) <= 2^s, and m into "*m". For l = ceil(log2(d))
+ * the condition always holds.
+ */
+static unsigned int magic_search(uint64_t d, unsigned int base, unsigned int l, uint64_t *m)
+{
+  unsigned int s;
+
+  for (s = 0; s < l; s++)
+  {
+    unsigned int p = base + s;
+
+    *m = pow2_div(p, d) + 1;
+    // The error is less than d, so it is exact modulo 2^64.
+    if (*m * d - ((p == 64) ? 0 : (UINT64_C(1) << p)) <= (UINT64_C(1) << s))
+    {
+      return s;
+    }
+  }
+  *m = pow2_div(base + l, d) + 1;
+  return l;
+}
+
+/* Return the number of trailing zero bits of the nonzero "d". */
+static unsigned int trailing_zeros(uint64_t d)
+{
+  unsigned int k = 0;
+
+  while ((d & 1) == 0)
+  {
+    d >>= 1;
+    k++;
+  }
+  return k;
+}
+
+/* Return ceil(log2(d)) for d > 1. */
+static unsigned int ceil_log2(uint64_t d)
+{
+  unsigned int l = 0;
+
+  while (l < 64 && (UINT64_C(1) << l) < d)
+  {
+    l++;
+  }
+  return l;
+}
+
+/* Compute the magic numbers of the division of W-bit integers (W <= 32) by
+ * "d", signed if "s" is set, whose products are computed in "wide" bits
+ * (2*W <= wide <= 64). Returns 0, or -1 if "d" is zero or does not fit in W
+ * bits.
+ *
+ * Unsigned: for d = 2^k, q = x >> k (magic 0, shift k). Otherwise
+ * q = ((x >> pre_shift) * magic) >> shift with the smallest shift for which
+ * the magic is exact, provided that the product fits in "wide" bits. When
+ * the magic takes W+1 bits instead, an even d is first divided by its power
+ * of two (pre_shift), and an odd one uses the W-bit magic - 2^W ("add"):
+ * q = (((x * magic) >> W) + x) >> shift.
+ *
+ * Signed: for |d| = 2^k, q = (x + bias) >> k with a bias of 2^k - 1 for a
+ * negative x (magic 0, shift k). Otherwise q = ((x * magic) >> shift) + 1
+ * for a negative x, magic < 2^W. The quotient is then negated for d < 0.
+ */
+int kmul_div_magic(int64_t d, int s, unsigned int W, unsigned int wide, KmulDivMagic *mg)
+{
+  uint64_t ad = s ? ((d >= 0) ? (uint64_t)d : (uint64_t)0 - (uint64_t)d) : (uint64_t)d;
+  uint64_t m;
+  unsigned int l, k;
+
+  memset(mg, 0, sizeof(KmulDivMagic));
+  if (W == 0 || W > 32 || 2 * W > wide || wide > 64 || d == 0)
+  {
+    return -1;
+  }
+  if ((s && (d < -(INT64_C(1) << (W - 1)) || d >= (INT64_C(1) << (W - 1)))) ||
+      (!s && ad >= (UINT64_C(1) << W)))
+  {
+    return -1;
+  }
+  // Powers of two
+  if ((ad & (ad - 1)) == 0)
+  {
+    mg->shift = (int)trailing_zeros(ad);
+    return 0;
+  }
+  l = ceil_log2(ad);
+  if (s)
+  {
+    mg->shift = (int)(W - 1 + magic_search(ad, W - 1, l, &m));
+    mg->magic = m;
+    return 0;
+  }
+  k = magic_search(ad, W, l, &m);
+  // The product of a W-bit x must fit in the wide type.
+  if (m < (UINT64_C(1) << (wide - W)))
+  {
+    mg->magic = m;
+    mg->shift = (int)(W + k);
+  }
+  else if ((ad & 1) == 0)
+  {
+    // A dividend of W - z bits by the odd part of d, with a magic of at most
+    // W - z + 1 bits.
+    unsigned int z = trailing_zeros(ad);
+
+    ad >>= z;
+    mg->pre_shift = (int)z;
+    mg->shift = (int)(W - z + magic_search(ad, W - z, ceil_log2(ad), &m));
+    mg->magic = m;
+  }
+  else
+  {
+    mg->magic = m - (UINT64_C(1) << W);
+    mg->shift = (int)k;
+    mg->add = 1;
+  }
+  return 0;
+}
+
+/* Print the name of the routine of operation "op" by "c" into "name", named
+ * like kmul_routine_name() but "kdiv_..." for a division and "kmod_..." for
+ * a remainder.
+ */
+void kdiv_routine_name(char *name, KmulRoutineOp op, ConstMulAlg alg, int64_t c, int s, unsigned int W)
+{
+  kmul_routine_name(name, alg, c, s, W);
+  if (op != KMUL_ROUTINE_MUL)
+  {
+    memcpy(name, (op == KMUL_ROUTINE_MOD) ? "kmod" : "kdiv", 4);
+  }
+}
+
+/* Print a constant in the wide type of the language "cgen". */
+static void print_div_constant(FILE *f, CodegenMode cgen, uint64_t c)
+{
+  if (cgen == NAC || c <= INT32_MAX)
+  {
+    fprintf(f, "%" PRIu64, c);
+  }
+  else if (cgen == ANSIC)
+  {
+    fprintf(f, "%" PRIu64 "UL", c);
+  }
+  else
+  {
+    fprintf(f, "UINT64_C(%" PRIu64 ")", c);
+  }
+}
+
+/* Print the operation "dst = src1 <op> src2/imm" in NAC or ANSI C/C99.
+ * Returns 1 for an addition, subtraction or negation, else 0.
+ */
+static int print_div_op(FILE *f, CodegenMode cgen, const char *dst, DivOpcode opcode,
+  const char *src1, const char *src2, uint64_t imm)
+{
+  static const char *mnemonic[] = { "mov", "ldc", "shl", "add", "sub", "neg", "mul", "shr" };
+
+  if (cgen == NAC)
+  {
+    fprintf(f, "  %s <= %s ", dst, mnemonic[opcode]);
+    switch (opcode)
+    {
+      case DIV_LDC: fprintf(f, "%" PRIu64, imm); break;
+      case DIV_MOV:
+      case DIV_NEG: fprintf(f, "%s", src1); break;
+      case DIV_ADD:
+      case DIV_SUB: fprintf(f, "%s, %s", src1, src2); break;
+      default:      fprintf(f, "%s, %" PRIu64, src1, imm); break;
+    }
+  }
+  else
+  {
+    fprintf(f, "  %s = ", dst);
+    switch (opcode)
+    {
+      case DIV_LDC: print_div_constant(f, cgen, imm); break;
+      case DIV_MOV: fprintf(f, "%s", src1); break;
+      case DIV_NEG: fprintf(f, "-%s", src1); break;
+      case DIV_ADD: fprintf(f, "%s + %s", src1, src2); break;
+      case DIV_SUB: fprintf(f, "%s - %s", src1, src2); break;
+      case DIV_SHL: fprintf(f, "%s << %" PRIu64, src1, imm); break;
+      case DIV_SHR: fprintf(f, "%s >> %" PRIu64, src1, imm); break;
+      case DIV_MUL:
+        fprintf(f, "%s * ", src1);
+        print_div_constant(f, cgen, imm);
+        break;
+    }
+  }
+  fprintf(f, ";\n");
+  return (opcode == DIV_ADD || opcode == DIV_SUB || opcode == DIV_NEG);
+}
+
+/* Print the operations of a multiplication sequence on temporaries named
+ * "<prefix><n>", the multiplicand being "x". Returns the number of
+ * additions/subtractions.
+ */
+static int print_div_sequence(FILE *f, CodegenMode cgen, const KmulOp *ops, int num_ops,
+  char prefix, const char *x)
+{
+  char dst[16], src1[16], src2[16];
+  int i, adders = 0;
+
+  for (i = 0; i < num_ops; i++)
+  {
+    sprintf(dst, "%c%d", prefix, ops[i].dst);
+    if (ops[i].src1 == KMUL_X)
+    {
+      strcpy(src1, x);
+    }
+    else
+    {
+      sprintf(src1, "%c%d", prefix, ops[i].src1);
+    }
+    if (ops[i].src2 == KMUL_X)
+    {
+      strcpy(src2, x);
+    }
+    else
+    {
+      sprintf(src2, "%c%d", prefix, ops[i].src2);
+    }
+    adders += print_div_op(f, cgen, dst, (DivOpcode)ops[i].opcode, src1, src2, (uint64_t)ops[i].imm);
+  }
+  return adders;
+}
+
+/* Print the declarations of the temporaries "<prefix><n>" of a sequence of
+ * type "type".
+ */
+static void print_div_temps(FILE *f, CodegenMode cgen, const char *type, const KmulOp *ops,
+  int num_ops, char prefix)
+{
+  int i, num_temps = 0;
+
+  for (i = 0; i < num_ops; i++)
+  {
+    if (ops[i].dst >= num_temps)
+    {
+      num_temps = ops[i].dst + 1;
+    }
+  }
+  for (i = 0; i < num_temps; i++)
+  {
+    fprintf(f, (cgen == NAC) ? "  localvar %s %c%d;\n" : "  %s %c%d;\n", type, prefix, i);
+  }
+}
+
+/* Print the declaration of variable "name" of type "type". */
+static void print_div_var(FILE *f, CodegenMode cgen, const char *type, const char *name)
+{
+  fprintf(f, (cgen == NAC) ? "  localvar %s %s;\n" : "  %s %s;\n", type, name);
+}
+
+/* Copy the operation sequence of "m" from the context, or a single
+ * multiplication if that is not cheaper than the multiplier unit (with the
+ * constant loaded unless it fits in an immediate). Returns the operations
+ * (to be freed by the caller) and their number and result temporary in
+ * "*num_ops" and "*result".
+ */
+static KmulOp *div_sequence(KmulContext *ctx, ConstMulAlg alg, int64_t m, int *num_ops, int *result)
+{
+  const KmulCostModel *cm = &ctx->cost_model;
+  const KmulSequence *seq = kmul_sequence(ctx, alg, m);
+  int mul_cost = cm->mult_cost;
+  KmulOp *ops;
+
+  if (cm->imm_bits < 64 && (cm->imm_bits == 0 || m >= (INT64_C(1) << (cm->imm_bits - 1)) ||
+      m < -(INT64_C(1) << (cm->imm_bits - 1))))
+  {
+    mul_cost += cm->ldc_cost;
+  }
+  ops = malloc(((seq->num_ops > 1) ? seq->num_ops : 1) * sizeof(KmulOp));
+  if (ops == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %d operations.\n", seq->num_ops);
+    exit(EXIT_FAILURE);
+  }
+  if (m != 0 && seq->cost >= mul_cost)
+  {
+    ops[0].opcode = KMUL_MUL;
+    ops[0].dst = 0;
+    ops[0].src1 = KMUL_X;
+    ops[0].src2 = 0;
+    ops[0].imm = m;
+    *num_ops = 1;
+    *result = 0;
+  }
+  else
+  {
+    memcpy(ops, seq->ops, seq->num_ops * sizeof(KmulOp));
+    *num_ops = seq->num_ops;
+    *result = seq->result;
+  }
+  return ops;
+}
+
+/* Emit the routine of the division (KMUL_ROUTINE_DIV) or remainder
+ * (KMUL_ROUTINE_MOD) of unsigned/signed W-bit integers by "d" in NAC, ANSI C or C99, with magic
+ * numbers for the width of the data type (see kmul_div_magic()). The magic
+ * multiplication is computed in the wide type by the operation sequence of
+ * the given algorithm, or by the multiplier unit if that is cheaper; the
+ * remainder x - q * d multiplies the quotient q by "d" likewise. Quotients
+ * are truncated towards zero and remainders take the sign of the dividend,
+ * as in C99. The magic and the additions/subtractions of the routine are
+ * reported to the info stream of the context, if any.
+ */
+void emit_kdiv(KmulContext *ctx, KmulRoutineOp op, ConstMulAlg alg, int64_t d, int s, unsigned int W)
+{
+  int mod = (op == KMUL_ROUTINE_MOD);
+  FILE *f = ctx->fout;
+  CodegenMode cgen = ctx->cgen;
+  unsigned int width = div_width(cgen, W);
+  unsigned int wide = div_wide_width(cgen);
+  char c = (s ? 's' : 'u');
+  char name[KMUL_NAME_SIZE], dt[24], wt[24], st[24], pr[16], tr[16];
+  KmulOp *mops = NULL, *qops = NULL;
+  int mnum = 0, mres = 0, qnum = 0, qres = 0, adders = 0;
+  KmulDivMagic mg;
+
+  if (kmul_div_magic(d, s, width, wide, &mg) != 0)
+  {
+    fprintf(stderr, "Error: Cannot divide %u-bit integers by %" PRId64 ".\n", width, d);
+    exit(EXIT_FAILURE);
+  }
+  // Types of the data, and of the unsigned and signed wide values
+  if (cgen == NAC)
+  {
+    sprintf(dt, "%c%u", c, W);
+    sprintf(wt, "u%u", wide);
+    sprintf(st, "s%u", wide);
+  }
+  else
+  {
+    char *type = get_c_type(cgen, s, W);
+
+    strcpy(dt, type);
+    free(type);
+    strcpy(wt, (cgen == ANSIC) ? "unsigned long" : "uint64_t");
+    strcpy(st, (cgen == ANSIC) ? "long" : "int64_t");
+  }
+  if (mg.magic != 0)
+  {
+    mops = div_sequence(ctx, alg, (int64_t)mg.magic, &mnum, &mres);
+    sprintf(pr, "p%d", mres);
+  }
+  if (mod)
+  {
+    qops = div_sequence(ctx, alg, d, &qnum, &qres);
+    sprintf(tr, "t%d", qres);
+  }
+
+  kdiv_routine_name(name, op, alg, d, s, W);
+  if (cgen == NAC)
+  {
+    fprintf(f, "procedure %s (in %s x, out %s y)\n", name, dt, dt);
+  }
+  else
+  {
+    fprintf(f, "%s %s (%s x)\n", dt, name, dt);
+  }
+  fprintf(f, "{\n");
+  // The unsigned wide x, unless the quotient of a signed x is x or -x
+  if (!s || mg.magic != 0 || mg.shift > 0)
+  {
+    print_div_var(f, cgen, wt, "xw");
+  }
+  print_div_temps(f, cgen, wt, mops, mnum, 'p');
+  print_div_var(f, cgen, s ? st : wt, "h");
+  if (s && (mg.magic != 0 || mg.shift > 0))
+  {
+    print_div_var(f, cgen, st, "g");
+  }
+  if (mod)
+  {
+    print_div_var(f, cgen, dt, "q");
+    print_div_temps(f, cgen, dt, qops, qnum, 't');
+  }
+  if (cgen == NAC)
+  {
+    fprintf(f, "S_1:\n");
+  }
+  else
+  {
+    print_div_var(f, cgen, dt, "y");
+  }
+
+  if (!s)
+  {
+    print_div_op(f, cgen, "xw", DIV_MOV, "x", NULL, 0);
+    if (mg.pre_shift > 0)
+    {
+      print_div_op(f, cgen, "xw", DIV_SHR, "xw", NULL, mg.pre_shift);
+    }
+    if (mg.magic == 0)
+    {
+      print_div_op(f, cgen, "h", DIV_SHR, "xw", NULL, mg.shift);
+    }
+    else
+    {
+      adders += print_div_sequence(f, cgen, mops, mnum, 'p', "xw");
+      if (mg.add)
+      {
+        // q = (((x * (m - 2^W)) >> W) + x) >> shift, without overflow in
+        // the wide type
+        print_div_op(f, cgen, "h", DIV_SHR, pr, NULL, width);
+        adders += print_div_op(f, cgen, "h", DIV_ADD, "h", "xw", 0);
+        if (mg.shift > 0)
+        {
+          print_div_op(f, cgen, "h", DIV_SHR, "h", NULL, mg.shift);
+        }
+      }
+      else
+      {
+        print_div_op(f, cgen, "h", DIV_SHR, pr, NULL, mg.shift);
+      }
+    }
+  }
+  else
+  {
+    // Sign-extend x to the wide type.
+    print_div_op(f, cgen, "h", DIV_MOV, "x", NULL, 0);
+    if (mg.magic == 0 && mg.shift > 0)
+    {
+      // Add 2^k - 1 = g - (g << k) to a negative x (g = -1), so that the
+      // shift truncates towards zero. Unlike a logical shift of g, this does
+      // not depend on the actual width of long in ANSI C.
+      print_div_op(f, cgen, "g", DIV_SHR, "h", NULL, wide - 1);
+      print_div_op(f, cgen, "xw", DIV_MOV, "g", NULL, 0);
+      print_div_op(f, cgen, "xw", DIV_SHL, "xw", NULL, mg.shift);
+      adders += print_div_op(f, cgen, "xw", DIV_SUB, "g", "xw", 0);
+      print_div_op(f, cgen, "g", DIV_MOV, "xw", NULL, 0);
+      adders += print_div_op(f, cgen, "h", DIV_ADD, "h", "g", 0);
+      print_div_op(f, cgen, "h", DIV_SHR, "h", NULL, mg.shift);
+    }
+    else if (mg.magic != 0)
+    {
+      // Round the quotient of a negative x up, by subtracting its sign.
+      print_div_op(f, cgen, "xw", DIV_MOV, "h", NULL, 0);
+      adders += print_div_sequence(f, cgen, mops, mnum, 'p', "xw");
+      print_div_op(f, cgen, "g", DIV_SHR, "h", NULL, wide - 1);
+      print_div_op(f, cgen, "h", DIV_MOV, pr, NULL, 0);
+      print_div_op(f, cgen, "h", DIV_SHR, "h", NULL, mg.shift);
+      adders += print_div_op(f, cgen, "h", DIV_SUB, "h", "g", 0);
+    }
+    if (d < 0)
+    {
+      adders += print_div_op(f, cgen, "h", DIV_NEG, "h", NULL, 0);
+    }
+  }
+  if (mod)
+  {
+    print_div_op(f, cgen, "q", DIV_MOV, "h", NULL, 0);
+    adders += print_div_sequence(f, cgen, qops, qnum, 't', "q");
+    adders += print_div_op(f, cgen, "y", DIV_SUB, "x", tr, 0);
+  }
+  else
+  {
+    print_div_op(f, cgen, "y", DIV_MOV, "h", NULL, 0);
+  }
+  if (cgen != NAC)
+  {
+    fprintf(f, "  return (y);\n");
+  }
+  fprintf(f, "}\n");
+
+  if (ctx->finfo != NULL)
+  {
+    fprintf(ctx->finfo, "Info: %s: magic %" PRIu64 ", shift %d%s, %d additions/subtractions.\n", name,
+      mg.magic, mg.shift, mg.add ? " (with add)" : (mg.pre_shift > 0) ? " (with pre-shift)" : "", adders);
+  }
+  free(mops);
+  free(qops);
+}
@@ -0,0 +1,330 @@
+/*
+ * File       : libkmul_ir.c
+ * Description: Passes over the operation sequences, turning them into SSA
+ *              form without redundant operations, and assignment of their
+ *              temporaries to as few variables as possible.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "kmul.h"
+
+// Index of a removed operation
+#define REMOVED (-2)
+
+
+/* Allocate "n" (at least one) elements of "size" bytes, or exit. */
+static void *ir_alloc(size_t n, size_t size)
+{
+  void *p = calloc((n > 0) ? n : 1, size);
+
+  if (p == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for %u operations.\n", (unsigned int)n);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/* Whether operation "op" reads its first/second operand. */
+static int reads_src1(const KmulOp *op)
+{
+  return (op->opcode != KMUL_LDC);
+}
+
+static int reads_src2(const KmulOp *op)
+{
+  return (op->opcode == KMUL_ADD || op->opcode == KMUL_SUB);
+}
+
+/* Whether operations "a" and "b" (on values) compute the same value. */
+static int same_op(const KmulOp *a, const KmulOp *b)
+{
+  if (a->opcode != b->opcode)
+  {
+    return 0;
+  }
+  switch (a->opcode)
+  {
+    case KMUL_LDC:
+      return (a->imm == b->imm);
+    case KMUL_MOV:
+    case KMUL_NEG:
+      return (a->src1 == b->src1);
+    case KMUL_SHL:
+    case KMUL_MUL:
+      return (a->src1 == b->src1 && a->imm == b->imm);
+    case KMUL_ADD:
+      return ((a->src1 == b->src1 && a->src2 == b->src2) ||
+              (a->src1 == b->src2 && a->src2 == b->src1));
+    case KMUL_SUB:
+      return (a->src1 == b->src1 && a->src2 == b->src2);
+  }
+  return 0;
+}
+
+/* Rewrite the operation sequence "seq" so that operation i defines
+ * temporary i and nothing else (SSA form), updating the "num_outputs"
+ * temporaries of "outputs" that hold its products (e.g. &seq->result). The
+ * operations are cleaned up on the way:
+ *   - copies (mov, and shl by 0) are propagated into their uses;
+ *   - shl of shl becomes a single shl, if the sum of the shifts is below 64;
+ *   - an operation computing the same value as an earlier one is replaced by
+ *     it (common subexpression elimination);
+ *   - operations whose value does not reach an output are removed.
+ * A single mov of the multiplicand is kept if it is an output itself. The
+ * cost of the sequence is kept, while its additions/subtractions and depth
+ * are left to be measured again.
+ */
+void kmul_optimize_sequence(KmulSequence *seq, int *outputs, int num_outputs)
+{
+  int n = seq->num_ops;
+  int num_temps = 1;
+  int *version, *value, *live, *index;
+  KmulOp *ops;
+  int i, j, kept, copy_x = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    if (seq->ops[i].dst >= num_temps)
+    {
+      num_temps = seq->ops[i].dst + 1;
+    }
+  }
+  for (i = 0; i < num_outputs; i++)
+  {
+    if (outputs[i] >= num_temps)
+    {
+      num_temps = outputs[i] + 1;
+    }
+  }
+  // version[t]: the operation last assigning temporary t; value[i]: the
+  // operation (or KMUL_X) first computing the value of operation i.
+  version = ir_alloc(num_temps, sizeof(int));
+  value = ir_alloc(n, sizeof(int));
+  live = ir_alloc(n, sizeof(int));
+  index = ir_alloc(n, sizeof(int));
+
+  for (i = 0; i < n; i++)
+  {
+    KmulOp *op = &seq->ops[i];
+    int dst = op->dst;
+
+    // Operands refer to the values of operations from now on.
+    if (reads_src1(op) && op->src1 != KMUL_X)
+    {
+      op->src1 = value[version[op->src1]];
+    }
+    if (reads_src2(op) && op->src2 != KMUL_X)
+    {
+      op->src2 = value[version[op->src2]];
+    }
+    value[i] = i;
+    if (op->opcode == KMUL_MOV || (op->opcode == KMUL_SHL && op->imm == 0))
+    {
+      value[i] = op->src1;
+    }
+    else
+    {
+      if (op->opcode == KMUL_SHL && op->src1 != KMUL_X && seq->ops[op->src1].opcode == KMUL_SHL &&
+          seq->ops[op->src1].imm + op->imm < 64)
+      {
+        op->imm += seq->ops[op->src1].imm;
+        op->src1 = seq->ops[op->src1].src1;
+      }
+      for (j = 0; j < i; j++)
+      {
+        if (value[j] == j && same_op(&seq->ops[j], op))
+        {
+          value[i] = j;
+          break;
+        }
+      }
+    }
+    version[dst] = i;
+  }
+  for (i = 0; i < num_outputs; i++)
+  {
+    outputs[i] = value[version[outputs[i]]];
+    if (outputs[i] == KMUL_X)
+    {
+      copy_x = 1;
+    }
+    else
+    {
+      live[outputs[i]] = 1;
+    }
+  }
+
+  // Dead operations: those whose value reaches no output.
+  for (i = n - 1; i >= 0; i--)
+  {
+    const KmulOp *op = &seq->ops[i];
+
+    if (value[i] != i)
+    {
+      live[i] = 0;
+    }
+    else if (live[i])
+    {
+      if (reads_src1(op) && op->src1 != KMUL_X)
+      {
+        live[op->src1] = 1;
+      }
+      if (reads_src2(op) && op->src2 != KMUL_X)
+      {
+        live[op->src2] = 1;
+      }
+    }
+  }
+
+  // Number the remaining operations in order, after the copy of x.
+  kept = copy_x;
+  for (i = 0; i < n; i++)
+  {
+    index[i] = live[i] ? kept++ : REMOVED;
+  }
+  ops = ir_alloc(kept, sizeof(KmulOp));
+  if (copy_x)
+  {
+    ops[0].opcode = KMUL_MOV;
+    ops[0].dst = 0;
+    ops[0].src1 = KMUL_X;
+  }
+  for (i = 0; i < n; i++)
+  {
+    KmulOp *op;
+
+    if (!live[i])
+    {
+      continue;
+    }
+    op = &ops[index[i]];
+    *op = seq->ops[i];
+    op->dst = index[i];
+    if (reads_src1(op) && op->src1 != KMUL_X)
+    {
+      op->src1 = index[op->src1];
+    }
+    if (reads_src2(op) && op->src2 != KMUL_X)
+    {
+      op->src2 = index[op->src2];
+    }
+  }
+  if (kept > seq->max_ops)
+  {
+    KmulOp *grown = realloc(seq->ops, kept * sizeof(KmulOp));
+
+    if (grown == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for %d operations.\n", kept);
+      exit(EXIT_FAILURE);
+    }
+    seq->ops = grown;
+    seq->max_ops = kept;
+  }
+  memcpy(seq->ops, ops, kept * sizeof(KmulOp));
+  for (i = 0; i < num_outputs; i++)
+  {
+    outputs[i] = (outputs[i] == KMUL_X) ? 0 : index[outputs[i]];
+  }
+  seq->num_ops = kept;
+
+  free(ops);
+  free(version);
+  free(value);
+  free(live);
+  free(index);
+}
+
+/* Assign the temporaries of the sequence "seq", in the SSA form of
+ * kmul_optimize_sequence(), to as few variables as possible: a variable is
+ * reused as soon as the last operation reading its value has read it, which
+ * may be the operation assigning it again. The variable of temporary i is
+ * stored to "var[i]"; those of the "num_outputs" temporaries of "outputs" are
+ * never reused. Returns the number of variables.
+ */
+int kmul_assign_temps(const KmulSequence *seq, const int *outputs, int num_outputs, int *var)
+{
+  int n = seq->num_ops;
+  int *last_use = ir_alloc(n, sizeof(int));
+  int *free_vars = ir_alloc(n, sizeof(int));
+  int num_free = 0, num_vars = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+
+    last_use[i] = -1;
+    if (reads_src1(op) && op->src1 != KMUL_X)
+    {
+      last_use[op->src1] = i;
+    }
+    if (reads_src2(op) && op->src2 != KMUL_X)
+    {
+      last_use[op->src2] = i;
+    }
+  }
+  for (i = 0; i < num_outputs; i++)
+  {
+    last_use[outputs[i]] = n;
+  }
+  for (i = 0; i < n; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+
+    // The operands read for the last time free their variables first.
+    if (reads_src1(op) && op->src1 != KMUL_X && last_use[op->src1] == i)
+    {
+      free_vars[num_free++] = var[op->src1];
+    }
+    if (reads_src2(op) && op->src2 != KMUL_X && op->src2 != op->src1 && last_use[op->src2] == i)
+    {
+      free_vars[num_free++] = var[op->src2];
+    }
+    var[i] = (num_free > 0) ? free_vars[--num_free] : num_vars++;
+  }
+
+  free(last_use);
+  free(free_vars);
+  return num_vars;
+}
+
+/* Return operation "op" of a sequence in SSA form, with its temporaries
+ * replaced by their variables "var" from kmul_assign_temps().
+ */
+KmulOp kmul_rename_op(const KmulOp *op, const int *var)
+{
+  KmulOp renamed = *op;
+
+  renamed.dst = var[op->dst];
+  if (reads_src1(op) && op->src1 != KMUL_X)
+  {
+    renamed.src1 = var[op->src1];
+  }
+  if (reads_src2(op) && op->src2 != KMUL_X)
+  {
+    renamed.src2 = var[op->src2];
+  }
+  return renamed;
+}
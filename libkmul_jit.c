@@ -0,0 +1,289 @@
+/*
+ * File       : libkmul_jit.c
+ * Description: Compilation of the multiplications by constants known only at
+ *              run time to x86-64 machine code in executable memory, cached
+ *              per constant.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "kmul.h"
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// Initial number of cache slots (a power of two)
+#define JIT_INITIAL_SLOTS 64
+// Size of the encoding buffer on the stack, enough for most functions
+#define JIT_BUFFER_SIZE   1024
+// Size of the chunks of code (rounded up to whole pages), and the alignment
+// of the functions in them
+#define JIT_CHUNK_SIZE    65536
+#define JIT_ALIGN         16
+
+
+/* Hash a multiplier to a cache slot index (before masking), with the
+ * MurmurHash3 finalizer like the memo table.
+ */
+static unsigned int jit_hash(int64_t m)
+{
+  uint64_t h = (uint64_t)m;
+
+  h ^= h >> 33;
+  h *= UINT64_C(0xFF51AFD7ED558CCD);
+  h ^= h >> 33;
+  h *= UINT64_C(0xC4CEB9FE1A85EC53);
+  h ^= h >> 33;
+  return (unsigned int)h;
+}
+
+/* Allocate an empty cache of "size" slots (a power of two). */
+static int alloc_cache(KmulJit *jit, unsigned int size)
+{
+  jit->entries = calloc(size, sizeof(KmulJitEntry));
+  if (jit->entries == NULL)
+  {
+    return -1;
+  }
+  jit->mask = size - 1;
+  jit->used = 0;
+  return 0;
+}
+
+/* Double the size of the cache and reinsert all of its entries. */
+static int grow_cache(KmulJit *jit)
+{
+  KmulJitEntry *old = jit->entries;
+  unsigned int old_size = jit->mask + 1;
+  unsigned int used = jit->used;
+  unsigned int i, j;
+
+  if (alloc_cache(jit, 2 * old_size) != 0)
+  {
+    jit->entries = old;
+    return -1;
+  }
+  for (i = 0; i < old_size; i++)
+  {
+    if (old[i].fn != NULL)
+    {
+      j = jit_hash(old[i].m) & jit->mask;
+      while (jit->entries[j].fn != NULL)
+      {
+        j = (j + 1) & jit->mask;
+      }
+      jit->entries[j] = old[i];
+    }
+  }
+  jit->used = used;
+  free(old);
+  return 0;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+/* Allocate "len" bytes of code after the functions of the last chunk of
+ * "jit", or else at the start of a new chunk, large enough for them. The
+ * chunks are executable and not writable (W^X): see write_code(). Returns
+ * the code, or NULL if the pages cannot be mapped or protected.
+ */
+static uint8_t *alloc_code(KmulJit *jit, size_t len)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  KmulJitChunk *c;
+  size_t offset, size;
+  void *p;
+
+  if (jit->num_chunks > 0)
+  {
+    c = &jit->chunks[jit->num_chunks - 1];
+    offset = (c->used + JIT_ALIGN - 1) & ~(size_t)(JIT_ALIGN - 1);
+    if (offset + len <= c->size)
+    {
+      c->used = offset + len;
+      return c->base + offset;
+    }
+  }
+
+  if (jit->num_chunks == jit->max_chunks)
+  {
+    unsigned int max = (jit->max_chunks > 0) ? 2 * jit->max_chunks : 8;
+    KmulJitChunk *chunks = realloc(jit->chunks, max * sizeof(KmulJitChunk));
+
+    if (chunks == NULL)
+    {
+      return NULL;
+    }
+    jit->chunks = chunks;
+    jit->max_chunks = max;
+  }
+  size = (len > JIT_CHUNK_SIZE) ? len : JIT_CHUNK_SIZE;
+  size = (size + page - 1) & ~(page - 1);
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+  {
+    return NULL;
+  }
+  // The padding between the functions traps (int3).
+  memset(p, 0xCC, size);
+  if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0)
+  {
+    munmap(p, size);
+    return NULL;
+  }
+  c = &jit->chunks[jit->num_chunks++];
+  c->base = p;
+  c->size = size;
+  c->used = len;
+  return c->base;
+}
+
+/* Copy the "len" bytes of "code" to "p" in a chunk, making only the pages
+ * they span writable (and no longer executable) for the copy. Returns 0, or
+ * -1 if the pages cannot be protected.
+ */
+static int write_code(uint8_t *p, const uint8_t *code, size_t len)
+{
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)p & ~(page - 1);
+  uintptr_t end = ((uintptr_t)p + len + page - 1) & ~(page - 1);
+
+  if (mprotect((void *)start, end - start, PROT_READ | PROT_WRITE) != 0)
+  {
+    return -1;
+  }
+  memcpy(p, code, len);
+  return mprotect((void *)start, end - start, PROT_READ | PROT_EXEC);
+}
+#endif
+
+/* Initialize a JIT compiler finding the sequences with "alg" in context
+ * "ctx", which must outlive it.
+ */
+int kmul_jit_init(KmulJit *jit, KmulContext *ctx, ConstMulAlg alg)
+{
+  jit->ctx = ctx;
+  jit->alg = alg;
+  jit->code_bytes = 0;
+  jit->chunks = NULL;
+  jit->num_chunks = 0;
+  jit->max_chunks = 0;
+  return alloc_cache(jit, JIT_INITIAL_SLOTS);
+}
+
+/* Return the function multiplying its argument by "m" modulo 2^64 (so that
+ * its low W bits are the product for any data width W), compiling it on the
+ * first request for "m". The code is that of the 64-bit x86-64 routine of
+ * "-x86-64", appended to the last chunk of executable pages. Returns NULL on
+ * hosts other than x86-64, or if the pages cannot be allocated. Not
+ * thread-safe: use a JIT compiler (and context) per thread, or a lock held
+ * both to compile and to call its functions, as the pages receiving a new
+ * function are briefly not executable.
+ */
+KmulJitFn kmul_jit(KmulJit *jit, int64_t m)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+  unsigned int i = jit_hash(m) & jit->mask;
+  uint8_t buffer[JIT_BUFFER_SIZE], *code = buffer;
+  size_t len;
+  uint8_t *p;
+
+  while (jit->entries[i].fn != NULL)
+  {
+    if (jit->entries[i].m == m)
+    {
+      return jit->entries[i].fn;
+    }
+    i = (i + 1) & jit->mask;
+  }
+
+  len = kmul_encode_x86_64(jit->ctx, jit->alg, m, 0, 64, buffer, sizeof(buffer));
+  if (len > sizeof(buffer))
+  {
+    code = malloc(len);
+    if (code == NULL)
+    {
+      return NULL;
+    }
+    kmul_encode_x86_64(jit->ctx, jit->alg, m, 0, 64, code, len);
+  }
+  p = alloc_code(jit, len);
+  if (p != NULL && write_code(p, code, len) != 0)
+  {
+    p = NULL;
+  }
+  if (code != buffer)
+  {
+    free(code);
+  }
+  if (p == NULL)
+  {
+    return NULL;
+  }
+
+  // Keep the cache at most half full.
+  if (2 * (jit->used + 1) > jit->mask + 1)
+  {
+    if (grow_cache(jit) != 0)
+    {
+      return NULL;
+    }
+    i = jit_hash(m) & jit->mask;
+    while (jit->entries[i].fn != NULL)
+    {
+      i = (i + 1) & jit->mask;
+    }
+  }
+  jit->entries[i].m = m;
+  // Object to function pointer conversion, as for dlsym().
+  *(void **)&jit->entries[i].fn = p;
+  jit->used++;
+  jit->code_bytes += len;
+  return jit->entries[i].fn;
+#else
+  (void)jit;
+  (void)m;
+  return NULL;
+#endif
+}
+
+/* Release the code of all the functions compiled by "jit". */
+void kmul_jit_free(KmulJit *jit)
+{
+  unsigned int i;
+
+  for (i = 0; i < jit->num_chunks; i++)
+  {
+    munmap(jit->chunks[i].base, jit->chunks[i].size);
+  }
+  free(jit->chunks);
+  free(jit->entries);
+  jit->chunks = NULL;
+  jit->num_chunks = 0;
+  jit->max_chunks = 0;
+  jit->entries = NULL;
+  jit->used = 0;
+}
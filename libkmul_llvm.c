@@ -0,0 +1,240 @@
+/*
+ * File       : libkmul_llvm.c
+ * Description: Emission of the routines as LLVM IR functions on integers of
+ *              the exact data width.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+/* Absolute value of an integer, as an unsigned 64-bit integer. */
+#define UABS(x)           ((x) >= 0 ? (uint64_t)(x) : (uint64_t)0 - (uint64_t)(x))
+
+/* An operand of an LLVM instruction: the multiplicand, a definition of a
+ * temporary (t<n> for the first one, then t<n>.<version>) or a constant.
+ * "safe" values are exact multiples "coef" * x that cannot wrap around as
+ * long as the product does not overflow.
+ */
+typedef struct
+{
+  int temp, version;
+  int is_const;
+  int64_t value;
+  int safe;
+  int64_t coef;
+} LlvmValue;
+
+
+/* Sign-extend the W-bit value "c". */
+static int64_t sign_extend(int64_t c, unsigned int W)
+{
+  uint64_t u = (W < 64) ? (uint64_t)c & ((UINT64_C(1) << W) - 1) : (uint64_t)c;
+
+  if (W < 64 && (u >> (W - 1)) != 0)
+  {
+    return (int64_t)(u - (UINT64_C(1) << W));
+  }
+  return (int64_t)u;
+}
+
+/* Whether x * c cannot overflow the W-bit signed range when x * m does not:
+ * |x * c| is then below |x * m| <= 2^(W-1), unless c is m itself.
+ */
+static int coef_fits(int64_t c, int64_t m)
+{
+  return c == m || UABS(c) < UABS(m);
+}
+
+/* Print an operand of an LLVM instruction. */
+static void print_llvm_operand(FILE *f, const LlvmValue *v)
+{
+  if (v->is_const)
+  {
+    fprintf(f, "%" PRId64, v->value);
+  }
+  else if (v->temp == KMUL_X)
+  {
+    fprintf(f, "%%x");
+  }
+  else if (v->version == 0)
+  {
+    fprintf(f, "%%t%d", v->temp);
+  }
+  else
+  {
+    fprintf(f, "%%t%d.%d", v->temp, v->version);
+  }
+}
+
+/* Emit the LLVM IR function "i<W> @<name>(i<W> %x)" for the multiplication by
+ * "m", computing modulo 2^W for any data width W up to 64. Copies and
+ * constants are forwarded to their uses, and shifts by W or more bits are
+ * folded to 0. In signed routines, operations whose value is a multiple of x
+ * by a factor not exceeding the multiplier carry the nsw flag, so that the
+ * routine has the semantics of "mul nsw" (its result is poison when the
+ * product overflows); unsigned routines wrap around like "mul", and no
+ * operation is nuw since the product may wrap around.
+ */
+void emit_kmul_llvm(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  char name[KMUL_NAME_SIZE];
+  const KmulSequence *seq;
+  LlvmValue *temps, a, b, *d;
+  int *versions;
+  int num_temps, i;
+
+  // Only checks the data width.
+  set_data_width(C99, W);
+  kmul_routine_name(name, alg, m, s, W);
+  fprintf(f, "define i%u @%s(i%u %%x) {\n", W, name, W);
+  if (m == 0)
+  {
+    fprintf(f, "  ret i%u 0\n", W);
+    fprintf(f, "}\n");
+    return;
+  }
+
+  seq = kmul_routine_sequence(ctx, alg, m, W);
+  num_temps = seq->result + 1;
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (seq->ops[i].dst >= num_temps)
+    {
+      num_temps = seq->ops[i].dst + 1;
+    }
+  }
+  // One more slot for the multiplicand
+  temps = malloc((num_temps + 1) * sizeof(LlvmValue));
+  versions = calloc(num_temps, sizeof(int));
+  if (temps == NULL || versions == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for the temporaries of %s.\n", name);
+    exit(EXIT_FAILURE);
+  }
+  m = sign_extend(m, W);
+  temps[num_temps].temp = KMUL_X;
+  temps[num_temps].version = 0;
+  temps[num_temps].is_const = 0;
+  temps[num_temps].safe = 1;
+  temps[num_temps].coef = 1;
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+    int64_t c = 0;
+    int known = 0;
+
+    // The operands are read before the destination, which may be one of
+    // them, is redefined.
+    a = temps[(op->src1 == KMUL_X) ? num_temps : op->src1];
+    b = temps[(op->src2 == KMUL_X) ? num_temps : op->src2];
+    d = &temps[op->dst];
+    d->temp = op->dst;
+    d->is_const = 0;
+    d->value = 0;
+    // The factor of x of the result, if its operands are safe and it does
+    // not overflow 64 bits
+    switch (op->opcode)
+    {
+      case KMUL_MOV:
+        *d = a;
+        continue;
+      case KMUL_LDC:
+        d->is_const = 1;
+        d->value = sign_extend(op->imm, W);
+        d->safe = 1;
+        d->coef = 0;
+        continue;
+      case KMUL_SHL:
+        if (op->imm >= W)
+        {
+          // Every bit is shifted out.
+          d->is_const = 1;
+          d->safe = 0;
+          continue;
+        }
+        if (a.safe && op->imm < 62 && UABS(a.coef) <= (UINT64_C(1) << (62 - op->imm)))
+        {
+          c = (int64_t)((uint64_t)a.coef << op->imm);
+          known = 1;
+        }
+        break;
+      case KMUL_NEG:
+        c = -a.coef;
+        known = a.safe && a.coef != INT64_MIN;
+        break;
+      case KMUL_ADD:
+      case KMUL_SUB:
+        c = (op->opcode == KMUL_ADD) ? a.coef + b.coef : a.coef - b.coef;
+        known = a.safe && b.safe && UABS(a.coef) < (UINT64_C(1) << 62) && UABS(b.coef) < (UINT64_C(1) << 62);
+        break;
+      case KMUL_MUL:
+        known = a.safe && op->imm != INT64_MIN && a.coef != INT64_MIN && op->imm != 0 &&
+          UABS(a.coef) <= (uint64_t)INT64_MAX / UABS(op->imm);
+        c = known ? a.coef * op->imm : 0;
+        break;
+    }
+    d->safe = s && known && coef_fits(c, m);
+    d->coef = c;
+    d->version = versions[op->dst]++;
+
+    fprintf(f, "  ");
+    print_llvm_operand(f, d);
+    fprintf(f, " = ");
+    switch (op->opcode)
+    {
+      case KMUL_SHL:
+        fprintf(f, "shl%s i%u ", d->safe ? " nsw" : "", W);
+        print_llvm_operand(f, &a);
+        fprintf(f, ", %" PRId64, op->imm);
+        break;
+      case KMUL_NEG:
+        fprintf(f, "sub%s i%u 0, ", d->safe ? " nsw" : "", W);
+        print_llvm_operand(f, &a);
+        break;
+      case KMUL_ADD:
+      case KMUL_SUB:
+        fprintf(f, "%s%s i%u ", (op->opcode == KMUL_ADD) ? "add" : "sub", d->safe ? " nsw" : "", W);
+        print_llvm_operand(f, &a);
+        fprintf(f, ", ");
+        print_llvm_operand(f, &b);
+        break;
+      case KMUL_MUL:
+        fprintf(f, "mul%s i%u ", d->safe ? " nsw" : "", W);
+        print_llvm_operand(f, &a);
+        fprintf(f, ", %" PRId64, sign_extend(op->imm, W));
+        break;
+      default:
+        break;
+    }
+    fprintf(f, "\n");
+  }
+  fprintf(f, "  ret i%u ", W);
+  print_llvm_operand(f, &temps[seq->result]);
+  fprintf(f, "\n");
+  fprintf(f, "}\n");
+  free(temps);
+  free(versions);
+}
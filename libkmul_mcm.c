@@ -0,0 +1,702 @@
+/*
+ * File       : libkmul_mcm.c
+ * Description: Multiple constant multiplication (MCM): a single adder graph
+ *              shared by the multiplications of one multiplicand by several
+ *              constants, built by a simplified version of the Hcub
+ *              heuristic (Voronenko and Pueschel, "Multiplierless multiple
+ *              constant multiplication", ACM TALG, 2007).
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "kmul.h"
+
+// Maximum number of fundamentals, as addressed by a KmulAdderOp
+#define MCM_MAX_FUND  65535
+
+/* A fundamental in the sorted index of the fundamentals. */
+typedef struct
+{
+  uint64_t value;
+  int index;
+} SortedFund;
+
+/* A value one A-operation away from the fundamentals (a successor), and
+ * the operation computing it. Empty slots have a zero value.
+ */
+typedef struct
+{
+  uint64_t value;
+  KmulAdderOp op;
+} Successor;
+
+/* State of the construction of the graph. */
+typedef struct
+{
+  KmulMcm *mcm;
+  const KmulCostModel *cm;
+  uint64_t bound;
+  unsigned int max_shift;
+  // Fundamentals (the ready set), in order of creation and sorted
+  uint64_t *fund;
+  SortedFund *sorted;
+  int num_fund;
+  // Odd successors of the fundamentals: open addressing with linear
+  // probing, grown to stay at most half full
+  Successor *succ;
+  unsigned int succ_mask, succ_used;
+  // Odd parts of the multipliers still to be computed
+  uint64_t *todo;
+  int num_todo;
+} McmState;
+
+
+static int popcount64(uint64_t x)
+{
+  int n = 0;
+
+  while (x != 0)
+  {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+/* Number of nonzero digits of the canonical signed digit (CSD) form of "x",
+ * the usual estimate of the additions needed to compute it from scratch.
+ */
+static int csd_weight(uint64_t x)
+{
+  return popcount64(((3 * x) ^ x) >> 1);
+}
+
+static uint64_t odd_part(uint64_t x)
+{
+  while (x != 0 && (x & 1) == 0)
+  {
+    x >>= 1;
+  }
+  return x;
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+  p = realloc(p, size);
+  if (p == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for the multiple constant multiplication.\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/* Return the index of fundamental "v" in creation order, or -1. */
+static int find_fund(const McmState *st, uint64_t v)
+{
+  int lo = 0, hi = st->num_fund - 1;
+
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+
+    if (st->sorted[mid].value == v)
+    {
+      return st->sorted[mid].index;
+    }
+    if (st->sorted[mid].value < v)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+  return -1;
+}
+
+/* Compute "v" = (fund[a] << shift) op fund[b] as an A-operation, if it does
+ * not exceed the bound of the graph; returns 0 otherwise.
+ */
+static uint64_t a_operation(const McmState *st, const KmulAdderOp *op)
+{
+  uint64_t a = st->fund[op->a], b = st->fund[op->b];
+  uint64_t shifted;
+
+  if (a > (2 * st->bound) >> op->shift)
+  {
+    return 0;
+  }
+  shifted = a << op->shift;
+  if (op->opcode == KMUL_ADD)
+  {
+    shifted += b;
+  }
+  else if (op->reverse)
+  {
+    shifted = (b > shifted) ? b - shifted : 0;
+  }
+  else
+  {
+    shifted = (shifted > b) ? shifted - b : 0;
+  }
+  return (shifted <= st->bound) ? shifted : 0;
+}
+
+static unsigned int succ_hash(uint64_t v)
+{
+  v ^= v >> 33;
+  v *= UINT64_C(0xFF51AFD7ED558CCD);
+  v ^= v >> 33;
+  return (unsigned int)v;
+}
+
+/* Return the successor slot of "v", or NULL if "v" is not a successor. */
+static const Successor *find_succ(const McmState *st, uint64_t v)
+{
+  unsigned int i = succ_hash(v) & st->succ_mask;
+
+  while (st->succ[i].value != 0)
+  {
+    if (st->succ[i].value == v)
+    {
+      return &st->succ[i];
+    }
+    i = (i + 1) & st->succ_mask;
+  }
+  return NULL;
+}
+
+static void insert_succ(McmState *st, uint64_t v, const KmulAdderOp *op)
+{
+  unsigned int i;
+
+  if (2 * (st->succ_used + 1) > st->succ_mask + 1)
+  {
+    Successor *old = st->succ;
+    unsigned int old_size = (old == NULL) ? 0 : st->succ_mask + 1;
+    unsigned int size = (old == NULL) ? 1024 : 2 * old_size;
+
+    st->succ = calloc(size, sizeof(Successor));
+    if (st->succ == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for the multiple constant multiplication.\n");
+      exit(EXIT_FAILURE);
+    }
+    st->succ_mask = size - 1;
+    st->succ_used = 0;
+    for (i = 0; i < old_size; i++)
+    {
+      if (old[i].value != 0)
+      {
+        insert_succ(st, old[i].value, &old[i].op);
+      }
+    }
+    free(old);
+  }
+  // The first operation found for a value is kept.
+  i = succ_hash(v) & st->succ_mask;
+  while (st->succ[i].value != 0)
+  {
+    if (st->succ[i].value == v)
+    {
+      return;
+    }
+    i = (i + 1) & st->succ_mask;
+  }
+  st->succ[i].value = v;
+  st->succ[i].op = *op;
+  st->succ_used++;
+}
+
+/* Add the odd successors of the new fundamental "f" combined with every
+ * fundamental (itself included) to the successor set.
+ */
+static void add_successors(McmState *st, int f)
+{
+  KmulAdderOp op;
+  unsigned int k;
+  int r, side, form;
+
+  for (r = 0; r <= f; r++)
+  {
+    for (side = 0; side < 2; side++)
+    {
+      // The shifted operand is "f" on one side and "r" on the other one.
+      op.a = (unsigned short)(side ? r : f);
+      op.b = (unsigned short)(side ? f : r);
+      for (k = 0; k <= st->max_shift; k++)
+      {
+        op.shift = (unsigned char)k;
+        for (form = 0; form < 3; form++)
+        {
+          uint64_t v;
+
+          op.opcode = (form == 0) ? KMUL_ADD : KMUL_SUB;
+          op.reverse = (form == 2);
+          v = a_operation(st, &op);
+          if (v != 0 && (v & 1) != 0)
+          {
+            insert_succ(st, v, &op);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* Add fundamental "v" computed by "op" to the graph. */
+static void add_fund(McmState *st, uint64_t v, const KmulAdderOp *op)
+{
+  KmulMcm *mcm = st->mcm;
+  int i;
+
+  if (st->num_fund > MCM_MAX_FUND)
+  {
+    fprintf(stderr, "Error: More than %d fundamentals in a multiple constant multiplication.\n", MCM_MAX_FUND);
+    exit(EXIT_FAILURE);
+  }
+  if (mcm->num_ops == mcm->max_ops)
+  {
+    mcm->max_ops = (mcm->max_ops == 0) ? 32 : 2 * mcm->max_ops;
+    mcm->ops = xrealloc(mcm->ops, mcm->max_ops * sizeof(KmulAdderOp));
+    st->fund = xrealloc(st->fund, (mcm->max_ops + 1) * sizeof(uint64_t));
+    st->sorted = xrealloc(st->sorted, (mcm->max_ops + 1) * sizeof(SortedFund));
+  }
+  mcm->ops[mcm->num_ops++] = *op;
+  st->fund[st->num_fund] = v;
+  for (i = st->num_fund; i > 0 && st->sorted[i-1].value > v; i--)
+  {
+    st->sorted[i] = st->sorted[i-1];
+  }
+  st->sorted[i].value = v;
+  st->sorted[i].index = st->num_fund;
+  st->num_fund++;
+  add_successors(st, st->num_fund - 1);
+  // Drop the multiplier if it is complete now.
+  for (i = 0; i < st->num_todo; i++)
+  {
+    if (st->todo[i] == v)
+    {
+      st->todo[i] = st->todo[--st->num_todo];
+      break;
+    }
+  }
+}
+
+/* Estimate the number of A-operations computing "t" with the help of the
+ * fundamental "f": 1 if the remainder t -/+ (f << k) is a fundamental (or
+ * "f") shifted, or else the CSD weight of its odd part, which has to be
+ * built.
+ */
+static int estimate_with(const McmState *st, uint64_t f, uint64_t t)
+{
+  int best = csd_weight(t);
+  unsigned int k;
+
+  for (k = 0; k <= st->max_shift && f <= (2 * st->bound) >> k; k++)
+  {
+    uint64_t fs = f << k;
+    uint64_t r[2];
+    int i;
+
+    r[0] = (t > fs) ? t - fs : fs - t;
+    r[1] = t + fs;
+    for (i = 0; i < 2; i++)
+    {
+      uint64_t o;
+      int w;
+
+      if (r[i] == 0)
+      {
+        continue;
+      }
+      // "f" may not be a fundamental yet.
+      o = odd_part(r[i]);
+      w = (o == f || find_fund(st, o) >= 0) ? 1 : csd_weight(o);
+      if (w < best)
+      {
+        best = w;
+      }
+    }
+  }
+  return best;
+}
+
+/* Estimated distance of "t" from the fundamentals. */
+static int estimate(const McmState *st, uint64_t t)
+{
+  int best = csd_weight(t);
+  int i;
+
+  for (i = 0; i < st->num_fund && best > 1; i++)
+  {
+    int d = estimate_with(st, st->fund[i], t);
+
+    if (d < best)
+    {
+      best = d;
+    }
+  }
+  return best;
+}
+
+/* Add the first fundamental missing from the computation of "t" from its
+ * CSD digits, from the most significant one down, as a chain of
+ * A-operations with the multiplicand. This is the fallback when no
+ * multiplier is within two A-operations.
+ */
+static void add_csd_step(McmState *st, uint64_t t)
+{
+  int digit[KMUL_MCM_MAX_BITS+3];
+  uint64_t x = t, v = 1;
+  int top, i, last;
+  KmulAdderOp op;
+
+  for (i = 0; x != 0; i++, x >>= 1)
+  {
+    digit[i] = 0;
+    if (x & 1)
+    {
+      digit[i] = 2 - (int)(x & 3);
+      x -= (uint64_t)(int64_t)digit[i];
+    }
+  }
+  top = i - 1;
+  last = top;
+  for (i = top - 1; i >= 0; i--)
+  {
+    if (digit[i] == 0)
+    {
+      continue;
+    }
+    // v = (v << (last - i)) +/- 1
+    op.opcode = (digit[i] > 0) ? KMUL_ADD : KMUL_SUB;
+    op.reverse = 0;
+    op.shift = (unsigned char)(last - i);
+    op.a = (unsigned short)find_fund(st, v);
+    op.b = 0;
+    v = (digit[i] > 0) ? (v << op.shift) + 1 : (v << op.shift) - 1;
+    last = i;
+    if (find_fund(st, v) < 0)
+    {
+      add_fund(st, v, &op);
+      return;
+    }
+  }
+}
+
+/* Return the odd part of the remainder t -/+ (f << k) over the fundamentals
+ * "f" with the fewest CSD digits, the smaller one on ties.
+ */
+static uint64_t best_remainder(const McmState *st, uint64_t t)
+{
+  uint64_t best = t;
+  int best_weight = csd_weight(t);
+  unsigned int k;
+  int f, i;
+
+  for (f = 0; f < st->num_fund; f++)
+  {
+    for (k = 0; k <= st->max_shift && st->fund[f] <= (2 * st->bound) >> k; k++)
+    {
+      uint64_t fs = st->fund[f] << k;
+      uint64_t r[2];
+
+      r[0] = (t > fs) ? t - fs : fs - t;
+      r[1] = t + fs;
+      for (i = 0; i < 2; i++)
+      {
+        uint64_t o;
+        int w;
+
+        if (r[i] == 0)
+        {
+          continue;
+        }
+        o = odd_part(r[i]);
+        w = csd_weight(o);
+        if (w < best_weight || (w == best_weight && o < best))
+        {
+          best = o;
+          best_weight = w;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+static int compare_value(const void *x, const void *y)
+{
+  uint64_t a = *(const uint64_t *)x;
+  uint64_t b = *(const uint64_t *)y;
+
+  return (a > b) - (a < b);
+}
+
+/* Add the successor that brings the remaining multipliers closest, weighting
+ * close multipliers higher as in Hcub: the benefit of a successor "s" is the
+ * sum of 10^-d'(t) * (d(t) - d'(t)) over the multipliers "t", with the
+ * estimated distances d before and d' after adding "s". Only successors that
+ * bring some multiplier within a single A-operation (i.e., the odd parts of
+ * its remainders t -/+ (f << k)) are considered; if there are none, the
+ * closest multiplier is approached through the CSD digits of its remainder.
+ */
+static void add_best_successor(McmState *st, const int *dist)
+{
+  uint64_t *cand = NULL;
+  int num_cand = 0, max_cand = 0;
+  uint64_t best_value = 0;
+  double best_benefit = 0.0;
+  unsigned int k;
+  int i, j, f;
+
+  for (i = 0; i < st->num_todo; i++)
+  {
+    uint64_t t = st->todo[i];
+
+    for (f = 0; f < st->num_fund; f++)
+    {
+      for (k = 0; k <= st->max_shift && st->fund[f] <= (2 * st->bound) >> k; k++)
+      {
+        uint64_t fs = st->fund[f] << k;
+        uint64_t r[2];
+        int side;
+
+        r[0] = (t > fs) ? t - fs : fs - t;
+        r[1] = t + fs;
+        for (side = 0; side < 2; side++)
+        {
+          uint64_t u = odd_part(r[side]);
+
+          if (u > 1 && find_succ(st, u) != NULL && find_fund(st, u) < 0)
+          {
+            if (num_cand == max_cand)
+            {
+              max_cand = (max_cand == 0) ? 64 : 2 * max_cand;
+              cand = xrealloc(cand, max_cand * sizeof(uint64_t));
+            }
+            cand[num_cand++] = u;
+          }
+        }
+      }
+    }
+  }
+  qsort(cand, num_cand, sizeof(uint64_t), compare_value);
+
+  // Candidates are visited in increasing order, so ties go to the smaller
+  // fundamental.
+  for (j = 0; j < num_cand; j++)
+  {
+    double benefit = 0.0;
+
+    if (j > 0 && cand[j] == cand[j-1])
+    {
+      continue;
+    }
+    for (i = 0; i < st->num_todo; i++)
+    {
+      int d = estimate_with(st, cand[j], st->todo[i]);
+      double w = 1.0;
+      int n;
+
+      if (d < dist[i])
+      {
+        for (n = 0; n < d; n++)
+        {
+          w /= 10.0;
+        }
+        benefit += w * (dist[i] - d);
+      }
+    }
+    if (benefit > best_benefit)
+    {
+      best_benefit = benefit;
+      best_value = cand[j];
+    }
+  }
+  free(cand);
+
+  if (best_benefit > 0.0)
+  {
+    add_fund(st, best_value, &find_succ(st, best_value)->op);
+  }
+  else
+  {
+    // Approach the closest multiplier.
+    for (i = 1, j = 0; i < st->num_todo; i++)
+    {
+      if (dist[i] < dist[j])
+      {
+        j = i;
+      }
+    }
+    add_csd_step(st, best_remainder(st, st->todo[j]));
+  }
+}
+
+/* Build the shared adder graph for the multiplications by the "n"
+ * multipliers "m". Returns 0 on success, or -1 if a multiplier is too wide.
+ */
+int mcm_graph(KmulContext *ctx, const int64_t *m, int n, KmulMcm *mcm)
+{
+  McmState st;
+  KmulAdderOp op;
+  int *dist;
+  int bits = 1;
+  int i, progress;
+
+  memset(mcm, 0, sizeof(KmulMcm));
+  memset(&st, 0, sizeof(st));
+  st.mcm = mcm;
+  st.cm = &ctx->cost_model;
+  mcm->num_targets = n;
+  mcm->targets = xrealloc(NULL, n * sizeof(int64_t));
+  mcm->fundamental = xrealloc(NULL, n * sizeof(int));
+  mcm->shift = xrealloc(NULL, n * sizeof(int));
+  mcm->outputs = xrealloc(NULL, n * sizeof(int));
+  st.todo = xrealloc(NULL, n * sizeof(uint64_t));
+  dist = xrealloc(NULL, n * sizeof(int));
+  memcpy(mcm->targets, m, n * sizeof(int64_t));
+
+  // The odd parts of the multipliers are the targets of the graph.
+  for (i = 0; i < n; i++)
+  {
+    uint64_t c = (m[i] >= 0) ? (uint64_t)m[i] : (uint64_t)0 - (uint64_t)m[i];
+    int b = 0;
+    int j;
+
+    c = odd_part(c);
+    while ((c >> b) != 0)
+    {
+      b++;
+    }
+    if (b > KMUL_MCM_MAX_BITS)
+    {
+      kmul_mcm_free(mcm);
+      free(st.todo);
+      free(dist);
+      return -1;
+    }
+    bits = (b > bits) ? b : bits;
+    for (j = 0; j < st.num_todo && st.todo[j] != c; j++)
+      ;
+    if (c > 1 && j == st.num_todo)
+    {
+      st.todo[st.num_todo++] = c;
+    }
+  }
+  st.bound = UINT64_C(1) << (bits + 1);
+  st.max_shift = bits + 1;
+  st.fund = xrealloc(NULL, sizeof(uint64_t));
+  st.sorted = xrealloc(NULL, sizeof(SortedFund));
+  st.fund[0] = 1;
+  st.sorted[0].value = 1;
+  st.sorted[0].index = 0;
+  st.num_fund = 1;
+  add_successors(&st, 0);
+
+  while (st.num_todo > 0)
+  {
+    // Complete the multipliers that are a single A-operation away.
+    do
+    {
+      progress = 0;
+      for (i = 0; i < st.num_todo; i++)
+      {
+        const Successor *e = find_succ(&st, st.todo[i]);
+
+        if (e != NULL)
+        {
+          op = e->op;
+          add_fund(&st, st.todo[i], &op);
+          progress = 1;
+          break;
+        }
+      }
+    } while (progress && st.num_todo > 0);
+    if (st.num_todo == 0)
+    {
+      break;
+    }
+    for (i = 0; i < st.num_todo; i++)
+    {
+      dist[i] = estimate(&st, st.todo[i]);
+    }
+    add_best_successor(&st, dist);
+  }
+
+  // Locate the product of every multiplier and sum up the cost.
+  mcm->cost = 0;
+  for (i = 0; i < mcm->num_ops; i++)
+  {
+    mcm->cost += kmul_adder_cost(st.cm, (KmulOpcode)mcm->ops[i].opcode, mcm->ops[i].reverse, mcm->ops[i].shift);
+  }
+  for (i = 0; i < n; i++)
+  {
+    uint64_t c = (m[i] >= 0) ? (uint64_t)m[i] : (uint64_t)0 - (uint64_t)m[i];
+    int j;
+
+    mcm->shift[i] = 0;
+    mcm->fundamental[i] = -1;
+    if (c == 0)
+    {
+      continue;
+    }
+    while ((c & 1) == 0)
+    {
+      c >>= 1;
+      mcm->shift[i]++;
+    }
+    mcm->fundamental[i] = find_fund(&st, c);
+    // Repeated multipliers share their product.
+    for (j = 0; j < i && m[j] != m[i]; j++)
+      ;
+    if (j == i)
+    {
+      mcm->cost += (m[i] < 0) ? st.cm->neg_cost : 0;
+      mcm->cost += (mcm->shift[i] > 0) ? st.cm->shift_cost : 0;
+    }
+  }
+
+  free(st.fund);
+  free(st.sorted);
+  free(st.succ);
+  free(st.todo);
+  free(dist);
+  return 0;
+}
+
+/* Release the memory held by a multiple constant multiplication.
+ */
+void kmul_mcm_free(KmulMcm *mcm)
+{
+  free(mcm->targets);
+  free(mcm->fundamental);
+  free(mcm->shift);
+  free(mcm->outputs);
+  free(mcm->ops);
+  memset(mcm, 0, sizeof(KmulMcm));
+}
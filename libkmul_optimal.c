@@ -0,0 +1,525 @@
+/*
+ * File       : libkmul_optimal.c
+ * Description: Exhaustive search for single-constant multiplication adder
+ *              graphs with the minimum number of additions/subtractions, by
+ *              iterative deepening over A-operations. The search is bounded
+ *              by the cost of the Bernstein-Briggs sequence and by a time
+ *              budget, and falls back to that sequence when it runs out.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "kmul.h"
+
+// Widest odd part of a multiplier handled by the search; fundamentals are
+// kept below 2^(bits+1), which must fit in 63 bits.
+#define OPTIMAL_MAX_BITS  61
+// Number of search nodes between checks of the time budget
+#define CLOCK_INTERVAL    1024
+// Size of the set of values completing the target with a single A-operation
+#define NEED_SIZE         (KMUL_MAX_GRAPH * (OPTIMAL_MAX_BITS+2) * 7)
+
+/* A value "v" from which the target is computed with a single A-operation
+ * together with the fundamental "a": (a << shift) + v, (a << shift) - v or
+ * v - (a << shift), or with the roles of "a" and "v" swapped if "shift_new"
+ * is set. Fundamental index KMUL_MAX_GRAPH+1 stands for "v" itself.
+ */
+typedef struct
+{
+  uint64_t value;
+  KmulAdderOp op;
+  unsigned char shift_new;
+} NeedEntry;
+
+/* State of the search for a single target. */
+typedef struct
+{
+  const KmulCostModel *cm;
+  uint64_t target, bound;
+  unsigned int max_shift;
+  int negate, shift, limit;
+  // Fundamentals found so far; fund[0] is 1 (the multiplicand)
+  uint64_t fund[KMUL_MAX_GRAPH+1];
+  KmulAdderOp ops[KMUL_MAX_GRAPH];
+  int num_ops, depth;
+  // Time budget
+  struct timespec deadline;
+  int timed;
+  unsigned long nodes;
+  int expired, found;
+  KmulGraph *graph;
+  // Values completing the target, sorted for binary search (last, so that
+  // the fields above can be cleared without it)
+  int num_need;
+  NeedEntry need[NEED_SIZE];
+} OptimalSearch;
+
+
+static int bit_length(uint64_t c)
+{
+  int n = 0;
+
+  while (c != 0)
+  {
+    c >>= 1;
+    n++;
+  }
+  return n;
+}
+
+/* Check the time budget every CLOCK_INTERVAL search nodes.
+ */
+static int out_of_time(OptimalSearch *s)
+{
+  struct timespec now;
+
+  if (s->expired)
+  {
+    return 1;
+  }
+  if (!s->timed || ++s->nodes % CLOCK_INTERVAL != 0)
+  {
+    return 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > s->deadline.tv_sec ||
+      (now.tv_sec == s->deadline.tv_sec && now.tv_nsec >= s->deadline.tv_nsec))
+  {
+    s->expired = 1;
+  }
+  return s->expired;
+}
+
+/* Return the value of an A-operation on the values "a" and "b", or 0 if it
+ * is not positive or exceeds the bound of the search.
+ */
+static uint64_t a_operation(const OptimalSearch *s, const KmulAdderOp *op, uint64_t a, uint64_t b)
+{
+  uint64_t shifted;
+
+  // Keep (a << shift) + b within 2^63 + 2^62.
+  if (a > (2 * s->bound) >> op->shift)
+  {
+    return 0;
+  }
+  shifted = a << op->shift;
+  if (op->opcode == KMUL_ADD)
+  {
+    shifted += b;
+  }
+  else if (op->reverse)
+  {
+    shifted = (b > shifted) ? b - shifted : 0;
+  }
+  else
+  {
+    shifted = (shifted > b) ? shifted - b : 0;
+  }
+  return (shifted <= s->bound) ? shifted : 0;
+}
+
+/* Return whether "v" is a fundamental already, or one of them shifted left.
+ */
+static int is_redundant(const OptimalSearch *s, uint64_t v)
+{
+  int i;
+
+  for (i = 0; i <= s->num_ops; i++)
+  {
+    uint64_t f = s->fund[i];
+
+    if (v >= f && v % f == 0 && ((v / f) & (v / f - 1)) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Cost of the graph of the first "num_ops" operations of the search. */
+static int graph_cost(const OptimalSearch *s, const KmulAdderOp *ops, int num_ops, int negate)
+{
+  int cost = 0;
+  int i;
+
+  for (i = 0; i < num_ops; i++)
+  {
+    cost += kmul_adder_cost(s->cm, (KmulOpcode)ops[i].opcode, ops[i].reverse, ops[i].shift);
+  }
+  if (negate)
+  {
+    cost += s->cm->neg_cost;
+  }
+  if (s->shift > 0)
+  {
+    cost += s->cm->shift_cost;
+  }
+  return cost;
+}
+
+/* Accept the graph ending with the operation "last" if it is cheaper than the
+ * limit. A negative target is computed by swapping the operands of a final
+ * subtraction, or else by a negation.
+ */
+static int accept(OptimalSearch *s, KmulAdderOp last)
+{
+  int negate = 0;
+  int cost;
+
+  if (s->negate)
+  {
+    if (last.opcode == KMUL_SUB)
+    {
+      last.reverse = !last.reverse;
+    }
+    else
+    {
+      negate = 1;
+    }
+  }
+  s->ops[s->num_ops] = last;
+  cost = graph_cost(s, s->ops, s->num_ops + 1, negate);
+  if (cost >= s->limit)
+  {
+    return 0;
+  }
+  s->graph->cost = cost;
+  s->graph->num_ops = s->num_ops + 1;
+  s->graph->negate = negate;
+  s->graph->shift = s->shift;
+  memcpy(s->graph->ops, s->ops, s->graph->num_ops * sizeof(KmulAdderOp));
+  s->found = 1;
+  return 1;
+}
+
+/* Try to complete the graph with a single A-operation on two fundamentals;
+ * for negative targets, subtractions are tried first.
+ */
+static int complete_one(OptimalSearch *s)
+{
+  static const unsigned char order[2][3][2] =
+  {
+    {{KMUL_ADD, 0}, {KMUL_SUB, 0}, {KMUL_SUB, 1}},
+    {{KMUL_SUB, 0}, {KMUL_SUB, 1}, {KMUL_ADD, 0}}
+  };
+  KmulAdderOp op;
+  int a, b, form;
+
+  for (form = 0; form < 3; form++)
+  {
+    op.opcode = order[s->negate][form][0];
+    op.reverse = order[s->negate][form][1];
+    for (a = 0; a <= s->num_ops; a++)
+    {
+      for (op.shift = 0; op.shift <= s->max_shift; op.shift++)
+      {
+        for (b = 0; b <= s->num_ops; b++)
+        {
+          if (a_operation(s, &op, s->fund[a], s->fund[b]) == s->target)
+          {
+            op.a = (unsigned short)a;
+            op.b = (unsigned short)b;
+            if (accept(s, op))
+            {
+              return 1;
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static int compare_need(const void *x, const void *y)
+{
+  uint64_t a = ((const NeedEntry *)x)->value;
+  uint64_t b = ((const NeedEntry *)y)->value;
+
+  return (a > b) - (a < b);
+}
+
+static void add_need(OptimalSearch *s, uint64_t v, unsigned char opcode,
+  unsigned char reverse, unsigned int shift, int a, int shift_new)
+{
+  NeedEntry *e;
+
+  if (v == 0 || v > s->bound || s->num_need == NEED_SIZE)
+  {
+    return;
+  }
+  e = &s->need[s->num_need++];
+  e->value = v;
+  e->op.opcode = opcode;
+  e->op.reverse = reverse;
+  e->op.shift = (unsigned char)shift;
+  e->op.a = (unsigned short)a;
+  e->op.b = 0;
+  e->shift_new = (unsigned char)shift_new;
+}
+
+/* Collect the values "v" from which the target is computed with a single
+ * A-operation together with a fundamental, or with "v" alone.
+ */
+static void collect_need(OptimalSearch *s)
+{
+  uint64_t c = s->target;
+  unsigned int k;
+  int a;
+
+  s->num_need = 0;
+  for (a = 0; a <= s->num_ops; a++)
+  {
+    uint64_t f = s->fund[a];
+
+    for (k = 0; k <= s->max_shift && f <= (2 * s->bound) >> k; k++)
+    {
+      uint64_t fs = f << k;
+
+      // c = (f << k) + v, (f << k) - v, v - (f << k)
+      if (c > fs)
+      {
+        add_need(s, c - fs, KMUL_ADD, 0, k, a, 0);
+      }
+      if (fs > c)
+      {
+        add_need(s, fs - c, KMUL_SUB, 0, k, a, 0);
+      }
+      add_need(s, c + fs, KMUL_SUB, 1, k, a, 0);
+      // c = (v << k) + f, (v << k) - f, f - (v << k)
+      if (k > 0)
+      {
+        if (c > f && ((c - f) & ((UINT64_C(1) << k) - 1)) == 0)
+        {
+          add_need(s, (c - f) >> k, KMUL_ADD, 0, k, a, 1);
+        }
+        if (((c + f) & ((UINT64_C(1) << k) - 1)) == 0)
+        {
+          add_need(s, (c + f) >> k, KMUL_SUB, 0, k, a, 1);
+        }
+        if (f > c && ((f - c) & ((UINT64_C(1) << k) - 1)) == 0)
+        {
+          add_need(s, (f - c) >> k, KMUL_SUB, 1, k, a, 1);
+        }
+      }
+    }
+  }
+  // c = (v << k) + v, (v << k) - v
+  for (k = 1; k <= s->max_shift; k++)
+  {
+    uint64_t d = UINT64_C(1) << k;
+
+    if (c % (d + 1) == 0)
+    {
+      add_need(s, c / (d + 1), KMUL_ADD, 0, k, KMUL_MAX_GRAPH+1, 1);
+    }
+    if (k > 1 && c % (d - 1) == 0)
+    {
+      add_need(s, c / (d - 1), KMUL_SUB, 0, k, KMUL_MAX_GRAPH+1, 1);
+    }
+  }
+  qsort(s->need, s->num_need, sizeof(NeedEntry), compare_need);
+}
+
+/* Accept the graph made of a new fundamental "v" (already the last one of
+ * the search) and the final operation of the need entry "e".
+ */
+static int accept_need(OptimalSearch *s, const NeedEntry *e)
+{
+  KmulAdderOp last = e->op;
+  int v = s->num_ops;
+
+  if (last.a == KMUL_MAX_GRAPH+1)
+  {
+    last.a = (unsigned short)v;
+    last.b = (unsigned short)v;
+  }
+  else if (e->shift_new)
+  {
+    last.b = last.a;
+    last.a = (unsigned short)v;
+  }
+  else
+  {
+    last.b = (unsigned short)v;
+  }
+  return accept(s, last);
+}
+
+/* Depth-first search for graphs with s->depth operations, extending the
+ * current fundamentals by one A-operation per level.
+ */
+static int search(OptimalSearch *s)
+{
+  int remaining = s->depth - s->num_ops;
+  KmulAdderOp op;
+  int a, b, form;
+
+  if (out_of_time(s))
+  {
+    return 0;
+  }
+  if (remaining == 1)
+  {
+    return complete_one(s);
+  }
+  if (remaining == 2)
+  {
+    collect_need(s);
+  }
+  for (a = 0; a <= s->num_ops; a++)
+  {
+    for (b = 0; b <= s->num_ops; b++)
+    {
+      for (op.shift = 0; op.shift <= s->max_shift; op.shift++)
+      {
+        for (form = 0; form < 3; form++)
+        {
+          uint64_t v;
+
+          op.opcode = (form == 0) ? KMUL_ADD : KMUL_SUB;
+          op.reverse = (form == 2);
+          // Without a shift, a + b and a - b are computed once.
+          if (op.shift == 0 && ((form == 0 && a > b) || form == 2))
+          {
+            continue;
+          }
+          v = a_operation(s, &op, s->fund[a], s->fund[b]);
+          if (v == 0 || is_redundant(s, v))
+          {
+            continue;
+          }
+          op.a = (unsigned short)a;
+          op.b = (unsigned short)b;
+          s->ops[s->num_ops] = op;
+          s->fund[++s->num_ops] = v;
+          if (remaining == 2)
+          {
+            NeedEntry key, *e;
+
+            key.value = v;
+            e = bsearch(&key, s->need, s->num_need, sizeof(NeedEntry), compare_need);
+            // Visit all entries of the value.
+            while (e != NULL && e > s->need && e[-1].value == v)
+            {
+              e--;
+            }
+            for (; e != NULL && e < s->need + s->num_need && e->value == v; e++)
+            {
+              if (accept_need(s, e))
+              {
+                return 1;
+              }
+            }
+          }
+          else if (search(s))
+          {
+            return 1;
+          }
+          s->num_ops--;
+          if (s->expired)
+          {
+            return 0;
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/* Search for an adder graph computing "target" with the fewest additions and
+ * subtractions, whose cost is below "limit". The search gives up when the
+ * time budget of the context (if any) runs out. Returns 1 and fills "graph"
+ * on success.
+ */
+int optimal_graph(KmulContext *ctx, int64_t target, int limit, KmulGraph *graph)
+{
+  OptimalSearch *s;
+  uint64_t c = (target >= 0) ? (uint64_t)target : (uint64_t)0 - (uint64_t)target;
+  int min_cost, bits, found;
+
+  if (target == 0)
+  {
+    return 0;
+  }
+  s = malloc(sizeof(OptimalSearch));
+  if (s == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for the adder graph search.\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(s, 0, offsetof(OptimalSearch, need));
+  s->cm = &ctx->cost_model;
+  s->graph = graph;
+  s->limit = limit;
+  s->negate = (target < 0);
+  while ((c & 1) == 0)
+  {
+    c >>= 1;
+    s->shift++;
+  }
+  s->target = c;
+  bits = bit_length(c);
+  s->fund[0] = 1;
+  graph->target = target;
+  if (ctx->timeout_ms > 0)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &s->deadline);
+    s->deadline.tv_sec += ctx->timeout_ms / 1000;
+    s->deadline.tv_nsec += (long)(ctx->timeout_ms % 1000) * 1000000L;
+    if (s->deadline.tv_nsec >= 1000000000L)
+    {
+      s->deadline.tv_sec++;
+      s->deadline.tv_nsec -= 1000000000L;
+    }
+    s->timed = 1;
+  }
+
+  // Odd multipliers 1 and -1 need no additions; wider ones are left to
+  // the heuristic.
+  if (c > 1 && bits <= OPTIMAL_MAX_BITS)
+  {
+    s->bound = UINT64_C(1) << (bits + 1);
+    s->max_shift = bits + 1;
+    min_cost = (s->cm->add_cost < s->cm->sub_cost) ? s->cm->add_cost : s->cm->sub_cost;
+    for (s->depth = 1; s->depth <= KMUL_MAX_GRAPH && !s->expired; s->depth++)
+    {
+      // Every additional level costs at least one more addition.
+      if (s->depth * min_cost >= limit && min_cost > 0)
+      {
+        break;
+      }
+      if (search(s))
+      {
+        break;
+      }
+    }
+  }
+  found = s->found;
+  free(s);
+  return found;
+}
@@ -0,0 +1,153 @@
+/*
+ * File       : libkmul_profile.c
+ * Description: Cost profiles of target processors for libkmul: built-in
+ *              profiles selected by name, and profile files overriding any of
+ *              the costs.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include "kmul.h"
+
+// Maximum length of a line of a profile file
+#define PROFILE_LINE 256
+
+/* A built-in profile. The costs are latencies in cycles of typical cores of
+ * each architecture.
+ */
+typedef struct
+{
+  const char *name;
+  KmulCostModel cm;
+} KmulProfile;
+
+static const KmulProfile profiles[] =
+{
+  // Abstract machine of the Bernstein-Briggs paper: free shifts, no fused
+  // operations and no immediate limits
+  {"generic", {1, 1, 1, 0, 8, 0, 0, 0, 64, 0}},
+  // lea computes a + (b << k) for k <= 3; imul takes a 32-bit immediate
+  {"x86-64",  {1, 1, 1, 1, 3, 3, 0, 0, 32, 1}},
+  // add/sub take a register shifted by any amount as the second operand, so
+  // (a << k) + b and b - (a << k) are single instructions; mul has no
+  // immediate form
+  {"aarch64", {1, 1, 1, 1, 3, 63, 0, 63, 0, 1}},
+  // Zba sh1add/sh2add/sh3add compute (a << k) + b for k <= 3; mul has no
+  // immediate form
+  {"rv64-zba", {1, 1, 1, 1, 3, 3, 0, 0, 0, 1}}
+};
+
+/* A key of a profile file and the cost it sets. */
+typedef struct
+{
+  const char *key;
+  size_t offset;
+} KmulProfileKey;
+
+static const KmulProfileKey profile_keys[] =
+{
+  {"add_cost",        offsetof(KmulCostModel, add_cost)},
+  {"sub_cost",        offsetof(KmulCostModel, sub_cost)},
+  {"neg_cost",        offsetof(KmulCostModel, neg_cost)},
+  {"shift_cost",      offsetof(KmulCostModel, shift_cost)},
+  {"mult_cost",       offsetof(KmulCostModel, mult_cost)},
+  {"fused_add_shift", offsetof(KmulCostModel, fused_add_shift)},
+  {"fused_sub_shift", offsetof(KmulCostModel, fused_sub_shift)},
+  {"fused_rsb_shift", offsetof(KmulCostModel, fused_rsb_shift)},
+  {"imm_bits",        offsetof(KmulCostModel, imm_bits)},
+  {"ldc_cost",        offsetof(KmulCostModel, ldc_cost)}
+};
+
+
+/* Set "cm" to the built-in profile "name" (generic, x86-64, aarch64 or
+ * rv64-zba). Returns 0 on success, or -1 for an unknown profile.
+ */
+int kmul_target_profile(const char *name, KmulCostModel *cm)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++)
+  {
+    if (strcmp(profiles[i].name, name) == 0)
+    {
+      *cm = profiles[i].cm;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Override costs of "cm" from the profile file "path", with a "key = value"
+ * line per cost (e.g. "mult_cost = 4"); empty lines and lines starting with
+ * '#' are skipped. Returns 0 on success, -1 if the file cannot be read, or
+ * the number of the first invalid line.
+ */
+int kmul_read_profile(const char *path, KmulCostModel *cm)
+{
+  char line[PROFILE_LINE], key[PROFILE_LINE];
+  FILE *f = fopen(path, "r");
+  int line_no = 0;
+
+  if (f == NULL)
+  {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    char *p = line;
+    unsigned int i;
+    int value, n = 0;
+
+    line_no++;
+    while (isspace((unsigned char)*p))
+    {
+      p++;
+    }
+    if (*p == '\0' || *p == '#')
+    {
+      continue;
+    }
+    if (sscanf(p, "%255[a-z_] = %d %n", key, &value, &n) != 2 ||
+        (p[n] != '\0' && p[n] != '#') || value < 0)
+    {
+      fclose(f);
+      return line_no;
+    }
+    for (i = 0; i < sizeof(profile_keys) / sizeof(profile_keys[0]); i++)
+    {
+      if (strcmp(profile_keys[i].key, key) == 0)
+      {
+        *(int *)((char *)cm + profile_keys[i].offset) = value;
+        break;
+      }
+    }
+    if (i == sizeof(profile_keys) / sizeof(profile_keys[0]))
+    {
+      fclose(f);
+      return line_no;
+    }
+  }
+  fclose(f);
+  return 0;
+}
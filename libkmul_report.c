@@ -0,0 +1,244 @@
+/*
+ * File       : libkmul_report.c
+ * Description: Quality report of the sequences of all algorithms over a
+ *              range of multipliers, with their distributions and the best
+ *              algorithm per multiplier.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+
+/* The algorithms of the report, from the simplest one, which wins ties, to
+ * the most expensive one. Binary decomposition is the reference of the
+ * savings.
+ */
+static const struct
+{
+  const char *name;
+  ConstMulAlg alg;
+} algorithms[] =
+{
+  {"bindecomp", BINARY_DECOMPOSITION},
+  {"csd",       CSD_DECOMPOSITION},
+  {"bernstein", BERNSTEIN_BRIGGS},
+  {"optimal",   OPTIMAL}
+};
+
+#define NUM_ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]))
+
+/* The sequence of an algorithm for a single multiplier. */
+typedef struct
+{
+  int cost, adders, depth, mul;
+} ReportEntry;
+
+/* The totals and distributions of an algorithm over the range. "wins" counts
+ * the multipliers it is the winner of, "best" those where no algorithm does
+ * better (ties included), and "fallbacks" those left to the multiplier unit
+ * because no sequence costs less than "mult_cost".
+ */
+typedef struct
+{
+  uint64_t wins, best, fallbacks;
+  uint64_t cost, adders, depth;
+  uint64_t adders_hist[KMUL_HIST_SIZE], depth_hist[KMUL_HIST_SIZE];
+} ReportTotals;
+
+/* Return whether the sequence "a" is better than "b" for the objective of the
+ * context.
+ */
+static int better_entry(const KmulContext *ctx, const ReportEntry *a, const ReportEntry *b)
+{
+  if (ctx->objective == MINIMIZE_DEPTH && a->depth != b->depth)
+  {
+    return (a->depth < b->depth);
+  }
+  if (a->cost != b->cost)
+  {
+    return (a->cost < b->cost);
+  }
+  return (a->depth < b->depth);
+}
+
+static void add_bucket(uint64_t *h, int value)
+{
+  h[(value < KMUL_HIST_SIZE - 1) ? value : KMUL_HIST_SIZE - 1]++;
+}
+
+/* Print the histogram "name" of every algorithm as a table, with a row per
+ * value up to the largest one seen.
+ */
+static void print_histograms(FILE *f, const char *name, const ReportTotals *totals, size_t offset)
+{
+  unsigned int i;
+  int k, last = 0;
+
+  for (i = 0; i < NUM_ALGORITHMS; i++)
+  {
+    const uint64_t *h = (const uint64_t *)((const char *)&totals[i] + offset);
+
+    for (k = 0; k < KMUL_HIST_SIZE; k++)
+    {
+      if (h[k] > 0 && k > last)
+      {
+        last = k;
+      }
+    }
+  }
+  fprintf(f, "Report: %-8s", name);
+  for (i = 0; i < NUM_ALGORITHMS; i++)
+  {
+    fprintf(f, " %10s", algorithms[i].name);
+  }
+  fprintf(f, "\n");
+  for (k = 0; k <= last; k++)
+  {
+    fprintf(f, "Report: %3d%-5s", k, (k == KMUL_HIST_SIZE - 1) ? "+" : "");
+    for (i = 0; i < NUM_ALGORITHMS; i++)
+    {
+      fprintf(f, " %10" PRIu64, ((const uint64_t *)((const char *)&totals[i] + offset))[k]);
+    }
+    fprintf(f, "\n");
+  }
+}
+
+/* Compute the W-bit routines (signed if "s" is set) of all multipliers in
+ * [lo, hi] with every algorithm, under the cost model, objective, modular
+ * search and time budget of the context. Write a CSV row per multiplier to
+ * "csv", with the cost, additions/subtractions, adder depth and fallback to
+ * a multiplication of each algorithm, the winner (the simplest of the best
+ * algorithms) and the cost it saves over binary decomposition. Then print
+ * the totals, the savings over binary decomposition and the histograms of
+ * the additions/subtractions and of the depth of each algorithm to "summary".
+ */
+void kmul_report(KmulContext *ctx, FILE *csv, FILE *summary, int64_t lo, int64_t hi, int s, unsigned int W)
+{
+  ReportTotals totals[NUM_ALGORITHMS];
+  ReportEntry entries[NUM_ALGORITHMS];
+  uint64_t count = 0, best_cost = 0;
+  uint64_t u;
+  unsigned int i, j;
+
+  memset(totals, 0, sizeof(totals));
+  fprintf(csv, "multiplier");
+  for (i = 0; i < NUM_ALGORITHMS; i++)
+  {
+    fprintf(csv, ",%s_cost,%s_adders,%s_depth,%s_mul", algorithms[i].name, algorithms[i].name,
+      algorithms[i].name, algorithms[i].name);
+  }
+  fprintf(csv, ",winner,saving\n");
+
+  // Count in unsigned arithmetic, as in the ranges of routines.
+  for (u = (uint64_t)lo; ; u++)
+  {
+    int64_t m = (int64_t)u;
+    unsigned int winner = 0;
+
+    for (i = 0; i < NUM_ALGORITHMS; i++)
+    {
+      const KmulSequence *seq = kmul_routine_sequence(ctx, algorithms[i].alg, m, W);
+      ReportEntry *e = &entries[i];
+
+      e->cost = seq->cost;
+      e->adders = seq->adders;
+      e->depth = seq->depth;
+      e->mul = 0;
+      for (j = 0; j < (unsigned int)seq->num_ops; j++)
+      {
+        e->mul |= (seq->ops[j].opcode == KMUL_MUL);
+      }
+      if (better_entry(ctx, e, &entries[winner]))
+      {
+        winner = i;
+      }
+    }
+
+    if (s)
+    {
+      fprintf(csv, "%" PRId64, m);
+    }
+    else
+    {
+      fprintf(csv, "%" PRIu64, u);
+    }
+    for (i = 0; i < NUM_ALGORITHMS; i++)
+    {
+      const ReportEntry *e = &entries[i];
+      ReportTotals *t = &totals[i];
+
+      fprintf(csv, ",%d,%d,%d,%d", e->cost, e->adders, e->depth, e->mul);
+      t->wins += (i == winner);
+      t->best += !better_entry(ctx, &entries[winner], e);
+      t->fallbacks += e->mul;
+      t->cost += e->cost;
+      t->adders += e->adders;
+      t->depth += e->depth;
+      add_bucket(t->adders_hist, e->adders);
+      add_bucket(t->depth_hist, e->depth);
+    }
+    fprintf(csv, ",%s,%d\n", algorithms[winner].name, entries[0].cost - entries[winner].cost);
+    best_cost += entries[winner].cost;
+    count++;
+    // Stop before wrapping around when the range ends at the largest value.
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+
+  fprintf(summary, "Report: %" PRIu64 " %s %u-bit multipliers, mult_cost %d, minimizing %s%s.\n", count,
+    s ? "signed" : "unsigned", W, ctx->cost_model.mult_cost,
+    (ctx->objective == MINIMIZE_DEPTH) ? "depth" : "adders", (ctx->modular && W < 64) ? ", with the modular search" : "");
+  fprintf(summary, "Report: %-9s %10s %10s %10s %12s %12s %8s %10s %10s %10s\n", "algorithm", "wins", "best",
+    "fallbacks", "total cost", "saving", "saving%", "avg cost", "avg adders", "avg depth");
+  for (i = 0; i <= NUM_ALGORITHMS; i++)
+  {
+    // The last row is the winner of each multiplier.
+    uint64_t cost = (i < NUM_ALGORITHMS) ? totals[i].cost : best_cost;
+    int64_t saving = (int64_t)(totals[0].cost - cost);
+
+    if (i < NUM_ALGORITHMS)
+    {
+      const ReportTotals *t = &totals[i];
+
+      fprintf(summary, "Report: %-9s %10" PRIu64 " %10" PRIu64 " %10" PRIu64, algorithms[i].name, t->wins, t->best,
+        t->fallbacks);
+    }
+    else
+    {
+      fprintf(summary, "Report: %-9s %10s %10s %10s", "winner", "", "", "");
+    }
+    fprintf(summary, " %12" PRIu64 " %12" PRId64 " %7.1f%% %10.3f", cost, saving,
+      (totals[0].cost > 0) ? 100.0 * saving / totals[0].cost : 0.0, (double)cost / count);
+    if (i < NUM_ALGORITHMS)
+    {
+      fprintf(summary, " %10.3f %10.3f", (double)totals[i].adders / count, (double)totals[i].depth / count);
+    }
+    fprintf(summary, "\n");
+  }
+  print_histograms(summary, "adders", totals, offsetof(ReportTotals, adders_hist));
+  print_histograms(summary, "depth", totals, offsetof(ReportTotals, depth_hist));
+}
@@ -0,0 +1,749 @@
+/*
+ * File       : libkmul_rtl.c
+ * Description: Emission of the routines as synthesizable Verilog or VHDL
+ *              shift-and-add networks, optionally pipelined, and of
+ *              self-checking testbenches for them.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+// Number of input vectors applied by the testbenches
+#define RTL_VECTORS 256
+
+/* A value of the network: the result of an operation of the sequence in SSA
+ * form, or the input "x" (numbered after the operations). Operands are value
+ * numbers. Shifts are wiring and take the stage of their operand, while each
+ * addition, subtraction and negation is one adder level deeper than its
+ * operands. "delay" is the number of registers delaying the value for its
+ * uses in later stages.
+ */
+typedef struct
+{
+  KmulOpcode opcode;
+  int src1, src2;
+  int64_t imm;
+  int temp, version;
+  int is_zero;
+  int level, stage, delay;
+} RtlValue;
+
+/* The network of a routine. */
+typedef struct
+{
+  FILE *f;
+  CodegenMode cgen;
+  unsigned int W;
+  RtlValue *values;
+  int num_values, result;
+} RtlNet;
+
+
+/* Print the name of value "v" delayed by "delay" registers. */
+static void print_rtl_name(RtlNet *net, int v, int delay)
+{
+  const RtlValue *val = &net->values[v];
+  FILE *f = net->f;
+
+  if (val->is_zero)
+  {
+    if (net->cgen == VERILOG)
+    {
+      fprintf(f, "%u'd0", net->W);
+    }
+    else
+    {
+      fprintf(f, "0");
+    }
+    return;
+  }
+  if (v == net->num_values - 1)
+  {
+    fprintf(f, "x");
+  }
+  else if (val->version == 0)
+  {
+    fprintf(f, "t%d", val->temp);
+  }
+  else
+  {
+    fprintf(f, "t%d_%d", val->temp, val->version);
+  }
+  if (delay > 0)
+  {
+    fprintf(f, "_d%d", delay);
+  }
+}
+
+/* Print the name of value "v" as used in stage "stage". */
+static void print_rtl_value(RtlNet *net, int v, int stage)
+{
+  print_rtl_name(net, v, stage - net->values[v].stage);
+}
+
+/* Build the network of the sequence of the context: copies are forwarded,
+ * temporaries renamed to single assignments, shifts by W or more bits
+ * folded to 0, and the adders spread over "pipeline" stages (one without
+ * pipelining), so that each stage has at most ceil(depth / pipeline) adder
+ * levels. The output register closes the last stage.
+ */
+static void build_net(RtlNet *net, const KmulSequence *seq, int pipeline)
+{
+  int x = seq->num_ops;
+  int num_temps = seq->result + 1;
+  int stages = (pipeline > 0) ? pipeline : 1;
+  int *def, *versions;
+  int depth, i, k;
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    if (seq->ops[i].dst >= num_temps)
+    {
+      num_temps = seq->ops[i].dst + 1;
+    }
+  }
+  net->num_values = seq->num_ops + 1;
+  net->values = calloc(net->num_values, sizeof(RtlValue));
+  def = calloc(num_temps, sizeof(int));
+  versions = calloc(num_temps, sizeof(int));
+  if (net->values == NULL || def == NULL || versions == NULL)
+  {
+    fprintf(stderr, "Error: Out of memory for the network of a routine.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    const KmulOp *op = &seq->ops[i];
+    RtlValue *val = &net->values[i];
+
+    val->opcode = op->opcode;
+    val->imm = op->imm;
+    val->src1 = val->src2 = -1;
+    if (op->opcode != KMUL_LDC)
+    {
+      val->src1 = (op->src1 == KMUL_X) ? x : def[op->src1];
+    }
+    if (op->opcode == KMUL_ADD || op->opcode == KMUL_SUB)
+    {
+      val->src2 = (op->src2 == KMUL_X) ? x : def[op->src2];
+    }
+    switch (op->opcode)
+    {
+      case KMUL_MOV:
+        def[op->dst] = val->src1;
+        continue;
+      case KMUL_LDC:
+        // Only the zero multiplier loads a constant.
+        val->is_zero = 1;
+        break;
+      case KMUL_SHL:
+        val->is_zero = net->values[val->src1].is_zero || op->imm >= (int64_t)net->W;
+        val->level = net->values[val->src1].level;
+        break;
+      default:
+        val->level = net->values[val->src1].level;
+        if (val->src2 >= 0 && net->values[val->src2].level > val->level)
+        {
+          val->level = net->values[val->src2].level;
+        }
+        val->level++;
+        break;
+    }
+    val->temp = op->dst;
+    val->version = versions[op->dst]++;
+    def[op->dst] = i;
+  }
+  net->result = def[seq->result];
+
+  // Level L of the adders ends in stage ceil(L * stages / depth) - 1. Shifts
+  // are wiring, and are moved to the earliest stage using them so that only
+  // their operand is registered.
+  depth = net->values[net->result].level;
+  if (depth == 0)
+  {
+    depth = 1;
+  }
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    RtlValue *val = &net->values[i];
+
+    if (val->opcode == KMUL_ADD || val->opcode == KMUL_SUB || val->opcode == KMUL_NEG)
+    {
+      val->stage = (val->level * stages + depth - 1) / depth - 1;
+    }
+    else if (val->opcode == KMUL_SHL)
+    {
+      val->stage = (i == net->result) ? stages - 1 : stages;
+    }
+  }
+  for (i = seq->num_ops - 1; i >= 0; i--)
+  {
+    RtlValue *val = &net->values[i];
+
+    if (val->opcode == KMUL_MOV)
+    {
+      continue;
+    }
+    if (val->opcode == KMUL_SHL && val->stage == stages)
+    {
+      // Unused
+      val->stage = net->values[val->src1].stage;
+    }
+    for (k = 0; k < 2; k++)
+    {
+      int src = (k == 0) ? val->src1 : val->src2;
+
+      if (src >= 0 && src < x && net->values[src].opcode == KMUL_SHL &&
+          val->stage < net->values[src].stage)
+      {
+        net->values[src].stage = val->stage;
+      }
+    }
+  }
+  // Values used in later stages are delayed by as many registers.
+  for (i = 0; i < seq->num_ops; i++)
+  {
+    RtlValue *val = &net->values[i];
+
+    for (k = 0; k < 2; k++)
+    {
+      int src = (k == 0) ? val->src1 : val->src2;
+
+      if (src >= 0 && val->opcode != KMUL_MOV &&
+          val->stage - net->values[src].stage > net->values[src].delay)
+      {
+        net->values[src].delay = val->stage - net->values[src].stage;
+      }
+    }
+  }
+  if (pipeline > 0)
+  {
+    net->values[net->result].delay = pipeline - net->values[net->result].stage;
+  }
+  free(def);
+  free(versions);
+}
+
+/* Print the declaration of the signals of the network. */
+static void print_rtl_signals(RtlNet *net, const char *type)
+{
+  FILE *f = net->f;
+  int i, k;
+
+  for (i = 0; i < net->num_values; i++)
+  {
+    const RtlValue *val = &net->values[i];
+    int is_op = (i < net->num_values - 1);
+
+    if (val->is_zero || (is_op && val->opcode == KMUL_MOV))
+    {
+      continue;
+    }
+    // The input is a port, but its delayed copies are not.
+    for (k = (is_op ? 0 : 1); k <= val->delay; k++)
+    {
+      if (net->cgen == VERILOG)
+      {
+        fprintf(f, "  %s [%u:0] ", (k == 0) ? "wire" : "reg ", net->W - 1);
+        print_rtl_name(net, i, k);
+        fprintf(f, ";\n");
+      }
+      else
+      {
+        fprintf(f, "  signal ");
+        print_rtl_name(net, i, k);
+        fprintf(f, " : %s(%u downto 0);\n", type, net->W - 1);
+      }
+    }
+  }
+}
+
+/* Print the operation of value "v". */
+static void print_rtl_op(RtlNet *net, int v)
+{
+  const RtlValue *val = &net->values[v];
+  FILE *f = net->f;
+
+  fprintf(f, "  %s", (net->cgen == VERILOG) ? "assign " : "");
+  print_rtl_value(net, v, val->stage);
+  fprintf(f, (net->cgen == VERILOG) ? " = " : " <= ");
+  switch (val->opcode)
+  {
+    case KMUL_SHL:
+      if (net->cgen == VERILOG)
+      {
+        print_rtl_value(net, val->src1, val->stage);
+        fprintf(f, " << %" PRId64, val->imm);
+      }
+      else
+      {
+        fprintf(f, "shift_left(");
+        print_rtl_value(net, val->src1, val->stage);
+        fprintf(f, ", %" PRId64 ")", val->imm);
+      }
+      break;
+    case KMUL_NEG:
+      fprintf(f, (net->cgen == VERILOG) ? "-" : "0 - ");
+      print_rtl_value(net, val->src1, val->stage);
+      break;
+    case KMUL_ADD:
+    case KMUL_SUB:
+      print_rtl_value(net, val->src1, val->stage);
+      fprintf(f, (val->opcode == KMUL_ADD) ? " + " : " - ");
+      print_rtl_value(net, val->src2, val->stage);
+      break;
+    default:
+      break;
+  }
+  fprintf(f, ";  %s stage %d\n", (net->cgen == VERILOG) ? "//" : "--", val->stage);
+}
+
+/* Print the pipeline registers of the network. */
+static void print_rtl_registers(RtlNet *net)
+{
+  FILE *f = net->f;
+  int i, k;
+
+  if (net->cgen == VERILOG)
+  {
+    fprintf(f, "  always @(posedge clk)\n");
+    fprintf(f, "  begin\n");
+  }
+  else
+  {
+    fprintf(f, "  process (clk)\n");
+    fprintf(f, "  begin\n");
+    fprintf(f, "    if rising_edge(clk) then\n");
+  }
+  for (i = 0; i < net->num_values; i++)
+  {
+    const RtlValue *val = &net->values[i];
+
+    if (val->is_zero)
+    {
+      continue;
+    }
+    for (k = 1; k <= val->delay; k++)
+    {
+      fprintf(f, (net->cgen == VERILOG) ? "    " : "      ");
+      print_rtl_name(net, i, k);
+      fprintf(f, " <= ");
+      print_rtl_name(net, i, k - 1);
+      fprintf(f, ";\n");
+    }
+  }
+  if (net->cgen == VERILOG)
+  {
+    fprintf(f, "  end\n");
+  }
+  else
+  {
+    fprintf(f, "    end if;\n");
+    fprintf(f, "  end process;\n");
+  }
+}
+
+/* Emit the Verilog module or VHDL entity (according to the language of the
+ * context) for the multiplication by "m" modulo 2^W, with an input "x" and
+ * an output "y" of exactly W bits. Multiplications are replaced by the CSD
+ * decomposition, so that the network only has adders. With "pipeline"
+ * stages in the context, the network gets a "clk" input, the adders are
+ * spread evenly over the stages, values crossing stages are delayed by
+ * registers and the output is registered, for a latency of "pipeline"
+ * cycles.
+ */
+void emit_kmul_rtl(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  const char *type = s ? "signed" : "unsigned";
+  int pipeline = ctx->pipeline;
+  char name[KMUL_NAME_SIZE];
+  RtlNet net;
+  int i;
+
+  // Only checks the data width.
+  set_data_width(C99, W);
+  net.f = f;
+  net.cgen = ctx->cgen;
+  net.W = W;
+  net.values = NULL;
+  if (m != 0)
+  {
+    const KmulSequence *seq = kmul_routine_sequence(ctx, alg, m, W);
+
+    for (i = 0; i < seq->num_ops; i++)
+    {
+      if (seq->ops[i].opcode == KMUL_MUL)
+      {
+        ctx->seq.num_ops = 0;
+        ctx->count = 0;
+        csd_decomposition(ctx, m);
+        kmul_optimize_sequence(&ctx->seq, &ctx->seq.result, 1);
+        break;
+      }
+    }
+    build_net(&net, &ctx->seq, pipeline);
+  }
+
+  kmul_routine_name(name, alg, m, s, W);
+  if (ctx->cgen == VERILOG)
+  {
+    fprintf(f, "module %s (\n", name);
+    if (pipeline > 0)
+    {
+      fprintf(f, "  input  wire clk,\n");
+    }
+    fprintf(f, "  input  wire %s[%u:0] x,\n", s ? "signed " : "", W - 1);
+    fprintf(f, "  output wire %s[%u:0] y\n", s ? "signed " : "", W - 1);
+    fprintf(f, ");\n");
+  }
+  else
+  {
+    fprintf(f, "library ieee;\n");
+    fprintf(f, "use ieee.std_logic_1164.all;\n");
+    fprintf(f, "use ieee.numeric_std.all;\n");
+    fprintf(f, "\n");
+    fprintf(f, "entity %s is\n", name);
+    fprintf(f, "  port (\n");
+    if (pipeline > 0)
+    {
+      fprintf(f, "    clk : in  std_logic;\n");
+    }
+    fprintf(f, "    x   : in  %s(%u downto 0);\n", type, W - 1);
+    fprintf(f, "    y   : out %s(%u downto 0)\n", type, W - 1);
+    fprintf(f, "  );\n");
+    fprintf(f, "end %s;\n", name);
+    fprintf(f, "\n");
+    fprintf(f, "architecture rtl of %s is\n", name);
+  }
+
+  if (m == 0 || net.values[net.result].is_zero)
+  {
+    if (ctx->cgen == VERILOG)
+    {
+      fprintf(f, "  assign y = %u'd0;\n", W);
+      fprintf(f, "endmodule\n");
+    }
+    else
+    {
+      fprintf(f, "begin\n");
+      fprintf(f, "  y <= (others => '0');\n");
+      fprintf(f, "end rtl;\n");
+    }
+    free(net.values);
+    return;
+  }
+
+  print_rtl_signals(&net, type);
+  if (ctx->cgen == VHDL)
+  {
+    fprintf(f, "begin\n");
+  }
+  for (i = 0; i < net.num_values - 1; i++)
+  {
+    const RtlValue *val = &net.values[i];
+
+    if (val->opcode != KMUL_MOV && !val->is_zero)
+    {
+      print_rtl_op(&net, i);
+    }
+  }
+  if (pipeline > 0)
+  {
+    print_rtl_registers(&net);
+  }
+  fprintf(f, "  %s", (ctx->cgen == VERILOG) ? "assign y = " : "y <= ");
+  print_rtl_value(&net, net.result, pipeline);
+  fprintf(f, ";\n");
+  fprintf(f, (ctx->cgen == VERILOG) ? "endmodule\n" : "end rtl;\n");
+  free(net.values);
+}
+
+/* Print "m" modulo 2^W as a Verilog constant or a VHDL binary string. */
+static void print_rtl_constant(FILE *f, CodegenMode cgen, int64_t m, unsigned int W)
+{
+  int k;
+
+  if (cgen == VERILOG)
+  {
+    fprintf(f, "%u'd%" PRIu64, W, (W < 64) ? (uint64_t)m & ((UINT64_C(1) << W) - 1) : (uint64_t)m);
+  }
+  else
+  {
+    fprintf(f, "\"");
+    for (k = (int)W - 1; k >= 0; k--)
+    {
+      fprintf(f, "%c", (((uint64_t)m >> k) & 1) ? '1' : '0');
+    }
+    fprintf(f, "\"");
+  }
+}
+
+
+/* Emit the Verilog testbench of emit_rtl_testbench(). */
+static void emit_verilog_testbench(FILE *f, const char *name, ConstMulAlg alg,
+  int64_t lo, int64_t hi, int s, unsigned int W, int pipeline)
+{
+  char routine[KMUL_NAME_SIZE];
+  uint64_t u;
+  int n, k;
+
+  fprintf(f, "`timescale 1ns / 1ps\n");
+  fprintf(f, "\n");
+  fprintf(f, "module %s;\n", name);
+  fprintf(f, "  reg clk = 1'b0;\n");
+  fprintf(f, "  reg [%u:0] x = %u'd0;\n", W - 1, W);
+  if (pipeline > 0)
+  {
+    fprintf(f, "  reg [%u:0] x_hist [0:%d];\n", W - 1, pipeline - 1);
+  }
+  fprintf(f, "  reg [%u:0] e, p;\n", W - 1);
+  fprintf(f, "  reg [63:0] s;\n");
+  fprintf(f, "  integer i, errors;\n");
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    fprintf(f, "  wire [%u:0] y%d;\n", W - 1, n);
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "\n");
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    kmul_routine_name(routine, alg, (int64_t)u, s, W);
+    fprintf(f, "  %s dut%d (%s.x(x), .y(y%d));\n", routine, n, (pipeline > 0) ? ".clk(clk), " : "", n);
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "\n");
+  fprintf(f, "  always #5 clk = ~clk;\n");
+  fprintf(f, "\n");
+  if (pipeline > 0)
+  {
+    fprintf(f, "  always @(posedge clk)\n");
+    fprintf(f, "  begin\n");
+    fprintf(f, "    x_hist[0] <= x;\n");
+    for (k = 1; k < pipeline; k++)
+    {
+      fprintf(f, "    x_hist[%d] <= x_hist[%d];\n", k, k - 1);
+    }
+    fprintf(f, "  end\n");
+    fprintf(f, "\n");
+  }
+  fprintf(f, "  initial\n");
+  fprintf(f, "  begin\n");
+  fprintf(f, "    errors = 0;\n");
+  fprintf(f, "    s = 64'h2545F4914F6CDD1D;\n");
+  fprintf(f, "    for (i = 0; i < %d; i = i + 1)\n", RTL_VECTORS + pipeline);
+  fprintf(f, "    begin\n");
+  fprintf(f, "      @(negedge clk);\n");
+  fprintf(f, "      if (i >= %d)\n", pipeline);
+  fprintf(f, "      begin\n");
+  if (pipeline > 0)
+  {
+    fprintf(f, "        e = x_hist[%d];\n", pipeline - 1);
+  }
+  else
+  {
+    fprintf(f, "        e = x;\n");
+  }
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    kmul_routine_name(routine, alg, (int64_t)u, s, W);
+    fprintf(f, "        p = e * ");
+    print_rtl_constant(f, VERILOG, (int64_t)u, W);
+    fprintf(f, ";\n");
+    fprintf(f, "        if (y%d !== p)\n", n);
+    fprintf(f, "        begin\n");
+    fprintf(f, "          errors = errors + 1;\n");
+    fprintf(f, "          $display(\"FAIL: %s(%%0d) = %%0d, expected %%0d\", e, y%d, p);\n", routine, n);
+    fprintf(f, "        end\n");
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "      end\n");
+  fprintf(f, "      s = s ^ (s << 13);\n");
+  fprintf(f, "      s = s ^ (s >> 7);\n");
+  fprintf(f, "      s = s ^ (s << 17);\n");
+  fprintf(f, "      x = (i == 0) ? {%u{1'b1}} : (i == 1) ? %u'd1 : s[%u:0];\n", W, W, W - 1);
+  fprintf(f, "    end\n");
+  fprintf(f, "    if (errors == 0)\n");
+  fprintf(f, "      $display(\"PASS: %d routines, %d vectors\");\n", n + 1, RTL_VECTORS);
+  fprintf(f, "    else\n");
+  fprintf(f, "      $display(\"FAIL: %%0d errors\", errors);\n");
+  fprintf(f, "    $finish;\n");
+  fprintf(f, "  end\n");
+  fprintf(f, "endmodule\n");
+}
+
+/* Emit the VHDL testbench of emit_rtl_testbench(). */
+static void emit_vhdl_testbench(FILE *f, const char *name, ConstMulAlg alg,
+  int64_t lo, int64_t hi, int s, unsigned int W, int pipeline)
+{
+  const char *type = s ? "signed" : "unsigned";
+  char routine[KMUL_NAME_SIZE];
+  uint64_t u;
+  int n, k;
+
+  fprintf(f, "library ieee;\n");
+  fprintf(f, "use ieee.std_logic_1164.all;\n");
+  fprintf(f, "use ieee.numeric_std.all;\n");
+  fprintf(f, "\n");
+  fprintf(f, "entity %s is\n", name);
+  fprintf(f, "end %s;\n", name);
+  fprintf(f, "\n");
+  fprintf(f, "architecture sim of %s is\n", name);
+  if (pipeline > 0)
+  {
+    fprintf(f, "  type hist_t is array (0 to %d) of %s(%u downto 0);\n", pipeline - 1, type, W - 1);
+    fprintf(f, "  signal x_hist : hist_t;\n");
+  }
+  fprintf(f, "  signal clk : std_logic := '0';\n");
+  fprintf(f, "  signal done : boolean := false;\n");
+  fprintf(f, "  signal x : %s(%u downto 0) := (others => '0');\n", type, W - 1);
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    fprintf(f, "  signal y%d : %s(%u downto 0);\n", n, type, W - 1);
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "begin\n");
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    kmul_routine_name(routine, alg, (int64_t)u, s, W);
+    fprintf(f, "  dut%d : entity work.%s port map (%sx => x, y => y%d);\n", n, routine,
+      (pipeline > 0) ? "clk => clk, " : "", n);
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "\n");
+  fprintf(f, "  process\n");
+  fprintf(f, "  begin\n");
+  fprintf(f, "    while not done loop\n");
+  fprintf(f, "      clk <= '0';\n");
+  fprintf(f, "      wait for 5 ns;\n");
+  fprintf(f, "      clk <= '1';\n");
+  fprintf(f, "      wait for 5 ns;\n");
+  fprintf(f, "    end loop;\n");
+  fprintf(f, "    wait;\n");
+  fprintf(f, "  end process;\n");
+  fprintf(f, "\n");
+  if (pipeline > 0)
+  {
+    fprintf(f, "  process (clk)\n");
+    fprintf(f, "  begin\n");
+    fprintf(f, "    if rising_edge(clk) then\n");
+    fprintf(f, "      x_hist(0) <= x;\n");
+    for (k = 1; k < pipeline; k++)
+    {
+      fprintf(f, "      x_hist(%d) <= x_hist(%d);\n", k, k - 1);
+    }
+    fprintf(f, "    end if;\n");
+    fprintf(f, "  end process;\n");
+    fprintf(f, "\n");
+  }
+  fprintf(f, "  process\n");
+  fprintf(f, "    variable s : unsigned(63 downto 0) := x\"2545F4914F6CDD1D\";\n");
+  fprintf(f, "    variable e : %s(%u downto 0);\n", type, W - 1);
+  fprintf(f, "    variable p : %s(%u downto 0);\n", type, 2 * W - 1);
+  fprintf(f, "    variable errors : natural := 0;\n");
+  fprintf(f, "  begin\n");
+  fprintf(f, "    for i in 0 to %d loop\n", RTL_VECTORS + pipeline - 1);
+  fprintf(f, "      wait until falling_edge(clk);\n");
+  fprintf(f, "      if i >= %d then\n", pipeline);
+  if (pipeline > 0)
+  {
+    fprintf(f, "        e := x_hist(%d);\n", pipeline - 1);
+  }
+  else
+  {
+    fprintf(f, "        e := x;\n");
+  }
+  for (u = (uint64_t)lo, n = 0; ; u++, n++)
+  {
+    kmul_routine_name(routine, alg, (int64_t)u, s, W);
+    fprintf(f, "        p := e * %s'(", type);
+    print_rtl_constant(f, VHDL, (int64_t)u, W);
+    fprintf(f, ");\n");
+    fprintf(f, "        if y%d /= p(%u downto 0) then\n", n, W - 1);
+    fprintf(f, "          errors := errors + 1;\n");
+    fprintf(f, "          report \"FAIL: %s\" severity error;\n", routine);
+    fprintf(f, "        end if;\n");
+    if (u == (uint64_t)hi)
+    {
+      break;
+    }
+  }
+  fprintf(f, "      end if;\n");
+  fprintf(f, "      s := s xor shift_left(s, 13);\n");
+  fprintf(f, "      s := s xor shift_right(s, 7);\n");
+  fprintf(f, "      s := s xor shift_left(s, 17);\n");
+  fprintf(f, "      if i = 0 then\n");
+  fprintf(f, "        x <= (others => '1');\n");
+  fprintf(f, "      elsif i = 1 then\n");
+  fprintf(f, "        x <= (0 => '1', others => '0');\n");
+  fprintf(f, "      else\n");
+  fprintf(f, "        x <= %s(s(%u downto 0));\n", type, W - 1);
+  fprintf(f, "      end if;\n");
+  fprintf(f, "    end loop;\n");
+  fprintf(f, "    if errors = 0 then\n");
+  fprintf(f, "      report \"PASS: %d routines, %d vectors\";\n", n + 1, RTL_VECTORS);
+  fprintf(f, "    else\n");
+  fprintf(f, "      report \"FAIL: \" & integer'image(errors) & \" errors\" severity failure;\n");
+  fprintf(f, "    end if;\n");
+  fprintf(f, "    done <= true;\n");
+  fprintf(f, "    wait;\n");
+  fprintf(f, "  end process;\n");
+  fprintf(f, "end sim;\n");
+}
+
+/* Emit the testbench "name" of the routines for the multipliers in [lo, hi]
+ * in the language "cgen". It applies the same input to all of them at every
+ * clock cycle (0, all ones, 1, then pseudo-random values), checks the output
+ * of each against the product of the input applied "pipeline" cycles before
+ * and reports "PASS", or each mismatch and "FAIL". It only needs a Verilog
+ * (e.g. Icarus Verilog) or VHDL (e.g. GHDL) simulator.
+ */
+void emit_rtl_testbench(FILE *f, CodegenMode cgen, const char *name, ConstMulAlg alg,
+  int64_t lo, int64_t hi, int s, unsigned int W, int pipeline)
+{
+  if (cgen == VERILOG)
+  {
+    emit_verilog_testbench(f, name, alg, lo, hi, s, W, pipeline);
+  }
+  else
+  {
+    emit_vhdl_testbench(f, name, alg, lo, hi, s, W, pipeline);
+  }
+}
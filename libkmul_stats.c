@@ -0,0 +1,264 @@
+/*
+ * File       : libkmul_stats.c
+ * Description: Statistics of the search for the routines of a batch, as JSON
+ *              lines or CSV rows with aggregate histograms.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "kmul.h"
+
+
+/* A histogram of KmulStats, with its name and kind of buckets. */
+typedef struct
+{
+  const char *name;
+  size_t offset;
+  int log2;
+} StatsHistogram;
+
+static const StatsHistogram histograms[] =
+{
+  {"cost",       offsetof(KmulStats, cost),       0},
+  {"ops",        offsetof(KmulStats, ops),        0},
+  {"depth",      offsetof(KmulStats, depth),      0},
+  {"finds",      offsetof(KmulStats, finds),      1},
+  {"nodes",      offsetof(KmulStats, nodes),      1},
+  {"max_probes", offsetof(KmulStats, max_probes), 0},
+  {"time_us",    offsetof(KmulStats, time_us),    1}
+};
+
+#define NUM_HISTOGRAMS (sizeof(histograms) / sizeof(histograms[0]))
+
+static uint64_t *histogram(KmulStats *stats, int i)
+{
+  return (uint64_t *)((char *)stats + histograms[i].offset);
+}
+
+static const uint64_t *histogram_const(const KmulStats *stats, int i)
+{
+  return (const uint64_t *)((const char *)stats + histograms[i].offset);
+}
+
+/* Count "value" in the histogram "h", of exact values or powers of two. */
+static void add_sample(uint64_t *h, uint64_t value, int log2)
+{
+  unsigned int k = 0;
+
+  if (log2)
+  {
+    while (value > 0)
+    {
+      value >>= 1;
+      k++;
+    }
+  }
+  else
+  {
+    k = (value < KMUL_HIST_SIZE - 1) ? (unsigned int)value : KMUL_HIST_SIZE - 1;
+  }
+  h[k]++;
+}
+
+/* Print the label of bucket "k" of a histogram. */
+static void print_bucket(FILE *f, unsigned int k, int log2)
+{
+  if (log2 && k > 1)
+  {
+    fprintf(f, "%" PRIu64 "-%" PRIu64, UINT64_C(1) << (k - 1), (UINT64_C(2) << (k - 1)) - 1);
+  }
+  else if (!log2 && k == KMUL_HIST_SIZE - 1)
+  {
+    fprintf(f, "%u+", k);
+  }
+  else
+  {
+    fprintf(f, "%u", k);
+  }
+}
+
+/* Start empty statistics writing their records to "f", as CSV rows if "csv"
+ * is set and as JSON lines otherwise.
+ */
+void kmul_stats_init(KmulStats *stats, FILE *f, int csv)
+{
+  memset(stats, 0, sizeof(KmulStats));
+  stats->f = f;
+  stats->csv = csv;
+}
+
+/* Write the header row of CSV statistics. */
+void kmul_stats_header(const KmulStats *stats)
+{
+  if (stats->csv)
+  {
+    fprintf(stats->f, "routine,multiplier,searched,cost,ops,adders,depth,finds,tries,pruned,"
+      "lookups,nodes,probes,max_probes,memo_slots,memo_used,memory,time_us\n");
+  }
+}
+
+/* Return the time of a monotonic clock in seconds. */
+double kmul_stats_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Return the bytes of the search structures of context "ctx" (node arena,
+ * memo table and sequence buffer), which only grow: their high-water mark.
+ */
+uint64_t kmul_context_memory(const KmulContext *ctx)
+{
+  unsigned int memo_slots = (ctx->memo != NULL) ? ctx->memo_mask + 1 : 0;
+
+  return (uint64_t)ctx->arena_size * sizeof(Node) + (uint64_t)memo_slots * sizeof(MemoSlot) +
+    (uint64_t)ctx->seq.max_ops * sizeof(KmulOp);
+}
+
+/* Record the routine "name" of the multiplication by "m" (signed if "s" is
+ * set), just emitted with the context "ctx" in "seconds", whose search
+ * counters were "before" at its start.
+ */
+void kmul_stats_record(KmulStats *stats, const KmulContext *ctx, const char *name, int64_t m, int s,
+  const KmulCounters *before, double seconds)
+{
+  const KmulCounters *c = &ctx->counters;
+  const KmulSequence *seq = &ctx->seq;
+  int searched = (m != 0);
+  int cost = searched ? seq->cost : 0;
+  int ops = searched ? seq->num_ops : 0;
+  int adders = searched ? seq->adders : 0;
+  int depth = searched ? seq->depth : 0;
+  unsigned int memo_slots = (ctx->memo != NULL) ? ctx->memo_mask + 1 : 0;
+  uint64_t memory = kmul_context_memory(ctx);
+  uint64_t finds = c->finds - before->finds, nodes = c->nodes - before->nodes;
+  double time_us = seconds * 1e6;
+  char multiplier[24];
+
+  if (s)
+  {
+    sprintf(multiplier, "%" PRId64, m);
+  }
+  else
+  {
+    sprintf(multiplier, "%" PRIu64, (uint64_t)m);
+  }
+  fprintf(stats->f, stats->csv ? "%s,%s,%" PRId64 ",%d,%d,%d,%d," :
+    "{\"routine\":\"%s\",\"multiplier\":%s,\"searched\":%" PRId64 ",\"cost\":%d,\"ops\":%d,"
+    "\"adders\":%d,\"depth\":%d,",
+    name, multiplier, searched ? seq->multiplier : 0, cost, ops, adders, depth);
+  fprintf(stats->f, stats->csv ? "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u," :
+    "\"finds\":%" PRIu64 ",\"tries\":%" PRIu64 ",\"pruned\":%" PRIu64 ",\"lookups\":%" PRIu64 ","
+    "\"nodes\":%" PRIu64 ",\"probes\":%" PRIu64 ",\"max_probes\":%u,",
+    finds, c->tries - before->tries, c->pruned - before->pruned, c->lookups - before->lookups,
+    nodes, c->probes - before->probes, ctx->max_probes);
+  fprintf(stats->f, stats->csv ? "%u,%u,%" PRIu64 ",%.3f\n" :
+    "\"memo_slots\":%u,\"memo_used\":%u,\"memory\":%" PRIu64 ",\"time_us\":%.3f}\n",
+    memo_slots, ctx->memo_used, memory, time_us);
+
+  stats->count++;
+  stats->seconds += seconds;
+  add_sample(stats->cost, (uint64_t)cost, 0);
+  add_sample(stats->ops, (uint64_t)ops, 0);
+  add_sample(stats->depth, (uint64_t)depth, 0);
+  add_sample(stats->finds, finds, 1);
+  add_sample(stats->nodes, nodes, 1);
+  add_sample(stats->max_probes, ctx->max_probes, 0);
+  add_sample(stats->time_us, (uint64_t)time_us, 1);
+}
+
+/* Add the records of "other" (e.g. of another thread) to the histograms of
+ * "stats".
+ */
+void kmul_stats_merge(KmulStats *stats, const KmulStats *other)
+{
+  unsigned int i, k;
+
+  stats->count += other->count;
+  stats->seconds += other->seconds;
+  for (i = 0; i < NUM_HISTOGRAMS; i++)
+  {
+    for (k = 0; k < KMUL_HIST_SIZE; k++)
+    {
+      histogram(stats, i)[k] += histogram_const(other, i)[k];
+    }
+  }
+}
+
+/* Write the histograms of the batch as a final JSON line {"summary": ...} of
+ * JSON statistics, with the total wall time as "total_time_us" apart from
+ * the "time_us" histogram, and as a table to "report" if not NULL.
+ */
+void kmul_stats_summary(const KmulStats *stats, FILE *report)
+{
+  unsigned int i, k;
+
+  if (!stats->csv)
+  {
+    fprintf(stats->f, "{\"summary\":{\"routines\":%" PRIu64 ",\"total_time_us\":%.3f", stats->count,
+      stats->seconds * 1e6);
+    for (i = 0; i < NUM_HISTOGRAMS; i++)
+    {
+      const char *sep = "";
+
+      fprintf(stats->f, ",\"%s\":{", histograms[i].name);
+      for (k = 0; k < KMUL_HIST_SIZE; k++)
+      {
+        if (histogram_const(stats, i)[k] > 0)
+        {
+          fprintf(stats->f, "%s\"", sep);
+          print_bucket(stats->f, k, histograms[i].log2);
+          fprintf(stats->f, "\":%" PRIu64, histogram_const(stats, i)[k]);
+          sep = ",";
+        }
+      }
+      fprintf(stats->f, "}");
+    }
+    fprintf(stats->f, "}}\n");
+  }
+  if (report == NULL)
+  {
+    return;
+  }
+  fprintf(report, "Stats: %" PRIu64 " routines in %.3f s.\n", stats->count, stats->seconds);
+  for (i = 0; i < NUM_HISTOGRAMS; i++)
+  {
+    fprintf(report, "Stats: %-10s", histograms[i].name);
+    for (k = 0; k < KMUL_HIST_SIZE; k++)
+    {
+      if (histogram_const(stats, i)[k] > 0)
+      {
+        fprintf(report, " ");
+        print_bucket(report, k, histograms[i].log2);
+        fprintf(report, ":%" PRIu64, histogram_const(stats, i)[k]);
+      }
+    }
+    fprintf(report, "\n");
+  }
+}
@@ -0,0 +1,284 @@
+/*
+ * File       : libkmul_table.c
+ * Description: Precomputed tables of Bernstein-Briggs chains for ranges of
+ *              multipliers. A table is built once, and then memory-mapped
+ *              (read-only and shared among processes) so that routines are
+ *              emitted with a single record lookup instead of the search.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kmul.h"
+
+// Magic number at the start of a table file (includes the format version)
+#define TABLE_MAGIC     "KMULTAB3"
+// Bytes of a record before its steps: cost, number of steps, final shift and
+// a reserved byte
+#define RECORD_HEADER   4
+// Number of steps of a record falling back to the multiplier unit
+#define RECORD_MUL      0xFF
+
+/* Header of a table file. It is followed by one record of "record_size" bytes
+ * per multiplier in [lo, hi]; a record holds the chain as (opcode, shift)
+ * byte pairs. All fields are in the byte order of the building machine.
+ */
+typedef struct
+{
+  char magic[8];
+  int64_t lo, hi;
+  uint32_t max_steps, record_size;
+  int32_t add_cost, sub_cost, neg_cost, shift_cost, mult_cost;
+  int32_t fused_add_shift, fused_sub_shift, fused_rsb_shift;
+  int32_t imm_bits, ldc_cost;
+} TableHeader;
+
+
+/* Build the table of chains for the multipliers from "lo" up to "hi" (in
+ * unsigned arithmetic, as the ranges of routines, so that unsigned ranges may
+ * cross 2^63) with the cost model of the context and write it to "path".
+ * Returns 0 on success, or -1 if the file cannot be written or a cost does
+ * not fit in a record.
+ */
+int kmul_table_build(KmulContext *ctx, const char *path, int64_t lo, int64_t hi)
+{
+  TableHeader header;
+  KmulChain chain;
+  unsigned char record[RECORD_HEADER + 2*KMUL_MAX_CHAIN];
+  FILE *f;
+  int max_steps = 0, status = 0;
+  uint64_t count = (uint64_t)hi - (uint64_t)lo + 1, k;
+  int i;
+
+  // A count of zero is the full 2^64 range.
+  if (count == 0 || ctx->cost_model.mult_cost > 0xFF)
+  {
+    return -1;
+  }
+  // The first pass finds the longest chain to size the records; the second
+  // one only revisits the hash table.
+  for (k = 0; k < count; k++)
+  {
+    int64_t m = (int64_t)((uint64_t)lo + k);
+
+    if (m != 0)
+    {
+      multiply_chain(ctx, m, &chain);
+      if (chain.cost > 0xFF)
+      {
+        return -1;
+      }
+      if (chain.num_steps > max_steps)
+      {
+        max_steps = chain.num_steps;
+      }
+    }
+  }
+
+  f = fopen(path, "wb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+  header.lo = lo;
+  header.hi = hi;
+  header.max_steps = max_steps;
+  header.record_size = RECORD_HEADER + 2*max_steps;
+  header.add_cost = ctx->cost_model.add_cost;
+  header.sub_cost = ctx->cost_model.sub_cost;
+  header.neg_cost = ctx->cost_model.neg_cost;
+  header.shift_cost = ctx->cost_model.shift_cost;
+  header.mult_cost = ctx->cost_model.mult_cost;
+  header.fused_add_shift = ctx->cost_model.fused_add_shift;
+  header.fused_sub_shift = ctx->cost_model.fused_sub_shift;
+  header.fused_rsb_shift = ctx->cost_model.fused_rsb_shift;
+  header.imm_bits = ctx->cost_model.imm_bits;
+  header.ldc_cost = ctx->cost_model.ldc_cost;
+  fwrite(&header, sizeof(header), 1, f);
+
+  for (k = 0; k < count && status == 0; k++)
+  {
+    int64_t m = (int64_t)((uint64_t)lo + k);
+
+    memset(record, 0, sizeof(record));
+    if (m != 0)
+    {
+      multiply_chain(ctx, m, &chain);
+      // The search state may have been reset since the first pass, finding
+      // another chain of the same cost, which must still fit in a record.
+      if (chain.cost > 0xFF || chain.num_steps > max_steps)
+      {
+        status = -1;
+        break;
+      }
+      record[0] = (unsigned char)chain.cost;
+      record[1] = (chain.num_steps == KMUL_CHAIN_MUL) ? RECORD_MUL : (unsigned char)chain.num_steps;
+      record[2] = (unsigned char)chain.shift;
+      for (i = 0; i < chain.num_steps; i++)
+      {
+        record[RECORD_HEADER + 2*i] = chain.steps[i].opcode;
+        record[RECORD_HEADER + 2*i + 1] = chain.steps[i].shift;
+      }
+    }
+    fwrite(record, header.record_size, 1, f);
+  }
+
+  if (fclose(f) != 0 || status != 0)
+  {
+    remove(path);
+    return -1;
+  }
+  return 0;
+}
+
+/* Map the table stored in "path". Returns NULL if the file cannot be mapped
+ * or is not a valid table.
+ */
+KmulTable *kmul_table_open(const char *path)
+{
+  KmulTable *table;
+  TableHeader header;
+  struct stat st;
+  uint64_t count;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TableHeader))
+  {
+    close(fd);
+    return NULL;
+  }
+  // The mapping is shared, so concurrent users of a table share its pages.
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return NULL;
+  }
+  memcpy(&header, data, sizeof(header));
+  // The records of [lo, hi], counted in unsigned arithmetic, fill the file.
+  count = (uint64_t)header.hi - (uint64_t)header.lo + 1;
+  if (memcmp(header.magic, TABLE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.max_steps > KMUL_MAX_CHAIN ||
+      header.record_size != RECORD_HEADER + 2*header.max_steps ||
+      count == 0 || count > ((uint64_t)st.st_size - sizeof(header)) / header.record_size ||
+      (uint64_t)st.st_size != sizeof(header) + count * header.record_size)
+  {
+    munmap(data, st.st_size);
+    return NULL;
+  }
+
+  table = malloc(sizeof(KmulTable));
+  if (table == NULL)
+  {
+    munmap(data, st.st_size);
+    return NULL;
+  }
+  table->data = data;
+  table->size = st.st_size;
+  table->records = table->data + sizeof(header);
+  table->lo = header.lo;
+  table->hi = header.hi;
+  table->max_steps = header.max_steps;
+  table->record_size = header.record_size;
+  table->cost_model.add_cost = header.add_cost;
+  table->cost_model.sub_cost = header.sub_cost;
+  table->cost_model.neg_cost = header.neg_cost;
+  table->cost_model.shift_cost = header.shift_cost;
+  table->cost_model.mult_cost = header.mult_cost;
+  table->cost_model.fused_add_shift = header.fused_add_shift;
+  table->cost_model.fused_sub_shift = header.fused_sub_shift;
+  table->cost_model.fused_rsb_shift = header.fused_rsb_shift;
+  table->cost_model.imm_bits = header.imm_bits;
+  table->cost_model.ldc_cost = header.ldc_cost;
+  return table;
+}
+
+/* Unmap a table.
+ */
+void kmul_table_close(KmulTable *table)
+{
+  if (table != NULL)
+  {
+    munmap((void *)table->data, table->size);
+    free(table);
+  }
+}
+
+/* Use the chains of a table instead of the search in the given context. The
+ * table is only used if it was built with the cost model of the context.
+ * Returns 1 if the table is used.
+ */
+int kmul_use_table(KmulContext *ctx, const KmulTable *table)
+{
+  const KmulCostModel *a = &ctx->cost_model;
+  const KmulCostModel *b = &table->cost_model;
+
+  if (a->add_cost != b->add_cost || a->sub_cost != b->sub_cost ||
+      a->neg_cost != b->neg_cost || a->shift_cost != b->shift_cost ||
+      a->mult_cost != b->mult_cost || a->fused_add_shift != b->fused_add_shift ||
+      a->fused_sub_shift != b->fused_sub_shift || a->fused_rsb_shift != b->fused_rsb_shift ||
+      a->imm_bits != b->imm_bits || a->ldc_cost != b->ldc_cost)
+  {
+    return 0;
+  }
+  ctx->table = table;
+  return 1;
+}
+
+/* Read the chain of "m" from a table. Returns 0 if "m" is out of the range of
+ * the table.
+ */
+int kmul_table_chain(const KmulTable *table, int64_t m, KmulChain *chain)
+{
+  uint64_t index = (uint64_t)m - (uint64_t)table->lo;
+  const unsigned char *record;
+  int i;
+
+  if (index > (uint64_t)table->hi - (uint64_t)table->lo)
+  {
+    return 0;
+  }
+  record = table->records + (size_t)index * table->record_size;
+  chain->target = m;
+  chain->cost = record[0];
+  chain->num_steps = (record[1] == RECORD_MUL) ? KMUL_CHAIN_MUL : record[1];
+  chain->shift = record[2];
+  for (i = 0; i < chain->num_steps; i++)
+  {
+    chain->steps[i].opcode = record[RECORD_HEADER + 2*i];
+    chain->steps[i].shift = record[RECORD_HEADER + 2*i + 1];
+  }
+  return 1;
+}
@@ -0,0 +1,248 @@
+/*
+ * File       : libkmul_vec.c
+ * Description: Emission of array kernels multiplying whole buffers by a
+ *              constant with the SSE2 or AVX2 shift/add/sub intrinsics of the
+ *              chosen operation sequence.
+ * Author     : Nikolaos Kavvadias <nikolaos.kavvadias@gmail.com>
+ * Copyright  : (C) Nikolaos Kavvadias 2006-2021
+ * Website    : http://www.nkavvadias.com
+ *
+ * This file is part of kmul, and is distributed under the terms of the
+ * Modified BSD License.
+ *
+ * A copy of the Modified BSD License is included with this distrubution
+ * in the files COPYING.BSD.
+ * kmul is free software: you can redistribute it and/or modify it under the
+ * terms of the Modified BSD License.
+ * kmul is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the Modified BSD License for more details.
+ *
+ * You should have received a copy of the Modified BSD License along with
+ * kmul. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "kmul.h"
+
+/* Naming of the intrinsics of a vector instruction set. */
+typedef struct
+{
+  const char *type;     /* vector type */
+  const char *prefix;   /* prefix of the intrinsics */
+  const char *suffix;   /* suffix of the whole-register intrinsics */
+  unsigned int bits;    /* width of a vector */
+} VecIsa;
+
+static const VecIsa vec_isas[] =
+{
+  {NULL, NULL, NULL, 0},
+  {"__m128i", "_mm", "si128", 128},
+  {"__m256i", "_mm256", "si256", 256}
+};
+
+
+/* Emit the includes needed by the array kernels. */
+void emit_vec_prologue(FILE *f, KmulVecIsa isa)
+{
+  fprintf(f, "#include <stddef.h>\n");
+  fprintf(f, "#include <%s>\n", (isa == VEC_AVX2) ? "immintrin.h" : "emmintrin.h");
+}
+
+static void print_vec_operand(FILE *f, int operand)
+{
+  if (operand == KMUL_X)
+  {
+    fprintf(f, "x");
+  }
+  else
+  {
+    fprintf(f, "t%d", operand);
+  }
+}
+
+/* Print a vector with "value" in every lane of "lane" bits. */
+static void print_vec_splat(FILE *f, const VecIsa *v, unsigned int lane, int64_t value)
+{
+  if (lane == 64)
+  {
+    fprintf(f, "%s_set1_epi64x(INT64_C(%" PRId64 "))", v->prefix, value);
+  }
+  else if (lane == 32)
+  {
+    fprintf(f, "%s_set1_epi32(%" PRId32 ")", v->prefix, (int32_t)(uint32_t)value);
+  }
+  else
+  {
+    // 8- and 16-bit lanes take the truncated value.
+    fprintf(f, "%s_set1_epi%u(%d)", v->prefix, lane,
+      (lane == 16) ? (int)(int16_t)(uint16_t)value : (int)(int8_t)(uint8_t)value);
+  }
+}
+
+/* Print an operation of the sequence on vectors of "lane"-bit lanes. There
+ * are no 8-bit shifts, so 16-bit lanes are shifted and the bits shifted in
+ * from the lower lane are cleared. Multiplications (only kept for the lanes
+ * of has_vec_mul()) use the multiplier of the lanes.
+ */
+static void print_vec_op(FILE *f, const VecIsa *v, unsigned int lane, const KmulOp *op)
+{
+  fprintf(f, "    t%d = ", op->dst);
+  switch (op->opcode)
+  {
+    case KMUL_LDC:
+      print_vec_splat(f, v, lane, op->imm);
+      break;
+    case KMUL_MOV:
+      print_vec_operand(f, op->src1);
+      break;
+    case KMUL_NEG:
+      fprintf(f, "%s_sub_epi%u(%s_setzero_%s(), ", v->prefix, lane, v->prefix, v->suffix);
+      print_vec_operand(f, op->src1);
+      fprintf(f, ")");
+      break;
+    case KMUL_SHL:
+      if (lane == 8)
+      {
+        fprintf(f, "%s_and_%s(%s_slli_epi16(", v->prefix, v->suffix, v->prefix);
+        print_vec_operand(f, op->src1);
+        fprintf(f, ", %" PRId64 "), ", op->imm);
+        print_vec_splat(f, v, 8, (op->imm < 8) ? (int64_t)(0xFF << op->imm) : 0);
+        fprintf(f, ")");
+      }
+      else
+      {
+        fprintf(f, "%s_slli_epi%u(", v->prefix, lane);
+        print_vec_operand(f, op->src1);
+        fprintf(f, ", %" PRId64 ")", op->imm);
+      }
+      break;
+    case KMUL_MUL:
+      fprintf(f, "%s_mullo_epi%u(", v->prefix, lane);
+      print_vec_operand(f, op->src1);
+      fprintf(f, ", ");
+      print_vec_splat(f, v, lane, op->imm);
+      fprintf(f, ")");
+      break;
+    case KMUL_ADD:
+    case KMUL_SUB:
+      fprintf(f, "%s_%s_epi%u(", v->prefix, (op->opcode == KMUL_ADD) ? "add" : "sub", lane);
+      print_vec_operand(f, op->src1);
+      fprintf(f, ", ");
+      print_vec_operand(f, op->src2);
+      fprintf(f, ")");
+      break;
+  }
+  fprintf(f, ";\n");
+}
+
+/* Return whether "isa" multiplies vectors of "lane"-bit lanes (keeping the
+ * low half of the products): mullo_epi16 for 16-bit lanes, and with AVX2
+ * mullo_epi32 for 32-bit lanes. 8-bit lanes have no multiplier, and 64-bit
+ * lanes only with AVX-512.
+ */
+static int has_vec_mul(KmulVecIsa isa, unsigned int lane)
+{
+  return (lane == 16 || (lane == 32 && isa == VEC_AVX2));
+}
+
+/* Emit the array kernel "<routine>_vec" multiplying the "n" elements of "in"
+ * by "m" into "out" with the vector instruction set of the context, followed
+ * by a scalar tail calling the routine itself. The kernel follows the C99
+ * routine emitted by emit_kmul() and reuses its operation sequence. That
+ * keeps a multiplication only where no sequence is cheaper under the cost
+ * model, and so does the kernel where the lanes have a vector multiplier;
+ * for other lanes, the multiplication is replaced by the CSD decomposition.
+ */
+void emit_kmul_vec(KmulContext *ctx, ConstMulAlg alg, int64_t m, int s, unsigned int W)
+{
+  FILE *f = ctx->fout;
+  const VecIsa *v = &vec_isas[ctx->vec];
+  unsigned int lane = set_data_width(C99, W);
+  unsigned int lanes = v->bits / lane;
+  char *dt = get_c_type(C99, s, W);
+  char name[KMUL_NAME_SIZE];
+  int num_vars = 0, reads_x = 0;
+  int *var = NULL;
+  int i;
+
+  if (m != 0)
+  {
+    for (i = 0; i < ctx->seq.num_ops; i++)
+    {
+      if (ctx->seq.ops[i].opcode == KMUL_MUL && !has_vec_mul(ctx->vec, lane))
+      {
+        ctx->seq.num_ops = 0;
+        ctx->count = 0;
+        csd_decomposition(ctx, m);
+        kmul_optimize_sequence(&ctx->seq, &ctx->seq.result, 1);
+        break;
+      }
+    }
+    var = malloc(ctx->seq.num_ops * sizeof(int));
+    if (var == NULL)
+    {
+      fprintf(stderr, "Error: Out of memory for %d temporaries.\n", ctx->seq.num_ops);
+      exit(EXIT_FAILURE);
+    }
+    num_vars = kmul_assign_temps(&ctx->seq, &ctx->seq.result, 1, var);
+    // A multiplier congruent to 0 (e.g. 256 in 8 bits) leaves the input
+    // unread, and then it is not loaded.
+    for (i = 0; i < ctx->seq.num_ops; i++)
+    {
+      const KmulOp *op = &ctx->seq.ops[i];
+
+      reads_x |= (op->opcode != KMUL_LDC && op->src1 == KMUL_X) ||
+        ((op->opcode == KMUL_ADD || op->opcode == KMUL_SUB) && op->src2 == KMUL_X);
+    }
+  }
+
+  kmul_routine_name(name, alg, m, s, W);
+  fprintf(f, "\n");
+  fprintf(f, "void %s_vec (const %s *in, %s *out, size_t n)\n", name, dt, dt);
+  fprintf(f, "{\n");
+  fprintf(f, "  size_t i = 0;\n");
+  if (m == 0 || reads_x)
+  {
+    fprintf(f, "  %s x;\n", v->type);
+  }
+  for (i = 0; i < num_vars; i++)
+  {
+    fprintf(f, "  %s t%d;\n", v->type, i);
+  }
+  fprintf(f, "  for (; i + %u <= n; i += %u)\n", lanes, lanes);
+  fprintf(f, "  {\n");
+  if (m == 0)
+  {
+    fprintf(f, "    x = %s_setzero_%s();\n", v->prefix, v->suffix);
+    fprintf(f, "    %s_storeu_%s((%s *)(out + i), x);\n", v->prefix, v->suffix, v->type);
+  }
+  else
+  {
+    if (reads_x)
+    {
+      fprintf(f, "    x = %s_loadu_%s((const %s *)(in + i));\n", v->prefix, v->suffix, v->type);
+    }
+    for (i = 0; i < ctx->seq.num_ops; i++)
+    {
+      KmulOp op = kmul_rename_op(&ctx->seq.ops[i], var);
+
+      print_vec_op(f, v, lane, &op);
+    }
+    fprintf(f, "    %s_storeu_%s((%s *)(out + i), t%d);\n", v->prefix, v->suffix, v->type,
+      var[ctx->seq.result]);
+  }
+  fprintf(f, "  }\n");
+  fprintf(f, "  for (; i < n; i++)\n");
+  fprintf(f, "  {\n");
+  fprintf(f, "    out[i] = %s(in[i]);\n", name);
+  fprintf(f, "  }\n");
+  fprintf(f, "}\n");
+
+  free(var);
+  free(dt);
+}
@@ -5,28 +5,12 @@
 long kmul_o_s32_p_23 (long x)
 {
   long t0;
-  long t1;
-  long t2;
-  long t3;
-  long t4;
-  long t5;
-  long t6;
-  long t7;
-  long t8;
-  long t9;
-  long t10;
-  long t11;
-  long t12;
-  long t13;
-  long t14;
-  long t15;
   long y;
-  t0 = x;
-  t1 = t0 << 1;
-  t2 = t1 + x;
-  t3 = t2 << 3;
-  t4 = t3 - x;
-  y = t4;
+  t0 = x << 1;
+  t0 = t0 + x;
+  t0 = t0 << 3;
+  t0 = t0 - x;
+  y = t0;
   return (y);
 }
 
@@ -5,7 +5,7 @@ EXE=.exe
 # Test unsigned and signed multiplications
 for mulu in "0" "1" "2" "3" "4" "5" "6" "7" "8" "9" "10" "11" "23" "37" "43" "111" "255"
 do
-  for alg in "" "-bindecomp"
+  for alg in "" "-bindecomp" "-csd" "-optimal"
   do
     ./kmul${EXE} ${alg} -mul ${mulu} -width 32 -unsigned -nac
     ./kmul${EXE} ${alg} -mul ${mulu} -width 32 -unsigned -ansic
@@ -13,12 +13,107 @@ do
 done
 for muls in "-255" "-111" "-43" "-3" "-2" "-1" "1" "2" "3" "4" "5" "6" "7" "8" "9" "10" "11" "23" "37" "43" "111" "255"
 do
-  for alg in "" "-bindecomp"
+  for alg in "" "-bindecomp" "-csd" "-optimal"
   do
     ./kmul${EXE} ${alg} -mul ${muls} -width 32 -signed -nac
     ./kmul${EXE} ${alg} -mul ${muls} -width 32 -signed -ansic
   done
 done
+# Test 64-bit multiplications
+for mul64 in "0xFFFFFFFF" "0x100000001" "0x9E3779B97F4A7C15" "0xFFFFFFFFFFFFFFFF"
+do
+  ./kmul${EXE} -mul ${mul64} -width 64 -unsigned -c99
+done
+./kmul${EXE} -mul -9223372036854775808 -width 64 -signed -c99
+# Test multipliers needing all bits of the data width, verified by the harness
+./kmul${EXE} -mul 0xFFFFFFFF -width 32 -unsigned -c99 -bench
+# Test depth-minimizing sequences
+for alg in "" "-bindecomp" "-csd"
+do
+  ./kmul${EXE} ${alg} -mul 1000001 -width 32 -unsigned -c99 -minimize depth
+  ./kmul${EXE} ${alg} -mul -21845 -width 32 -signed -nac -minimize depth
+done
+# Test target profiles
+for target in "generic" "x86-64" "aarch64" "rv64-zba"
+do
+  ./kmul${EXE} -mul 45 -width 32 -unsigned -c99 -target ${target}
+  ./kmul${EXE} -mul -1000001 -width 32 -signed -nac -target ${target}
+done
+# Test the modular search, verified for all 8-bit multiplicands
+./kmul${EXE} -modular -range 0 255 -width 8 -unsigned -c99 -bench
+./kmul${EXE} -modular -range -128 127 -width 8 -signed -ansic -bench
+./kmul${EXE} -modular -mul 0xFFFFFFF1 -width 32 -unsigned -c99 -bench
+./kmul${EXE} -modular -csd -mul 0xFFFF00FF -width 32 -unsigned -nac
+# Test the search statistics, as JSON lines and as CSV
+./kmul${EXE} -range 1 1000 -width 32 -unsigned -nac -stats kmul_stats.jsonl
+./kmul${EXE} -threads 4 -range -500 500 -width 16 -signed -c99 -stats kmul_stats.csv
+# Test the quality report comparing all algorithms
+./kmul${EXE} -report 0 4095 -width 16 -unsigned
+./kmul${EXE} -report -300 300 -signed -target x86-64 -minimize depth
+./kmul${EXE} -modular -report -128 127 -width 8 -signed
+# Test multiple constant multiplications
+./kmul${EXE} -mcm -7,35,153,193,153,35,-7 -width 16 -signed -nac
+./kmul${EXE} -mcm -7,35,153,193,153,35,-7 -width 16 -signed -c99
+./kmul${EXE} -mcm 0,1,6,96,0x10001 -width 32 -unsigned -ansic
+# Test array kernels
+for vec in "sse2" "avx2"
+do
+  for width in "8" "16" "32" "64"
+  do
+    ./kmul${EXE} -mul 181 -width ${width} -signed -c99 -vec ${vec}
+    ./kmul${EXE} -mul 1000 -width ${width} -unsigned -c99 -vec ${vec} -target x86-64
+  done
+done
+# A dense multiplier keeps the multiplication, and so do 32-bit AVX2 lanes.
+./kmul${EXE} -mul 0x9E3779B9 -width 32 -unsigned -c99 -vec avx2 -target x86-64
+# Test LLVM IR emission for exact data widths
+for width in "5" "17" "32" "48"
+do
+  ./kmul${EXE} -mul 100 -width ${width} -signed -llvm
+  ./kmul${EXE} -csd -mul 27 -width ${width} -unsigned -llvm
+done
+# Test assembly backends
+for backend in "-x86-64" "-aarch64"
+do
+  ./kmul${EXE} -mul 45 -width 32 -unsigned ${backend}
+  ./kmul${EXE} -mul -1000001 -width 64 -signed ${backend}
+done
+# Test the verification and micro-benchmark harness
+./kmul${EXE} -mul 77 -width 16 -signed -ansic -bench
+./kmul${EXE} -mul 1000001 -width 64 -unsigned -c99 -bench
+# Test division and remainder by constants, verified for all 16-bit dividends
+for op in "-div" "-mod"
+do
+  for d in "1" "3" "7" "10" "64" "641" "65535"
+  do
+    ./kmul${EXE} ${op} ${d} -width 16 -unsigned -c99 -bench
+  done
+  for d in "-32768" "-10" "-1" "3" "7" "4096" "32767"
+  do
+    ./kmul${EXE} -csd ${op} ${d} -width 16 -signed -ansic -bench
+  done
+  ./kmul${EXE} ${op} 4294967291 -width 32 -unsigned -c99 -bench
+  ./kmul${EXE} ${op} -1000 -width 32 -signed -c99 -bench
+  ./kmul${EXE} ${op} 7 -width 12 -unsigned -nac
+  ./kmul${EXE} ${op} -10 -width 32 -signed -nac
+done
+# Test the JIT compilation on x86-64 hosts
+if [ "$(uname -m)" = "x86_64" ]
+then
+  for alg in "" "-bindecomp" "-csd" "-optimal"
+  do
+    ./kmul${EXE} ${alg} -range -300 300 -signed -jit
+  done
+  ./kmul${EXE} -mul 0x9E3779B97F4A7C15 -width 64 -unsigned -jit
+fi
+# Test the C++ header backend (checked by test_cxx.sh)
+./kmul${EXE} -cxx kmul.hpp -target x86-64
+# Test Verilog/VHDL emission, combinational and pipelined
+for rtl in "-verilog" "-vhdl"
+do
+  ./kmul${EXE} -mul 181 -width 12 -signed ${rtl}
+  ./kmul${EXE} -csd -mul 0x9E3779B9 -width 32 -unsigned ${rtl} -pipeline 3
+done
 
 if [ "$SECONDS" -eq 1 ]
 then
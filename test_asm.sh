@@ -0,0 +1,158 @@
+#!/bin/bash
+
+# Assemble the routines of the x86-64 and AArch64 backends, call them from C
+# and compare their products against the C multiplication. AArch64 routines
+# are built with aarch64-linux-gnu-gcc and run natively or with qemu-aarch64,
+# when available.
+
+EXE=.exe
+KMUL=$(pwd)/kmul${EXE}
+WORK=$(mktemp -d)
+trap 'rm -rf "${WORK}"' EXIT
+status=0
+
+# Test cases: width, signedness and the kmul options selecting the routines
+cases=(
+  "8 -unsigned -range 0 255"
+  "8 -signed -range -128 127"
+  "16 -signed -range -300 300"
+  "16 -unsigned -range 65000 65535"
+  "32 -signed -range -300 300"
+  "32 -unsigned -range 0 600"
+  "32 -signed -target generic -range -300 300"
+  "32 -unsigned -target generic -range 0 600"
+  "32 -unsigned -bindecomp -range 1000 1100"
+  "32 -signed -csd -range -1100 -1000"
+  "32 -unsigned -optimal -timeout 100 -range 150 200"
+  "32 -unsigned -minimize depth -range 1000000 1000100"
+  "32 -unsigned -mul 0xFFFFFFFF"
+  "32 -signed -target generic -mul -21845"
+  "16 -unsigned -modular -range 65000 65535"
+  "32 -unsigned -modular -range 4294967000 4294967295"
+  "64 -unsigned -range 0 300"
+  "64 -signed -range -100 100"
+  "64 -unsigned -target generic -range 0 300"
+  "64 -unsigned -mul 0x9E3779B97F4A7C15"
+  "64 -unsigned -mul 0xFFFFFFFFFFFFFFFF"
+  "64 -signed -mul -9223372036854775808"
+  "64 -unsigned -bindecomp -minimize depth -mul 0x5555555555555555"
+  "64 -unsigned -csd -minimize depth -mul 0x5555555555555555"
+)
+
+# Write the C driver checking the routines of assembly file $1 for data
+# width $2 (sign $3) into $4.
+write_driver ()
+{
+  local width=$2 type=uint
+  if [ "$3" = "-signed" ]
+  then
+    type=int
+  fi
+  if [ "$width" -le 8 ]; then width=8
+  elif [ "$width" -le 16 ]; then width=16
+  elif [ "$width" -le 32 ]; then width=32
+  else width=64
+  fi
+  type="${type}${width}_t"
+  {
+    echo "#include <stdio.h>"
+    echo "#include <stdint.h>"
+    for name in $(sed -n 's/^\(kmul_[a-z0-9_]*\):$/\1/p' "$1")
+    do
+      echo "${type} ${name} (${type} x);"
+    done
+    echo "static const struct { ${type} (*f)(${type}); uint64_t m; const char *name; } routines[] = {"
+    for name in $(sed -n 's/^\(kmul_[a-z0-9_]*\):$/\1/p' "$1")
+    do
+      m=${name##*_}
+      case ${name} in
+        *_m_*) echo "  { ${name}, (uint64_t)0 - UINT64_C(${m}), \"${name}\" },";;
+        *)     echo "  { ${name}, UINT64_C(${m}), \"${name}\" },";;
+      esac
+    done
+    echo "};"
+    cat <<EOF
+int main (void)
+{
+  uint64_t seed = UINT64_C(0x2545F4914F6CDD1D);
+  unsigned int i, k, fails = 0;
+  for (i = 0; i < sizeof(routines) / sizeof(routines[0]); i++)
+  {
+    for (k = 0; k < 256; k++)
+    {
+      ${type} x, y;
+      seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+      x = (${type})((k < 4) ? (uint64_t)0 - k : (k < 8) ? ((uint64_t)1 << ($width - 1)) - (k - 4) : seed);
+      y = routines[i].f(x);
+      if (y != (${type})((uint64_t)x * routines[i].m))
+      {
+        if (fails++ < 10) printf("FAIL: %s(%lld)\n", routines[i].name, (long long)x);
+      }
+    }
+  }
+  printf("%u routines, %u failures\n", (unsigned int)(sizeof(routines) / sizeof(routines[0])), fails);
+  return (fails != 0);
+}
+EOF
+  } > "$4"
+}
+
+# Run the test cases for backend $1, building with compiler $2 and running
+# with $3 (empty to run natively, "-" to only assemble the routines).
+check_backend ()
+{
+  local backend=$1 cc=$2 run=$3 n=0 flags=""
+  if [ -n "${run}" ]
+  then
+    flags="-static"
+  fi
+  for c in "${cases[@]}"
+  do
+    set -- ${c}
+    local width=$1 sign=$2
+    shift 2
+    n=$((n + 1))
+    mkdir -p "${WORK}/${backend}${n}"
+    cd "${WORK}/${backend}${n}" || exit 1
+    ${KMUL} -width "${width}" "${sign}" "$@" -"${backend}" > /dev/null
+    asm=$(ls kmul_*.s)
+    echo -n "${backend} -width ${width} ${sign} $*: "
+    if [ "${run}" = "-" ]
+    then
+      ${cc} -c "${asm}" -o routines.o && echo "assembled" || status=1
+    else
+      write_driver "${asm}" "${width}" "${sign}" driver.c
+      if ${cc} -O1 -std=c99 ${flags} driver.c "${asm}" -o driver${EXE}
+      then
+        ${run} ./driver${EXE} || status=1
+      else
+        status=1
+      fi
+    fi
+    cd - > /dev/null || exit 1
+  done
+}
+
+if [ "$(uname -m)" = "x86_64" ]
+then
+  check_backend x86-64 "${CC:-gcc}" ""
+else
+  echo "Skipping the x86-64 backend: not an x86-64 host."
+fi
+
+if [ "$(uname -m)" = "aarch64" ]
+then
+  check_backend aarch64 "${CC:-gcc}" ""
+elif command -v aarch64-linux-gnu-gcc > /dev/null
+then
+  if command -v qemu-aarch64 > /dev/null
+  then
+    check_backend aarch64 aarch64-linux-gnu-gcc qemu-aarch64
+  else
+    check_backend aarch64 aarch64-linux-gnu-gcc -
+  fi
+else
+  echo "Skipping the AArch64 backend: aarch64-linux-gnu-gcc not found."
+fi
+
+exit ${status}
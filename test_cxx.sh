@@ -0,0 +1,109 @@
+#!/bin/bash
+
+# Write the C++ header of each target profile with "-cxx" and check
+# kmul::mul<C> with static_assert for the multipliers of test.sh, on all the
+# integer types of up to 64 bits, in C++17 and C++20 (when supported). The
+# chains on int64_t must have as many additions/subtractions as the routines
+# of kmul for the same target.
+
+EXE=.exe
+KMUL=$(pwd)/kmul${EXE}
+CXX=${CXX:-g++}
+WORK=$(mktemp -d)
+trap 'rm -rf "${WORK}"' EXIT
+status=0
+
+multipliers=(
+  0 1 2 3 4 5 6 7 8 9 10 11 23 37 43 111 255
+  -255 -111 -43 -3 -2 -1
+  0xFFFFFFFF 0x100000001 0x9E3779B97F4A7C15 0xFFFFFFFFFFFFFFFF
+  -9223372036854775808
+  1000001 -21845 45 -1000001 -7 35 153 193 0x10001 181 1000 100 27 77
+  0x9E3779B9 0x5555555555555555
+)
+
+# The C++ literal of multiplier $1
+literal ()
+{
+  case $1 in
+    -9223372036854775808) echo "(-9223372036854775807ll - 1)";;
+    0x*)                  echo "$1ull";;
+    -*)                   echo "($1ll)";;
+    *)                    echo "$1ll";;
+  esac
+}
+
+# Write the static_assert test of the header for target $1 into $2.
+write_test ()
+{
+  {
+    cat <<EOF
+#include <cstdint>
+#include "kmul.hpp"
+
+// x * C on T for edge values of x, against the multiplication modulo 2^64
+template <auto C, typename T>
+constexpr bool check()
+{
+  constexpr std::uint64_t values[] = {
+    0, 1, 2, 3, 7, 0x7F, 0x80, 0xFF, 0x7FFF, 0x8000, 0xFFFF, 0x7FFFFFFF,
+    0x80000000, 0xFFFFFFFF, 0x123456789ABCDEF, 0x7FFFFFFFFFFFFFFF,
+    0x8000000000000000, 0xFFFFFFFFFFFFFFFF
+  };
+
+  for (std::uint64_t v : values)
+  {
+    T x = static_cast<T>(v);
+    if (kmul::mul<C>(x) != static_cast<T>(static_cast<std::uint64_t>(x) * static_cast<std::uint64_t>(C)))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <auto C>
+constexpr bool check_all()
+{
+  return check<C, signed char>() && check<C, unsigned char>() &&
+    check<C, std::int16_t>() && check<C, std::uint16_t>() &&
+    check<C, std::int32_t>() && check<C, std::uint32_t>() &&
+    check<C, std::int64_t>() && check<C, std::uint64_t>() &&
+    check<C, long>() && check<C, unsigned long long>();
+}
+
+EOF
+    for m in "${multipliers[@]}"
+    do
+      c=$(literal "${m}")
+      n=$(${KMUL} -mul "${m}" -width 64 -signed -nac -target "$1" |
+        sed -n 's/^Info: kmul_.*: \([0-9]*\) additions.*/\1/p')
+      rm -f kmul_o_s64_*.nac
+      echo "static_assert(check_all<${c}>(), \"kmul::mul<${m}>\");"
+      echo "static_assert(kmul::sequence<${c}, std::int64_t>::additions == ${n}, \"${n} additions/subtractions for ${m}\");"
+    done
+  } > "$2"
+}
+
+cd "${WORK}" || exit 1
+for target in "generic" "x86-64" "aarch64" "rv64-zba"
+do
+  ${KMUL} -cxx kmul.hpp -target "${target}"
+  write_test "${target}" test.cpp
+  for std in "c++17" "c++20"
+  do
+    if [ "${std}" = "c++20" ] && ! echo "" | ${CXX} -std=c++20 -x c++ -fsyntax-only - 2> /dev/null
+    then
+      continue
+    fi
+    echo -n "-cxx -target ${target}, -std=${std}: "
+    if ${CXX} -std=${std} -Wall -Wextra -pedantic -fsyntax-only test.cpp
+    then
+      echo "${#multipliers[@]} multipliers passed"
+    else
+      status=1
+    fi
+  done
+done
+
+exit ${status}
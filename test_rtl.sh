@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Simulate the Verilog and VHDL routines with their self-checking testbenches,
+# using Icarus Verilog (iverilog/vvp) and GHDL when available.
+
+EXE=.exe
+KMUL=$(pwd)/kmul${EXE}
+WORK=$(mktemp -d)
+trap 'rm -rf "${WORK}"' EXIT
+status=0
+
+# Test cases: the kmul options selecting the routines
+cases=(
+  "-width 8 -unsigned -range 0 255"
+  "-width 8 -signed -range -128 127 -pipeline 2"
+  "-width 13 -signed -csd -range -300 300 -pipeline 1"
+  "-width 16 -unsigned -range 65000 65535 -pipeline 3"
+  "-width 32 -signed -minimize depth -range -1100 -1000 -pipeline 2"
+  "-width 32 -unsigned -mul 0xFFFFFFFF -pipeline 1"
+  "-width 32 -unsigned -csd -mul 0x9E3779B9 -pipeline 4"
+  "-width 64 -signed -range -100 100"
+  "-width 64 -unsigned -mul 0x9E3779B97F4A7C15 -pipeline 5"
+)
+
+# Compile and run the Verilog testbench $1.
+run_verilog ()
+{
+  iverilog -o tb.vvp $(ls kmul_*.v | grep -v '_tb\.v$') "$1.v" && vvp -n tb.vvp
+}
+
+# Analyze, elaborate and run the VHDL testbench $1.
+run_vhdl ()
+{
+  ghdl -a $(ls kmul_*.vhd | grep -v '_tb\.vhd$') "$1.vhd" && ghdl -e "$1" && ghdl -r "$1"
+}
+
+# Run the test cases for language $1 with simulation function $2.
+check_language ()
+{
+  local lang=$1 sim=$2 n=0
+  for c in "${cases[@]}"
+  do
+    n=$((n + 1))
+    mkdir -p "${WORK}/${lang}${n}"
+    cd "${WORK}/${lang}${n}" || exit 1
+    ${KMUL} ${c} -"${lang}" > /dev/null
+    tb=$(ls kmul_*_tb.*)
+    echo -n "${lang} ${c}: "
+    if ${sim} "${tb%.*}" > sim.log 2>&1 && grep -q "PASS" sim.log && ! grep -q "FAIL" sim.log
+    then
+      grep -o "PASS.*" sim.log
+    else
+      echo "FAIL"
+      head -20 sim.log
+      status=1
+    fi
+    cd - > /dev/null || exit 1
+  done
+}
+
+if command -v iverilog > /dev/null && command -v vvp > /dev/null
+then
+  check_language verilog run_verilog
+else
+  echo "Skipping the Verilog backend: iverilog not found."
+fi
+
+if command -v ghdl > /dev/null
+then
+  check_language vhdl run_vhdl
+else
+  echo "Skipping the VHDL backend: ghdl not found."
+fi
+
+exit ${status}